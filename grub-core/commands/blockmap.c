@@ -0,0 +1,430 @@
+/* blockmap.c - read boot files through a recorded block map */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/extcmd.h>
+#include <grub/file.h>
+#include <grub/disk.h>
+#include <grub/device.h>
+#include <grub/fs.h>
+#include <grub/env.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/crypto.h>
+#include <grub/normal.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define BLOCKMAP_HASH "sha256"
+#define BLOCKMAP_HASH_SIZE 32
+
+/* A boot file that is to be read through its block list.  */
+struct blockmap_entry
+{
+  struct blockmap_entry *next;
+  /* Block list file name handed out in place of PATH.  */
+  char *name;
+  char *path;
+  grub_uint64_t size;
+  grub_uint8_t hash[BLOCKMAP_HASH_SIZE];
+};
+
+static struct blockmap_entry *entries;
+
+/* Contents of a block list file that matched its recorded hash.  */
+struct blockmap_file
+{
+  grub_file_t file;
+  char *buf;
+};
+
+static const struct grub_arg_option options[] =
+  {
+    {"set", 's', 0,
+     N_("Set a variable to the name to open FILE with."), N_("VARNAME"),
+     ARG_TYPE_STRING},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+static int
+hextoval (char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static void
+entry_free (struct blockmap_entry *entry)
+{
+  grub_free (entry->name);
+  grub_free (entry->path);
+  grub_free (entry);
+}
+
+static grub_ssize_t
+blockmap_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  struct blockmap_file *data = file->data;
+
+  grub_memcpy (buf, data->buf + file->offset, len);
+  return len;
+}
+
+static grub_err_t
+blockmap_close (grub_file_t file)
+{
+  struct blockmap_file *data = file->data;
+
+  grub_file_close (data->file);
+  grub_free (data->buf);
+  grub_free (data);
+  file->data = 0;
+
+  /* device and name are freed by parent */
+  file->device = 0;
+  file->name = 0;
+
+  return grub_errno;
+}
+
+static struct grub_fs blockmap_fs =
+  {
+    .name = "blockmap",
+    .read = blockmap_read,
+    .close = blockmap_close
+  };
+
+/* Read IO, the block list of ENTRY, into memory and check its hash.  */
+static grub_file_t
+blockmap_load (grub_file_t io, struct blockmap_entry *entry)
+{
+  const gcry_md_spec_t *hash;
+  grub_uint8_t result[BLOCKMAP_HASH_SIZE];
+  struct blockmap_file *data;
+  grub_file_t ret;
+
+  if (io->size != ALIGN_UP (entry->size, GRUB_DISK_SECTOR_SIZE)
+      || entry->size >> (sizeof (grub_size_t) * GRUB_CHAR_BIT - 1))
+    return NULL;
+
+  hash = grub_crypto_lookup_md_by_name (BLOCKMAP_HASH);
+  if (!hash || hash->mdlen != BLOCKMAP_HASH_SIZE)
+    return NULL;
+
+  ret = grub_malloc (sizeof (*ret));
+  data = grub_malloc (sizeof (*data));
+  if (!ret || !data)
+    goto fail;
+  data->buf = grub_malloc (entry->size);
+  if (!data->buf)
+    goto fail;
+
+  if (grub_file_read (io, data->buf, entry->size)
+      != (grub_ssize_t) entry->size)
+    {
+      grub_free (data->buf);
+      goto fail;
+    }
+
+  grub_crypto_hash (hash, result, data->buf, entry->size);
+  if (grub_crypto_memcmp (result, entry->hash, sizeof (result)) != 0)
+    {
+      grub_dprintf ("blockmap", "hash of %s mismatches\n", entry->path);
+      grub_free (data->buf);
+      goto fail;
+    }
+
+  *ret = *io;
+  ret->fs = &blockmap_fs;
+  ret->size = entry->size;
+  ret->offset = 0;
+  ret->not_easily_seekable = 0;
+  ret->data = data;
+  data->file = io;
+  return ret;
+
+ fail:
+  grub_free (data);
+  grub_free (ret);
+  return NULL;
+}
+
+static grub_file_t
+grub_blockmap_open (grub_file_t io, const char *filename)
+{
+  struct blockmap_entry *entry;
+  grub_file_filter_t curfilt[GRUB_FILE_FILTER_MAX];
+  grub_file_t ret;
+
+  for (entry = entries; entry; entry = entry->next)
+    if (grub_strcmp (entry->name, filename) == 0)
+      break;
+  if (!entry)
+    return io;
+
+  ret = blockmap_load (io, entry);
+  if (ret)
+    return ret;
+
+  /* The blocks no longer hold the file.  Open it the normal way and
+     leave the remaining filters to our caller.  */
+  grub_dprintf ("blockmap", "falling back to %s\n", entry->path);
+  grub_errno = GRUB_ERR_NONE;
+  grub_memcpy (curfilt, grub_file_filters_enabled, sizeof (curfilt));
+  grub_file_filter_disable_all ();
+  ret = grub_file_open (entry->path);
+  grub_memcpy (grub_file_filters_enabled, curfilt, sizeof (curfilt));
+  if (!ret)
+    return NULL;
+
+  grub_file_close (io);
+  return ret;
+}
+
+/* Parse a block map line "PATH UUID GENERATION SIZE HASH BLOCKLIST" for
+   PATH into ENTRY.  Return 0 if the line is for another file.  */
+static int
+parse_line (char *line, const char *path, char **uuid, char **generation,
+	    char **blocklist, struct blockmap_entry *entry)
+{
+  char *fields[6];
+  char *p;
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (fields); i++)
+    {
+      while (grub_isspace (*line))
+	line++;
+      if (!*line || (i == 0 && *line == '#'))
+	return 0;
+      fields[i] = line;
+      while (*line && !grub_isspace (*line))
+	line++;
+      if (*line)
+	*line++ = '\0';
+    }
+
+  if (grub_strcmp (fields[0], path) != 0)
+    return 0;
+
+  *uuid = fields[1];
+  *generation = fields[2];
+  *blocklist = fields[5];
+
+  entry->size = grub_strtoull (fields[3], &p, 10);
+  if (grub_errno || *p)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  p = fields[4];
+  for (i = 0; i < BLOCKMAP_HASH_SIZE; i++)
+    {
+      int high = hextoval (*p++), low;
+
+      if (high < 0)
+	return 0;
+      low = hextoval (*p++);
+      if (low < 0)
+	return 0;
+      entry->hash[i] = (high << 4) | low;
+    }
+  return *p == '\0';
+}
+
+/* Check that the filesystem on DEVICE is the one the block map was
+   recorded from and has not been written to since.  */
+static int
+check_fs (grub_device_t device, const char *uuid, const char *generation)
+{
+  grub_fs_t fs;
+  int ok = 1;
+
+  fs = grub_fs_probe (device);
+  if (!fs)
+    return 0;
+
+  if (grub_strcmp (uuid, "-") != 0)
+    {
+      char *fs_uuid = NULL;
+
+      if (!fs->uuid || fs->uuid (device, &fs_uuid) != GRUB_ERR_NONE
+	  || !fs_uuid || grub_strcasecmp (fs_uuid, uuid) != 0)
+	ok = 0;
+      grub_free (fs_uuid);
+    }
+
+  if (ok && grub_strcmp (generation, "-") != 0)
+    {
+      grub_int32_t mtime;
+      char *p;
+      long expected;
+
+      expected = grub_strtol (generation, &p, 10);
+      if (grub_errno || *p || !fs->mtime
+	  || fs->mtime (device, &mtime) != GRUB_ERR_NONE
+	  || mtime != expected)
+	ok = 0;
+    }
+
+  grub_errno = GRUB_ERR_NONE;
+  return ok;
+}
+
+/* Look PATH up in MAPFILE and register the block list it records.
+   Return the name to open PATH with, or NULL to use PATH itself.  */
+static char *
+blockmap_lookup (const char *mapfile, const char *path)
+{
+  grub_file_t map;
+  grub_device_t device = NULL;
+  struct blockmap_entry *entry, **prev;
+  char *line = NULL, *uuid = NULL, *generation = NULL, *blocklist = NULL;
+  char *devname, *ret = NULL;
+  const char *fspath;
+  int found = 0;
+
+  devname = grub_file_get_device_name (path);
+  if (grub_errno)
+    return NULL;
+  if (!devname)
+    {
+      const char *root = grub_env_get ("root");
+
+      if (!root)
+	return NULL;
+      devname = grub_strdup (root);
+      if (!devname)
+	return NULL;
+    }
+  fspath = (path[0] == '(') ? grub_strchr (path, ')') + 1 : path;
+
+  entry = grub_zalloc (sizeof (*entry));
+  if (!entry)
+    goto out;
+
+  grub_file_filter_disable_all ();
+  map = grub_file_open (mapfile);
+  if (!map)
+    goto out;
+  while (grub_free (line), (line = grub_file_getline (map)))
+    if (parse_line (line, fspath, &uuid, &generation, &blocklist, entry))
+      {
+	found = 1;
+	break;
+      }
+  grub_file_close (map);
+  if (!found)
+    goto out;
+
+  device = grub_device_open (devname);
+  if (!device || !device->disk || !check_fs (device, uuid, generation))
+    goto out;
+
+  entry->name = grub_xasprintf ("(%s)%s", devname, blocklist);
+  entry->path = grub_xasprintf ("(%s)%s", devname, fspath);
+  if (!entry->name || !entry->path)
+    goto out;
+
+  /* Replace any earlier entry for the same block list.  */
+  for (prev = &entries; *prev; prev = &(*prev)->next)
+    if (grub_strcmp ((*prev)->name, entry->name) == 0)
+      {
+	struct blockmap_entry *old = *prev;
+
+	*prev = old->next;
+	entry_free (old);
+	break;
+      }
+  entry->next = entries;
+  entries = entry;
+  ret = grub_strdup (entry->name);
+  entry = NULL;
+
+ out:
+  grub_free (line);
+  if (entry)
+    entry_free (entry);
+  if (device)
+    grub_device_close (device);
+  grub_free (devname);
+  grub_errno = GRUB_ERR_NONE;
+  return ret;
+}
+
+static grub_err_t
+grub_cmd_blockmap (grub_extcmd_context_t ctxt, int argc, char **args)
+{
+  struct grub_arg_list *state = ctxt->state;
+  const char *sec;
+  char *name = NULL;
+
+  if (argc != 2)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("two arguments expected"));
+
+  /* Signatures are checked against the file's own name, which a block
+     list does not have.  */
+  sec = grub_env_get ("check_signatures");
+  if (!sec || grub_strcmp (sec, "enforce") != 0)
+    name = blockmap_lookup (args[0], args[1]);
+
+  grub_dprintf ("blockmap", "%s: %s\n", args[1], name ? : "not mapped");
+
+  if (state[0].set)
+    grub_env_set (state[0].arg, name ? : args[1]);
+  else
+    grub_printf ("%s\n", name ? : args[1]);
+
+  grub_free (name);
+  return grub_errno;
+}
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(blockmap)
+{
+  cmd = grub_register_extcmd ("blockmap", grub_cmd_blockmap, 0,
+			      N_("[--set=VARNAME] MAPFILE FILE"),
+			      N_("Read FILE through the block list recorded "
+				 "in MAPFILE."),
+			      options);
+  grub_file_filter_register (GRUB_FILE_FILTER_BLOCKMAP, grub_blockmap_open);
+}
+
+GRUB_MOD_FINI(blockmap)
+{
+  struct blockmap_entry *entry, *next;
+
+  grub_file_filter_unregister (GRUB_FILE_FILTER_BLOCKMAP);
+  grub_unregister_extcmd (cmd);
+
+  for (entry = entries; entry; entry = next)
+    {
+      next = entry->next;
+      entry_free (entry);
+    }
+  entries = NULL;
+}
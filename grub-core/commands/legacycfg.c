@@ -132,8 +132,7 @@ legacy_file (const char *filename)
 	      }
 	    args[0] = oldname;
 	    grub_normal_add_menu_entry (1, args, NULL, NULL, "legacy",
-					NULL, NULL,
-					entrysrc, 0);
+					NULL, entrysrc, NULL, 0);
 	    grub_free (args);
 	    entrysrc[0] = 0;
 	    grub_free (oldname);
@@ -186,7 +185,7 @@ legacy_file (const char *filename)
 	}
       args[0] = entryname;
       grub_normal_add_menu_entry (1, args, NULL, NULL, NULL,
-				  NULL, NULL, entrysrc, 0);
+				  NULL, entrysrc, NULL, 0);
       grub_free (args);
     }
 
@@ -24,6 +24,7 @@
 #include <grub/extcmd.h>
 #include <grub/i18n.h>
 #include <grub/normal.h>
+#include <grub/script_sh.h>
 
 static const struct grub_arg_option options[] =
   {
@@ -72,13 +73,15 @@ static struct
 
 /* Add a menu entry to the current menu context (as given by the environment
    variable data slot `menu').  As the configuration file is read, the script
-   parser calls this when a menu entry is to be created.  */
+   parser calls this when a menu entry is to be created.  Either SOURCECODE
+   or the parsed block SCRIPT is given.  For a block, the source code shown
+   in the editor is only put together when it is needed.  */
 grub_err_t
 grub_normal_add_menu_entry (int argc, const char **args,
 			    char **classes, const char *id,
 			    const char *users, const char *hotkey,
-			    const char *prefix, const char *sourcecode,
-			    int submenu)
+			    const char *sourcecode,
+			    struct grub_script *script, int submenu)
 {
   int menu_hotkey = 0;
   char **menu_args = NULL;
@@ -97,9 +100,12 @@ grub_normal_add_menu_entry (int argc, const char **args,
 
   last = &menu->entry_list;
 
-  menu_sourcecode = grub_xasprintf ("%s%s", prefix ?: "", sourcecode);
-  if (! menu_sourcecode)
-    return grub_errno;
+  if (! script)
+    {
+      menu_sourcecode = grub_strdup (sourcecode);
+      if (! menu_sourcecode)
+	return grub_errno;
+    }
 
   if (classes && classes[0])
     {
@@ -187,6 +193,7 @@ grub_normal_add_menu_entry (int argc, const char **args,
   (*last)->argc = argc;
   (*last)->args = menu_args;
   (*last)->sourcecode = menu_sourcecode;
+  (*last)->script = grub_script_ref (script);
   (*last)->submenu = submenu;
 
   menu->size++;
@@ -252,14 +259,27 @@ setparams_prefix (int argc, char **args)
   return result;
 }
 
+/* Return the source code of ENTRY, building it if needed.  */
+const char *
+grub_menu_entry_get_sourcecode (grub_menu_entry_t entry)
+{
+  char *prefix;
+
+  if (entry->sourcecode || ! entry->script || ! entry->script->text)
+    return entry->sourcecode;
+
+  prefix = setparams_prefix (entry->argc, entry->args);
+  if (! prefix)
+    return 0;
+
+  entry->sourcecode = grub_xasprintf ("%s%s", prefix, entry->script->text);
+  grub_free (prefix);
+  return entry->sourcecode;
+}
+
 static grub_err_t
 grub_cmd_menuentry (grub_extcmd_context_t ctxt, int argc, char **args)
 {
-  char ch;
-  char *src;
-  char *prefix;
-  unsigned len;
-  grub_err_t r;
   const char *users;
 
   if (! argc)
@@ -284,31 +304,18 @@ grub_cmd_menuentry (grub_extcmd_context_t ctxt, int argc, char **args)
 					: NULL),
 				       ctxt->state[4].arg,
 				       users,
-				       ctxt->state[2].arg, 0,
-				       ctxt->state[3].arg,
+				       ctxt->state[2].arg,
+				       ctxt->state[3].arg, NULL,
 				       ctxt->extcmd->cmd->name[0] == 's');
 
-  src = args[argc - 1];
-  args[argc - 1] = NULL;
-
-  len = grub_strlen(src);
-  ch = src[len - 1];
-  src[len - 1] = '\0';
-
-  prefix = setparams_prefix (argc - 1, args);
-  if (! prefix)
-    return grub_errno;
-
-  r = grub_normal_add_menu_entry (argc - 1, (const char **) args,
-				  ctxt->state[0].args, ctxt->state[4].arg,
-				  users,
-				  ctxt->state[2].arg, prefix, src + 1,
-				  ctxt->extcmd->cmd->name[0] == 's');
-
-  src[len - 1] = ch;
-  args[argc - 1] = src;
-  grub_free (prefix);
-  return r;
+  /* The last argument is the text of the block, which the entry gets
+     from the parsed block.  */
+  return grub_normal_add_menu_entry (argc - 1, (const char **) args,
+				     ctxt->state[0].args, ctxt->state[4].arg,
+				     users,
+				     ctxt->state[2].arg, NULL,
+				     ctxt->script,
+				     ctxt->extcmd->cmd->name[0] == 's');
 }
 
 static grub_extcmd_t cmd, cmd_sub;
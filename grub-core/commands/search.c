@@ -37,6 +37,14 @@
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+#if defined(DO_SEARCH_FS_UUID) || defined(DO_SEARCH_DISK_UUID) || \
+    defined(DO_SEARCH_PART_UUID)
+#define compare_fn grub_strcasecmp
+#else
+#define compare_fn grub_strcmp
+#endif
+
+#ifdef DO_SEARCH_FILE
 struct cache_entry
 {
   struct cache_entry *next;
@@ -45,6 +53,37 @@ struct cache_entry
 };
 
 static struct cache_entry *cache;
+#else
+/* The value searched for, read once from every device.  Entries are
+   kept in the device iteration order, and hashed by device name and by
+   value.  */
+struct probe_entry
+{
+  struct probe_entry *next;
+  struct probe_entry *name_next;
+  struct probe_entry *value_next;
+  char *name;
+  char *value;
+  unsigned seq;
+  enum
+    {
+      PROBE_NONE,
+      /* No filesystem was recognized without autoloading.  */
+      PROBE_PARTIAL,
+      PROBE_DONE
+    } state;
+};
+
+#define PROBE_HASHSZ	64
+
+static struct probe_entry *probe_list;
+static struct probe_entry **probe_last = &probe_list;
+static struct probe_entry *probe_names[PROBE_HASHSZ];
+static struct probe_entry *probe_values[PROBE_HASHSZ];
+static unsigned probe_count;
+static int probe_valid;
+static unsigned long probe_generation;
+#endif
 
 /* Context for FUNC_NAME.  */
 struct search_ctx
@@ -55,137 +94,233 @@ struct search_ctx
   char **hints;
   unsigned nhints;
   int count;
+#ifdef DO_SEARCH_FILE
   int is_cache;
+#endif
 };
 
-/* Helper for FUNC_NAME.  */
 static int
-iterate_device (const char *name, void *data)
+is_floppy (const char *name)
 {
-  struct search_ctx *ctx = data;
-  int found = 0;
+  return name[0] == 'f' && name[1] == 'd' && name[2] >= '0' && name[2] <= '9';
+}
 
-  /* Skip floppy drives when requested.  */
-  if (ctx->no_floppy &&
-      name[0] == 'f' && name[1] == 'd' && name[2] >= '0' && name[2] <= '9')
-    return 1;
+#ifndef DO_SEARCH_FILE
+/* Read the value to search for from device NAME into VALUE, or set it
+   to 0 if there is none.  Return the state of the probe.  */
+static int
+probe_device (const char *name, char **value)
+{
+  int state = PROBE_DONE;
+  grub_device_t dev;
 
-#if defined(DO_SEARCH_FS_UUID) || defined(DO_SEARCH_DISK_UUID)
-#define compare_fn grub_strcasecmp
+  *value = 0;
+
+  dev = grub_device_open (name);
+  if (! dev)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return state;
+    }
+
+#if defined(DO_SEARCH_PART_UUID)
+  if (grub_gpt_part_uuid (dev, value) != GRUB_ERR_NONE)
+    *value = 0;
+#elif defined(DO_SEARCH_PART_LABEL)
+  if (grub_gpt_part_label (dev, value) != GRUB_ERR_NONE)
+    *value = 0;
+#elif defined(DO_SEARCH_DISK_UUID)
+  if (grub_gpt_disk_uuid (dev, value) != GRUB_ERR_NONE)
+    *value = 0;
 #else
-#define compare_fn grub_strcmp
+  {
+    /* SEARCH_FS_UUID or SEARCH_LABEL */
+    grub_fs_t fs;
+
+    fs = grub_fs_probe (dev);
+
+#ifdef DO_SEARCH_FS_UUID
+#define read_fn uuid
+#else
+#define read_fn label
 #endif
 
-#ifdef DO_SEARCH_FILE
-    {
-      char *buf;
-      grub_file_t file;
+    if (fs && fs->read_fn)
+      {
+	fs->read_fn (dev, value);
+	if (grub_errno != GRUB_ERR_NONE)
+	  {
+	    grub_free (*value);
+	    *value = 0;
+	  }
+      }
+    else if (! fs && ! grub_fs_autoload_hook)
+      state = PROBE_PARTIAL;
+  }
+#endif
 
-      buf = grub_xasprintf ("(%s)%s", name, ctx->key);
-      if (! buf)
-	return 1;
+  grub_device_close (dev);
+  grub_errno = GRUB_ERR_NONE;
 
-      grub_file_filter_disable_compression ();
-      file = grub_file_open (buf);
-      if (file)
-	{
-	  found = 1;
-	  grub_file_close (file);
-	}
-      grub_free (buf);
-    }
-#elif defined(DO_SEARCH_PART_UUID)
-    {
-      grub_device_t dev;
-      char *quid;
+  return state;
+}
 
-      dev = grub_device_open (name);
-      if (dev)
-	{
-	  if (grub_gpt_part_uuid (dev, &quid) == GRUB_ERR_NONE)
-	    {
-	      if (grub_strcasecmp (quid, ctx->key) == 0)
-		    found = 1;
+static unsigned
+probe_hash (const char *s)
+{
+  unsigned h = 0;
 
-	      grub_free (quid);
-	    }
+  /* Case insensitive, as some values are compared that way.  */
+  while (*s)
+    h = h * 31 + grub_tolower (*s++);
 
-	  grub_device_close (dev);
-	}
-    }
-#elif defined(DO_SEARCH_PART_LABEL)
-    {
-      grub_device_t dev;
-      char *quid;
+  return h % PROBE_HASHSZ;
+}
 
-      dev = grub_device_open (name);
-      if (dev)
-	{
-	  if (grub_gpt_part_label (dev, &quid) == GRUB_ERR_NONE)
-	    {
-	      if (grub_strcmp (quid, ctx->key) == 0)
-		    found = 1;
+static struct probe_entry *
+probe_find (const char *name)
+{
+  struct probe_entry *entry;
 
-	      grub_free (quid);
-	    }
+  if (! probe_valid)
+    return 0;
 
-	  grub_device_close (dev);
-	}
-    }
-#elif defined(DO_SEARCH_DISK_UUID)
-    {
-      grub_device_t dev;
-      char *quid;
+  for (entry = probe_names[probe_hash (name)]; entry;
+       entry = entry->name_next)
+    if (grub_strcmp (entry->name, name) == 0)
+      return entry;
 
-      dev = grub_device_open (name);
-      if (dev)
-	{
-	  if (grub_gpt_disk_uuid (dev, &quid) == GRUB_ERR_NONE)
-	    {
-	      if (grub_strcmp (quid, ctx->key) == 0)
-		found = 1;
+  return 0;
+}
 
-	      grub_free (quid);
-	    }
+/* Probe ENTRY if it was not done yet, or if autoloading may now find
+   its filesystem, and hash its value.  */
+static void
+probe_update (struct probe_entry *entry)
+{
+  struct probe_entry **p;
 
-	  grub_device_close (dev);
-	}
+  if (entry->state == PROBE_DONE
+      || (entry->state == PROBE_PARTIAL && ! grub_fs_autoload_hook))
+    return;
+
+  entry->state = probe_device (entry->name, &entry->value);
+  if (! entry->value)
+    return;
+
+  /* Keep the iteration order among devices in the same bucket.  */
+  for (p = &probe_values[probe_hash (entry->value)]; *p;
+       p = &(*p)->value_next)
+    if ((*p)->seq > entry->seq)
+      break;
+  entry->value_next = *p;
+  *p = entry;
+}
+
+static void
+probe_free (void)
+{
+  struct probe_entry *entry, *next;
+
+  for (entry = probe_list; entry; entry = next)
+    {
+      next = entry->next;
+      grub_free (entry->name);
+      grub_free (entry->value);
+      grub_free (entry);
     }
-#else
+
+  probe_list = 0;
+  probe_last = &probe_list;
+  probe_count = 0;
+  probe_valid = 0;
+  grub_memset (probe_names, 0, sizeof (probe_names));
+  grub_memset (probe_values, 0, sizeof (probe_values));
+}
+
+/* Helper for probe_build.  */
+static int
+probe_add (const char *name, void *data __attribute__ ((unused)))
+{
+  struct probe_entry *entry;
+  unsigned h;
+
+  entry = grub_zalloc (sizeof (*entry));
+  if (! entry)
+    return 1;
+
+  entry->name = grub_strdup (name);
+  if (! entry->name)
     {
-      /* SEARCH_FS_UUID or SEARCH_LABEL */
-      grub_device_t dev;
-      grub_fs_t fs;
-      char *quid;
+      grub_free (entry);
+      return 1;
+    }
 
-      dev = grub_device_open (name);
-      if (dev)
-	{
-	  fs = grub_fs_probe (dev);
+  /* Devices are probed when a search first needs them.  */
+  entry->state = PROBE_NONE;
+  entry->seq = probe_count++;
 
-#ifdef DO_SEARCH_FS_UUID
-#define read_fn uuid
-#else
-#define read_fn label
+  *probe_last = entry;
+  probe_last = &entry->next;
+
+  h = probe_hash (name);
+  entry->name_next = probe_names[h];
+  probe_names[h] = entry;
+
+  return 0;
+}
+
+/* List all devices, unless it was done since the available disks last
+   changed.  */
+static void
+probe_build (void)
+{
+  if (probe_valid && probe_generation == grub_disk_dev_generation)
+    return;
+
+  probe_free ();
+  if (grub_device_iterate (probe_add, 0))
+    {
+      probe_free ();
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  /* Listing the devices may have set up new ones.  */
+  probe_generation = grub_disk_dev_generation;
+  probe_valid = 1;
+}
 #endif
 
-	  if (fs && fs->read_fn)
-	    {
-	      fs->read_fn (dev, &quid);
+/* Helper for FUNC_NAME.  */
+static int
+iterate_device (const char *name, void *data)
+{
+  struct search_ctx *ctx = data;
+  int found = 0;
 
-	      if (grub_errno == GRUB_ERR_NONE && quid)
-		{
-		  if (compare_fn (quid, ctx->key) == 0)
-		    found = 1;
+  /* Skip floppy drives when requested.  */
+  if (ctx->no_floppy && is_floppy (name))
+    return 1;
 
-		  grub_free (quid);
-		}
-	    }
+#ifdef DO_SEARCH_FILE
+    {
+      char *buf;
+      grub_file_t file;
 
-	  grub_device_close (dev);
+      buf = grub_xasprintf ("(%s)%s", name, ctx->key);
+      if (! buf)
+	return 1;
+
+      grub_file_filter_disable_compression ();
+      file = grub_file_open (buf);
+      if (file)
+	{
+	  found = 1;
+	  grub_file_close (file);
 	}
+      grub_free (buf);
     }
-#endif
 
   if (!ctx->is_cache && found && ctx->count == 0)
     {
@@ -211,6 +346,27 @@ iterate_device (const char *name, void *data)
       else
 	grub_errno = GRUB_ERR_NONE;
     }
+#else
+    {
+      struct probe_entry *entry;
+      char *quid;
+
+      entry = probe_find (name);
+      if (entry)
+	{
+	  probe_update (entry);
+	  quid = entry->value;
+	}
+      else
+	probe_device (name, &quid);
+
+      if (quid && compare_fn (quid, ctx->key) == 0)
+	found = 1;
+
+      if (! entry)
+	grub_free (quid);
+    }
+#endif
 
   if (found)
     {
@@ -252,6 +408,7 @@ static void
 try (struct search_ctx *ctx)    
 {
   unsigned i;
+#ifdef DO_SEARCH_FILE
   struct cache_entry **prev;
   struct cache_entry *cache_ent;
 
@@ -277,6 +434,9 @@ try (struct search_ctx *ctx)
 	  grub_free (cache_ent);
 	}
     }
+#else
+  probe_build ();
+#endif
 
   for (i = 0; i < ctx->nhints; i++)
     {
@@ -318,6 +478,26 @@ try (struct search_ctx *ctx)
 	    return;
 	}
     }
+
+#ifndef DO_SEARCH_FILE
+  if (probe_valid)
+    {
+      struct probe_entry *entry;
+
+      /* Only devices not probed yet need to be opened.  */
+      for (entry = probe_list; entry; entry = entry->next)
+	if (! ctx->no_floppy || ! is_floppy (entry->name))
+	  probe_update (entry);
+
+      for (entry = probe_values[probe_hash (ctx->key)]; entry;
+	   entry = entry->value_next)
+	if ((! ctx->no_floppy || ! is_floppy (entry->name))
+	    && compare_fn (entry->value, ctx->key) == 0
+	    && iterate_device (entry->name, ctx))
+	  return;
+      return;
+    }
+#endif
   grub_device_iterate (iterate_device, ctx);
 }
 
@@ -332,7 +512,9 @@ FUNC_NAME (const char *key, const char *var, int no_floppy,
     .hints = hints,
     .nhints = nhints,
     .count = 0,
+#ifdef DO_SEARCH_FILE
     .is_cache = 0
+#endif
   };
   grub_fs_autoload_hook_t saved_autoload;
 
@@ -407,4 +589,7 @@ GRUB_MOD_FINI(search_label)
 #endif
 {
   grub_unregister_command (cmd);
+#ifndef DO_SEARCH_FILE
+  probe_free ();
+#endif
 }
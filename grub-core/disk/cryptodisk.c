@@ -723,6 +723,7 @@ grub_cryptodisk_insert (grub_cryptodisk_t newdev, const char *name,
   newdev->partition_start = grub_partition_get_start (source->partition);
   newdev->next = cryptodisk_list;
   cryptodisk_list = newdev;
+  grub_disk_dev_generation++;
 
   return GRUB_ERR_NONE;
 }
@@ -770,6 +771,7 @@ grub_cryptodisk_cheat_insert (grub_cryptodisk_t newdev, const char *name,
   newdev->id = last_cryptodisk_id++;
   newdev->next = cryptodisk_list;
   cryptodisk_list = newdev;
+  grub_disk_dev_generation++;
 
   return GRUB_ERR_NONE;
 }
@@ -492,13 +492,25 @@ validate_segment (struct grub_diskfilter_segment *seg);
 static grub_err_t
 validate_lv (struct grub_diskfilter_lv *lv)
 {
-  unsigned int i;
+  unsigned int i, j;
   if (!lv)
     return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "unknown volume");
 
   if (!lv->vg || lv->vg->extent_size == 0)
     return grub_error (GRUB_ERR_READ_ERROR, "invalid volume");
 
+  /* read_lv looks segments up by binary search, so keep them sorted by
+     their first extent.  They are nearly always in order already.  */
+  for (i = 1; i < lv->segment_count; i++)
+    {
+      struct grub_diskfilter_segment seg = lv->segments[i];
+
+      for (j = i; j > 0 && lv->segments[j - 1].start_extent > seg.start_extent;
+	   j--)
+	lv->segments[j] = lv->segments[j - 1];
+      lv->segments[j] = seg;
+    }
+
   for (i = 0; i < lv->segment_count; i++)
     {
       grub_err_t err;
@@ -862,23 +874,27 @@ read_lv (struct grub_diskfilter_lv *lv, grub_disk_addr_t sector,
     {
       grub_err_t err = 0;
       struct grub_diskfilter_vg *vg = lv->vg;
-      struct grub_diskfilter_segment *seg = lv->segments;
+      struct grub_diskfilter_segment *seg;
       grub_uint64_t extent;
       grub_uint64_t to_read;
 
       extent = grub_divmod64 (sector, vg->extent_size, NULL);
       
-      /* Find the right segment.  */
+      /* Find the last segment starting at or before EXTENT.  */
       {
-	unsigned int i;
-	for (i = 0; i < lv->segment_count; i++)
+	unsigned int lo = 0, hi = lv->segment_count;
+	while (lo < hi)
 	  {
-	    if ((seg->start_extent <= extent)
-		&& ((seg->start_extent + seg->extent_count) > extent))
-	      break;
-	    seg++;
+	    unsigned int mid = lo + (hi - lo) / 2;
+	    if (lv->segments[mid].start_extent <= extent)
+	      lo = mid + 1;
+	    else
+	      hi = mid;
 	  }
-	if (i == lv->segment_count)
+	if (lo == 0)
+	  return grub_error (GRUB_ERR_READ_ERROR, "incorrect segment");
+	seg = &lv->segments[lo - 1];
+	if (seg->start_extent + seg->extent_count <= extent)
 	  return grub_error (GRUB_ERR_READ_ERROR, "incorrect segment");
       }
       to_read = ((seg->start_extent + seg->extent_count)
@@ -1002,6 +1018,7 @@ grub_diskfilter_vg_register (struct grub_diskfilter_vg *vg)
   /* Add our new array to the list.  */
   vg->next = array_list;
   array_list = vg;
+  grub_disk_dev_generation++;
   return GRUB_ERR_NONE;
 }
 
@@ -21,18 +21,39 @@
 #include <grub/misc.h>
 #include <grub/file.h>
 #include <grub/disk.h>
+#include <grub/partition.h>
 #include <grub/mm.h>
 #include <grub/extcmd.h>
 #include <grub/i18n.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+/* A run of sectors of the backing file and where they live on its disk.  */
+struct grub_loopback_extent
+{
+  grub_disk_addr_t start;
+  grub_disk_addr_t sector;
+  grub_disk_addr_t count;
+};
+
+/* Most extents kept per device; more fragmented files are read through
+   the filesystem.  */
+#define LOOPBACK_MAX_EXTENTS 1024
+/* Most extents a single read may produce and still be recorded.  */
+#define LOOPBACK_READ_EXTENTS 16
+
 struct grub_loopback
 {
   char *devname;
   grub_file_t file;
   struct grub_loopback *next;
   unsigned long id;
+
+  /* Map of the backing file onto its disk, sorted by START.  It is
+     learnt from the read hooks of reads done through the filesystem.  */
+  struct grub_loopback_extent *extents;
+  unsigned num_extents;
+  int can_map;
 };
 
 static struct grub_loopback *loopback_list;
@@ -68,11 +89,21 @@ delete_loopback (const char *name)
 
   grub_free (dev->devname);
   grub_file_close (dev->file);
+  grub_free (dev->extents);
   grub_free (dev);
+  grub_disk_dev_generation++;
 
   return 0;
 }
 
+/* Whether reads of FILE can be redirected to its disk.  Decompressed
+   files have no such mapping.  */
+static int
+can_map (grub_file_t file)
+{
+  return file->device && file->device->disk && ! file->not_easily_seekable;
+}
+
 /* The command to add and remove loopback devices.  */
 static grub_err_t
 grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
@@ -105,6 +136,11 @@ grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
     {
       grub_file_close (newdev->file);
       newdev->file = file;
+      grub_free (newdev->extents);
+      newdev->extents = 0;
+      newdev->num_extents = 0;
+      newdev->can_map = can_map (file);
+      grub_disk_dev_generation++;
 
       return 0;
     }
@@ -123,10 +159,14 @@ grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
 
   newdev->file = file;
   newdev->id = last_id++;
+  newdev->extents = 0;
+  newdev->num_extents = 0;
+  newdev->can_map = can_map (file);
 
   /* Add the new entry to the list.  */
   newdev->next = loopback_list;
   loopback_list = newdev;
+  grub_disk_dev_generation++;
 
   return 0;
 
@@ -181,19 +221,250 @@ grub_loopback_open (const char *name, grub_disk_t disk)
   return 0;
 }
 
+/* Context for record_extents.  */
+struct map_ctx
+{
+  grub_disk_addr_t next;
+  grub_uint64_t covered;
+  struct grub_loopback_extent found[LOOPBACK_READ_EXTENTS];
+  unsigned num_found;
+  int bad;
+};
+
+/* Read hook collecting where the sectors of a read come from.  Anything
+   that isn't whole sectors in file order spoils the read.  */
+static void
+record_extents (grub_disk_addr_t sector, unsigned offset, unsigned length,
+		void *data)
+{
+  struct map_ctx *ctx = data;
+  struct grub_loopback_extent *last;
+  grub_disk_addr_t count = length >> GRUB_DISK_SECTOR_BITS;
+
+  ctx->covered += length;
+  if (ctx->bad)
+    return;
+  if (offset || (length & (GRUB_DISK_SECTOR_SIZE - 1)) || ! count)
+    {
+      ctx->bad = 1;
+      return;
+    }
+
+  last = ctx->num_found ? &ctx->found[ctx->num_found - 1] : 0;
+  if (last && last->sector + last->count == sector)
+    last->count += count;
+  else if (ctx->num_found < LOOPBACK_READ_EXTENTS)
+    {
+      last = &ctx->found[ctx->num_found];
+      last->start = ctx->next;
+      last->sector = sector;
+      last->count = count;
+      ctx->num_found++;
+    }
+  else
+    ctx->bad = 1;
+  ctx->next += count;
+}
+
+/* Return the index of the first extent ending after SECTOR.  */
+static unsigned
+find_extent (struct grub_loopback *dev, grub_disk_addr_t sector)
+{
+  unsigned lo = 0, hi = dev->num_extents;
+
+  while (lo < hi)
+    {
+      unsigned mid = (lo + hi) / 2;
+
+      if (dev->extents[mid].start + dev->extents[mid].count <= sector)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Insert E as the I-th extent, merging it with its neighbours.  */
+static void
+insert_extent (struct grub_loopback *dev, unsigned i,
+	       const struct grub_loopback_extent *e)
+{
+  struct grub_loopback_extent *prev, *next;
+
+  prev = i ? &dev->extents[i - 1] : 0;
+  next = i < dev->num_extents ? &dev->extents[i] : 0;
+
+  if (prev && prev->start + prev->count == e->start
+      && prev->sector + prev->count == e->sector)
+    {
+      prev->count += e->count;
+      if (next && prev->start + prev->count == next->start
+	  && prev->sector + prev->count == next->sector)
+	{
+	  prev->count += next->count;
+	  grub_memmove (next, next + 1,
+			(dev->num_extents - i - 1) * sizeof (*next));
+	  dev->num_extents--;
+	}
+      return;
+    }
+  if (next && e->start + e->count == next->start
+      && e->sector + e->count == next->sector)
+    {
+      next->start = e->start;
+      next->sector = e->sector;
+      next->count += e->count;
+      return;
+    }
+
+  if (dev->num_extents == LOOPBACK_MAX_EXTENTS)
+    return;
+  if (! dev->extents)
+    {
+      dev->extents = grub_malloc (LOOPBACK_MAX_EXTENTS
+				  * sizeof (dev->extents[0]));
+      if (! dev->extents)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+    }
+  grub_memmove (dev->extents + i + 1, dev->extents + i,
+		(dev->num_extents - i) * sizeof (dev->extents[0]));
+  dev->extents[i] = *e;
+  dev->num_extents++;
+}
+
+/* Record E, skipping the parts that are mapped already.  */
+static void
+add_extent (struct grub_loopback *dev, struct grub_loopback_extent e)
+{
+  while (e.count)
+    {
+      unsigned i = find_extent (dev, e.start);
+      grub_disk_addr_t len;
+
+      if (i < dev->num_extents && dev->extents[i].start <= e.start)
+	len = dev->extents[i].start + dev->extents[i].count - e.start;
+      else
+	{
+	  struct grub_loopback_extent gap = e;
+
+	  if (i < dev->num_extents
+	      && dev->extents[i].start < e.start + e.count)
+	    gap.count = dev->extents[i].start - e.start;
+	  insert_extent (dev, i, &gap);
+	  len = gap.count;
+	}
+
+      if (len > e.count)
+	len = e.count;
+      e.start += len;
+      e.sector += len;
+      e.count -= len;
+    }
+}
+
+/* Read SIZE sectors at SECTOR of DISK, bypassing its cache: the data is
+   cached for the loopback device already.  */
+static grub_err_t
+read_backing (grub_disk_t disk, grub_disk_addr_t sector, grub_size_t size,
+	      char *buf)
+{
+  unsigned shift = disk->log_sector_size - GRUB_DISK_SECTOR_BITS;
+  grub_size_t max = disk->max_agglomerate << GRUB_DISK_CACHE_BITS;
+
+  if ((sector | size) & ((1 << shift) - 1))
+    return grub_disk_read (disk,
+			   sector - grub_partition_get_start (disk->partition),
+			   0, size << GRUB_DISK_SECTOR_BITS, buf);
+
+  while (size)
+    {
+      grub_size_t len = size < max ? size : max;
+      grub_err_t err;
+
+      err = (disk->dev->read) (disk, sector >> shift, len >> shift, buf);
+      if (err)
+	return err;
+      sector += len;
+      size -= len;
+      buf += len << GRUB_DISK_SECTOR_BITS;
+    }
+  return GRUB_ERR_NONE;
+}
+
+/* Serve the read from the backing disk if all of it is mapped.  Return 1
+   if it was.  */
+static int
+read_mapped (struct grub_loopback *dev, grub_disk_addr_t sector,
+	     grub_size_t size, char *buf, grub_err_t *err)
+{
+  grub_disk_t backing = dev->file->device->disk;
+  grub_disk_addr_t s;
+  unsigned i, first;
+
+  first = find_extent (dev, sector);
+  for (s = sector, i = first; s < sector + size; i++)
+    {
+      if (i == dev->num_extents || dev->extents[i].start > s)
+	return 0;
+      s = dev->extents[i].start + dev->extents[i].count;
+    }
+
+  for (s = sector, i = first; s < sector + size; i++)
+    {
+      struct grub_loopback_extent *e = &dev->extents[i];
+      grub_disk_addr_t len = e->start + e->count - s;
+
+      if (len > sector + size - s)
+	len = sector + size - s;
+      *err = read_backing (backing, e->sector + (s - e->start), len,
+			   buf + ((s - sector) << GRUB_DISK_SECTOR_BITS));
+      if (*err)
+	return 1;
+      s += len;
+    }
+  return 1;
+}
+
 static grub_err_t
 grub_loopback_read (grub_disk_t disk, grub_disk_addr_t sector,
 		    grub_size_t size, char *buf)
 {
-  grub_file_t file = ((struct grub_loopback *) disk->data)->file;
+  struct grub_loopback *dev = disk->data;
+  grub_file_t file = dev->file;
+  struct map_ctx ctx;
   grub_off_t pos;
+  grub_ssize_t got;
+  grub_err_t err;
+  unsigned i;
+
+  if (dev->can_map && read_mapped (dev, sector, size, buf, &err))
+    return err;
 
   grub_file_seek (file, sector << GRUB_DISK_SECTOR_BITS);
 
-  grub_file_read (file, buf, size << GRUB_DISK_SECTOR_BITS);
+  ctx.next = sector;
+  ctx.covered = 0;
+  ctx.num_found = 0;
+  ctx.bad = 0;
+  if (dev->can_map)
+    {
+      file->read_hook = record_extents;
+      file->read_hook_data = &ctx;
+    }
+  got = grub_file_read (file, buf, size << GRUB_DISK_SECTOR_BITS);
+  file->read_hook = 0;
+  file->read_hook_data = 0;
   if (grub_errno)
     return grub_errno;
 
+  if (dev->can_map && ! ctx.bad && got > 0
+      && ctx.covered == (grub_uint64_t) got)
+    for (i = 0; i < ctx.num_found; i++)
+      add_extent (dev, ctx.found[i]);
+
   /* In case there is more data read than there is available, in case
      of files that are not a multiple of GRUB_DISK_SECTOR_SIZE, fill
      the rest with zeros.  */
@@ -62,6 +62,62 @@ grub_lvm_checkvalue (char **p, char *str, char *tmpl)
 }
 #endif
 
+/* Read the first SIZE bytes of the metadata text at TEXT_OFFSET in the
+   circular metadata area of AREA_SIZE bytes at MDA_OFFSET into BUF and
+   terminate them.  */
+static grub_err_t
+grub_lvm_read_metadata (grub_disk_t disk, grub_uint64_t mda_offset,
+			grub_uint64_t area_size, grub_uint64_t text_offset,
+			grub_size_t size, char *buf)
+{
+  grub_size_t first = size;
+  grub_err_t err;
+
+  /* Metadata is circular.  The text wraps to just after the header.  */
+  if (text_offset + size > area_size)
+    first = area_size - text_offset;
+
+  err = grub_disk_read (disk, 0, mda_offset + text_offset, first, buf);
+  if (! err && first < size)
+    err = grub_disk_read (disk, 0, mda_offset + GRUB_LVM_MDA_HEADER_SIZE,
+			  size - first, buf + first);
+  buf[size] = '\0';
+  return err;
+}
+
+/* Parse the name and ID of the volume group at the start of the metadata
+   text P, which may be cut short.  Return the name and leave *REST just
+   after the ID, or return NULL.  */
+static char *
+grub_lvm_parse_header (char *p, char *vg_id, char **rest)
+{
+  char *q, *vgname;
+  unsigned i;
+
+  q = p;
+  while (*q != ' ' && *q != '\0')
+    q++;
+  if (*q == '\0')
+    return NULL;
+
+  *rest = grub_strstr (q, "id = \"");
+  if (*rest == NULL)
+    return NULL;
+  *rest += sizeof ("id = \"") - 1;
+  for (i = 0; i < GRUB_LVM_ID_STRLEN; i++)
+    if ((*rest)[i] == '\0')
+      return NULL;
+  grub_memcpy (vg_id, *rest, GRUB_LVM_ID_STRLEN);
+  vg_id[GRUB_LVM_ID_STRLEN] = '\0';
+
+  vgname = grub_malloc (q - p + 1);
+  if (! vgname)
+    return NULL;
+  grub_memcpy (vgname, p, q - p);
+  vgname[q - p] = '\0';
+  return vgname;
+}
+
 static int
 grub_lvm_check_flag (char *p, const char *str, const char *flag)
 {
@@ -105,6 +161,11 @@ grub_lvm_detect (grub_disk_t disk,
   char buf[GRUB_LVM_LABEL_SIZE];
   char vg_id[GRUB_LVM_ID_STRLEN+1];
   char pv_id[GRUB_LVM_ID_STRLEN+1];
+  union
+  {
+    struct grub_lvm_mda_header hdr;
+    char raw[GRUB_LVM_MDA_HEADER_SIZE];
+  } mda;
   char *metadatabuf, *p, *q, *vgname;
   struct grub_lvm_label_header *lh = (struct grub_lvm_label_header *) buf;
   struct grub_lvm_pv_header *pvh;
@@ -112,7 +173,8 @@ grub_lvm_detect (grub_disk_t disk,
   struct grub_lvm_mda_header *mdah;
   struct grub_lvm_raw_locn *rlocn;
   unsigned int i, j;
-  grub_size_t vgname_len;
+  grub_uint64_t area_size, text_offset, text_size;
+  grub_size_t size, vgname_len;
   struct grub_diskfilter_vg *vg;
   struct grub_diskfilter_pv *pv;
 
@@ -171,17 +233,11 @@ grub_lvm_detect (grub_disk_t disk,
 
   /* It's possible to have multiple copies of metadata areas, we just use the
      first one.  */
-
-  /* Allocate buffer space for the circular worst-case scenario. */
-  metadatabuf = grub_malloc (2 * mda_size);
-  if (! metadatabuf)
-    goto fail;
-
-  err = grub_disk_read (disk, 0, mda_offset, mda_size, metadatabuf);
+  err = grub_disk_read (disk, 0, mda_offset, sizeof (mda.raw), mda.raw);
   if (err)
-    goto fail2;
+    goto fail;
 
-  mdah = (struct grub_lvm_mda_header *) metadatabuf;
+  mdah = &mda.hdr;
   if ((grub_strncmp ((char *)mdah->magic, GRUB_LVM_FMTT_MAGIC,
 		     sizeof (mdah->magic)))
       || (grub_le_to_cpu32 (mdah->version) != GRUB_LVM_FMTT_VERSION))
@@ -191,52 +247,57 @@ grub_lvm_detect (grub_disk_t disk,
 #ifdef GRUB_UTIL
       grub_util_info ("unknown LVM metadata header");
 #endif
-      goto fail2;
+      goto fail;
     }
 
   rlocn = mdah->raw_locns;
-  if (grub_le_to_cpu64 (rlocn->offset) + grub_le_to_cpu64 (rlocn->size) >
-      grub_le_to_cpu64 (mdah->size))
-    {
-      /* Metadata is circular. Copy the wrap in place. */
-      grub_memcpy (metadatabuf + mda_size,
-		   metadatabuf + GRUB_LVM_MDA_HEADER_SIZE,
-		   grub_le_to_cpu64 (rlocn->offset) +
-		   grub_le_to_cpu64 (rlocn->size) -
-		   grub_le_to_cpu64 (mdah->size));
-    }
-  p = q = metadatabuf + grub_le_to_cpu64 (rlocn->offset);
-
-  while (*q != ' ' && q < metadatabuf + mda_size)
-    q++;
-
-  if (q == metadatabuf + mda_size)
+  area_size = grub_le_to_cpu64 (mdah->size);
+  text_offset = grub_le_to_cpu64 (rlocn->offset);
+  text_size = grub_le_to_cpu64 (rlocn->size);
+  if (area_size > mda_size || text_offset < GRUB_LVM_MDA_HEADER_SIZE
+      || text_offset >= area_size
+      || text_size > area_size - GRUB_LVM_MDA_HEADER_SIZE)
     {
 #ifdef GRUB_UTIL
-      grub_util_info ("error parsing metadata");
+      grub_util_info ("invalid LVM metadata location");
 #endif
-      goto fail2;
+      goto fail;
     }
 
-  vgname_len = q - p;
-  vgname = grub_malloc (vgname_len + 1);
-  if (!vgname)
-    goto fail2;
+  metadatabuf = grub_malloc (text_size + 1);
+  if (! metadatabuf)
+    goto fail;
 
-  grub_memcpy (vgname, p, vgname_len);
-  vgname[vgname_len] = '\0';
+  /* A volume group we already know only needs its ID, which comes
+     first.  Read the rest of the text the first time we see it.  */
+  size = text_size;
+  if (size > GRUB_LVM_MDA_HEADER_SIZE)
+    size = GRUB_LVM_MDA_HEADER_SIZE;
+  err = grub_lvm_read_metadata (disk, mda_offset, area_size, text_offset,
+				size, metadatabuf);
+  if (err)
+    goto fail2;
 
-  p = grub_strstr (q, "id = \"");
-  if (p == NULL)
+  vgname = grub_lvm_parse_header (metadatabuf, vg_id, &p);
+  if (size < text_size
+      && (! vgname
+	  || ! grub_diskfilter_get_vg_by_uuid (GRUB_LVM_ID_STRLEN, vg_id)))
+    {
+      grub_free (vgname);
+      err = grub_lvm_read_metadata (disk, mda_offset, area_size, text_offset,
+				    text_size, metadatabuf);
+      if (err)
+	goto fail2;
+      vgname = grub_lvm_parse_header (metadatabuf, vg_id, &p);
+    }
+  if (! vgname)
     {
 #ifdef GRUB_UTIL
-      grub_util_info ("couldn't find ID");
+      grub_util_info ("error parsing metadata");
 #endif
-      goto fail3;
+      goto fail2;
     }
-  p += sizeof ("id = \"") - 1;
-  grub_memcpy (vg_id, p, GRUB_LVM_ID_STRLEN);
-  vg_id[GRUB_LVM_ID_STRLEN] = '\0';
+  vgname_len = grub_strlen (vgname);
 
   vg = grub_diskfilter_get_vg_by_uuid (GRUB_LVM_ID_STRLEN, vg_id);
 
@@ -24,45 +24,10 @@
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
 #include <grub/crypto.h>
+#include <grub/gf256.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
-/* x**y.  */
-static grub_uint8_t powx[255 * 2];
-/* Such an s that x**s = y */
-static unsigned powx_inv[256];
-static const grub_uint8_t poly = 0x1d;
-
-static void
-grub_raid_block_mulx (unsigned mul, char *buf, grub_size_t size)
-{
-  grub_size_t i;
-  grub_uint8_t *p;
-
-  p = (grub_uint8_t *) buf;
-  for (i = 0; i < size; i++, p++)
-    if (*p)
-      *p = powx[mul + powx_inv[*p]];
-}
-
-static void
-grub_raid6_init_table (void)
-{
-  unsigned i;
-
-  grub_uint8_t cur = 1;
-  for (i = 0; i < 255; i++)
-    {
-      powx[i] = cur;
-      powx[i + 255] = cur;
-      powx_inv[cur] = i;
-      if (cur & 0x80)
-	cur = (cur << 1) ^ poly;
-      else
-	cur <<= 1;
-    }
-}
-
 static unsigned
 mod_255 (unsigned x)
 {
@@ -73,15 +38,19 @@ mod_255 (unsigned x)
   return x;
 }
 
-static grub_err_t
-grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
-                    char *buf, grub_disk_addr_t sector, grub_size_t size)
+/* Rebuild member DISKNR of a NSTRIPES wide array with P and Q syndromes
+   starting at member P.  SIZE is in bytes and SECTOR is passed through to
+   READ_FUNC.  */
+grub_err_t
+grub_raid6_recover_gen (void *data, grub_uint64_t nstripes, int disknr,
+			int p, char *buf, grub_disk_addr_t sector,
+			grub_size_t size, int layout,
+			grub_raid_recover_read_t read_func)
 {
   int i, q, pos;
   int bad1 = -1, bad2 = -1;
   char *pbuf = 0, *qbuf = 0;
 
-  size <<= GRUB_DISK_SECTOR_BITS;
   pbuf = grub_zalloc (size);
   if (!pbuf)
     goto quit;
@@ -91,17 +60,17 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
     goto quit;
 
   q = p + 1;
-  if (q == (int) array->node_count)
+  if (q == (int) nstripes)
     q = 0;
 
   pos = q + 1;
-  if (pos == (int) array->node_count)
+  if (pos == (int) nstripes)
     pos = 0;
 
-  for (i = 0; i < (int) array->node_count - 2; i++)
+  for (i = 0; i < (int) nstripes - 2; i++)
     {
       int c;
-      if (array->layout & GRUB_RAID_LAYOUT_MUL_FROM_POS)
+      if (layout & GRUB_RAID_LAYOUT_MUL_FROM_POS)
 	c = pos;
       else
 	c = i;
@@ -109,11 +78,11 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
         bad1 = c;
       else
         {
-          if (! grub_diskfilter_read_node (&array->nodes[pos], sector,
-					   size >> GRUB_DISK_SECTOR_BITS, buf))
+          if (! read_func (data, pos, sector, buf, size))
             {
               grub_crypto_xor (pbuf, pbuf, buf, size);
-              grub_raid_block_mulx (c, buf, size);
+              grub_gf256_mul_region ((grub_uint8_t *) buf,
+				     grub_gf256_pow (c), size);
               grub_crypto_xor (qbuf, qbuf, buf, size);
             }
           else
@@ -128,7 +97,7 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
         }
 
       pos++;
-      if (pos == (int) array->node_count)
+      if (pos == (int) nstripes)
         pos = 0;
     }
 
@@ -139,45 +108,42 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
   if (bad2 < 0)
     {
       /* One bad device */
-      if ((! grub_diskfilter_read_node (&array->nodes[p], sector,
-					size >> GRUB_DISK_SECTOR_BITS, buf)))
+      if (! read_func (data, p, sector, buf, size))
         {
           grub_crypto_xor (buf, buf, pbuf, size);
           goto quit;
         }
 
       grub_errno = GRUB_ERR_NONE;
-      if (grub_diskfilter_read_node (&array->nodes[q], sector,
-				     size >> GRUB_DISK_SECTOR_BITS, buf))
+      if (read_func (data, q, sector, buf, size))
         goto quit;
 
       grub_crypto_xor (buf, buf, qbuf, size);
-      grub_raid_block_mulx (255 - bad1, buf,
-                           size);
+      grub_gf256_mul_region ((grub_uint8_t *) buf,
+			     grub_gf256_pow (255 - bad1), size);
     }
   else
     {
       /* Two bad devices */
       unsigned c;
 
-      if (grub_diskfilter_read_node (&array->nodes[p], sector,
-				     size >> GRUB_DISK_SECTOR_BITS, buf))
+      if (read_func (data, p, sector, buf, size))
         goto quit;
 
       grub_crypto_xor (pbuf, pbuf, buf, size);
 
-      if (grub_diskfilter_read_node (&array->nodes[q], sector,
-				     size >> GRUB_DISK_SECTOR_BITS, buf))
+      if (read_func (data, q, sector, buf, size))
         goto quit;
 
       grub_crypto_xor (qbuf, qbuf, buf, size);
 
       c = mod_255((255 ^ bad1)
-		  + (255 ^ powx_inv[(powx[bad2 + (bad1 ^ 255)] ^ 1)]));
-      grub_raid_block_mulx (c, qbuf, size);
+		  + (255 ^ grub_gf256_log (grub_gf256_pow (bad2 + (bad1 ^ 255))
+					   ^ 1)));
+      grub_gf256_mul_region ((grub_uint8_t *) qbuf, grub_gf256_pow (c), size);
 
       c = mod_255((unsigned) bad2 + c);
-      grub_raid_block_mulx (c, pbuf, size);
+      grub_gf256_mul_region ((grub_uint8_t *) pbuf, grub_gf256_pow (c), size);
 
       grub_crypto_xor (pbuf, pbuf, qbuf, size);
       grub_memcpy (buf, pbuf, size);
@@ -190,9 +156,27 @@ quit:
   return grub_errno;
 }
 
+static grub_err_t
+raid6_read_node (void *data, int disknr, grub_disk_addr_t sector,
+		 void *buf, grub_size_t size)
+{
+  struct grub_diskfilter_segment *array = data;
+
+  return grub_diskfilter_read_node (&array->nodes[disknr], sector,
+				    size >> GRUB_DISK_SECTOR_BITS, buf);
+}
+
+static grub_err_t
+grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
+                    char *buf, grub_disk_addr_t sector, grub_size_t size)
+{
+  return grub_raid6_recover_gen (array, array->node_count, disknr, p, buf,
+				 sector, size << GRUB_DISK_SECTOR_BITS,
+				 array->layout, raid6_read_node);
+}
+
 GRUB_MOD_INIT(raid6rec)
 {
-  grub_raid6_init_table ();
   grub_raid6_recover_func = grub_raid6_recover;
 }
 
@@ -29,6 +29,7 @@
 #include <minilzo.h>
 #include <grub/i18n.h>
 #include <grub/btrfs.h>
+#include <grub/diskfilter.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -66,7 +67,10 @@ struct grub_btrfs_superblock
   grub_uint64_t chunk_tree;
   grub_uint8_t dummy2[0x20];
   grub_uint64_t root_dir_objectid;
-  grub_uint8_t dummy3[0x41];
+  grub_uint64_t num_devices;
+  grub_uint32_t sectorsize;
+  grub_uint32_t nodesize;
+  grub_uint8_t dummy3[0x41 - 0x10];
   struct grub_btrfs_device this_device;
   char label[0x100];
   grub_uint8_t dummy4[0x100];
@@ -77,7 +81,9 @@ struct btrfs_header
 {
   grub_btrfs_checksum_t checksum;
   grub_btrfs_uuid_t uuid;
-  grub_uint8_t dummy[0x30];
+  grub_uint8_t dummy[0x20];
+  grub_uint64_t generation;
+  grub_uint64_t owner;
   grub_uint32_t nitems;
   grub_uint8_t level;
 } GRUB_PACKED;
@@ -88,6 +94,24 @@ struct grub_btrfs_device_desc
   grub_uint64_t id;
 };
 
+/* A chunk item with its stripes, indexed by logical start.  */
+struct grub_btrfs_chunk_map
+{
+  grub_uint64_t start;
+  grub_uint64_t size;
+  struct grub_btrfs_chunk_item *chunk;
+};
+
+#define GRUB_BTRFS_NODE_CACHE_SIZE 32
+
+struct grub_btrfs_node_cache
+{
+  grub_disk_addr_t addr;
+  grub_uint64_t generation;
+  unsigned last_used;
+  grub_uint8_t *node;
+};
+
 struct grub_btrfs_data
 {
   struct grub_btrfs_superblock sblock;
@@ -105,6 +129,16 @@ struct grub_btrfs_data
   grub_uint64_t exttree;
   grub_size_t extsize;
   struct grub_btrfs_extent_data *extent;
+
+  /* Chunks mapped so far, sorted by logical address.  */
+  struct grub_btrfs_chunk_map *chunks;
+  unsigned n_chunks;
+  unsigned n_chunks_allocated;
+
+  /* Recently used tree nodes.  */
+  grub_uint32_t nodesize;
+  unsigned node_tick;
+  struct grub_btrfs_node_cache nodes[GRUB_BTRFS_NODE_CACHE_SIZE];
 };
 
 struct grub_btrfs_chunk_item
@@ -119,6 +153,8 @@ struct grub_btrfs_chunk_item
 #define GRUB_BTRFS_CHUNK_TYPE_RAID1         0x10
 #define GRUB_BTRFS_CHUNK_TYPE_DUPLICATED    0x20
 #define GRUB_BTRFS_CHUNK_TYPE_RAID10        0x40
+#define GRUB_BTRFS_CHUNK_TYPE_RAID5         0x80
+#define GRUB_BTRFS_CHUNK_TYPE_RAID6         0x100
   grub_uint8_t dummy2[0xc];
   grub_uint16_t nstripes;
   grub_uint16_t nsubstripes;
@@ -142,7 +178,7 @@ struct grub_btrfs_internal_node
 {
   struct grub_btrfs_key key;
   grub_uint64_t addr;
-  grub_uint64_t dummy;
+  grub_uint64_t generation;
 } GRUB_PACKED;
 
 struct grub_btrfs_dir_item
@@ -306,6 +342,79 @@ save_ref (struct grub_btrfs_leaf_descriptor *desc,
   return GRUB_ERR_NONE;
 }
 
+/* Read the tree node at ADDR, through the node cache.  GENERATION is
+   the one recorded in the parent pointer, or 0 if unknown.  The returned
+   buffer is only valid until the next call.  */
+static grub_err_t
+get_node (struct grub_btrfs_data *data, grub_disk_addr_t addr,
+	  grub_uint64_t generation, const grub_uint8_t **node_out,
+	  int recursion_depth)
+{
+  struct grub_btrfs_node_cache *slot;
+  const struct btrfs_header *head;
+  grub_uint8_t *node;
+  grub_size_t itemsize;
+  grub_err_t err;
+  unsigned i;
+
+  for (i = 0; i < GRUB_BTRFS_NODE_CACHE_SIZE; i++)
+    {
+      if (data->nodes[i].node && data->nodes[i].addr == addr
+	  && (!generation || data->nodes[i].generation == generation))
+	{
+	  data->nodes[i].last_used = ++data->node_tick;
+	  *node_out = data->nodes[i].node;
+	  return GRUB_ERR_NONE;
+	}
+    }
+
+  /* Mapping ADDR may need other nodes, so pick a slot only after the
+     read.  */
+  node = grub_malloc (data->nodesize);
+  if (!node)
+    return grub_errno;
+  err = grub_btrfs_read_logical (data, addr, node, data->nodesize,
+				 recursion_depth);
+  if (err)
+    {
+      grub_free (node);
+      return err;
+    }
+
+  head = (const struct btrfs_header *) node;
+  itemsize = head->level ? sizeof (struct grub_btrfs_internal_node)
+    : sizeof (struct grub_btrfs_leaf_node);
+  if (grub_le_to_cpu32 (head->nitems)
+      > (data->nodesize - sizeof (*head)) / itemsize)
+    {
+      grub_free (node);
+      return grub_error (GRUB_ERR_BAD_FS, "invalid btrfs tree node");
+    }
+
+  /* Replace a stale copy of the node, else the least recently used
+     one.  */
+  slot = &data->nodes[0];
+  for (i = 0; i < GRUB_BTRFS_NODE_CACHE_SIZE; i++)
+    {
+      if (data->nodes[i].node && data->nodes[i].addr == addr)
+	{
+	  slot = &data->nodes[i];
+	  break;
+	}
+      if (!data->nodes[i].node
+	  || (slot->node && data->nodes[i].last_used < slot->last_used))
+	slot = &data->nodes[i];
+    }
+
+  grub_free (slot->node);
+  slot->node = node;
+  slot->addr = addr;
+  slot->generation = grub_le_to_cpu64 (head->generation);
+  slot->last_used = ++data->node_tick;
+  *node_out = node;
+  return GRUB_ERR_NONE;
+}
+
 static int
 next (struct grub_btrfs_data *data,
       struct grub_btrfs_leaf_descriptor *desc,
@@ -313,6 +422,7 @@ next (struct grub_btrfs_data *data,
       struct grub_btrfs_key *key_out)
 {
   grub_err_t err;
+  const grub_uint8_t *node;
   struct grub_btrfs_leaf_node leaf;
 
   for (; desc->depth > 0; desc->depth--)
@@ -326,32 +436,33 @@ next (struct grub_btrfs_data *data,
     return 0;
   while (!desc->data[desc->depth - 1].leaf)
     {
-      struct grub_btrfs_internal_node node;
-      struct btrfs_header head;
-
-      err = grub_btrfs_read_logical (data, desc->data[desc->depth - 1].iter
-				     * sizeof (node)
-				     + sizeof (struct btrfs_header)
-				     + desc->data[desc->depth - 1].addr,
-				     &node, sizeof (node), 0);
+      struct grub_btrfs_internal_node child;
+      const struct btrfs_header *head;
+
+      err = get_node (data, desc->data[desc->depth - 1].addr, 0, &node, 0);
       if (err)
 	return -err;
+      grub_memcpy (&child, node + sizeof (struct btrfs_header)
+		   + desc->data[desc->depth - 1].iter * sizeof (child),
+		   sizeof (child));
 
-      err = grub_btrfs_read_logical (data, grub_le_to_cpu64 (node.addr),
-				     &head, sizeof (head), 0);
+      err = get_node (data, grub_le_to_cpu64 (child.addr),
+		      grub_le_to_cpu64 (child.generation), &node, 0);
       if (err)
 	return -err;
+      head = (const struct btrfs_header *) node;
 
-      save_ref (desc, grub_le_to_cpu64 (node.addr), 0,
-		grub_le_to_cpu32 (head.nitems), !head.level);
+      err = save_ref (desc, grub_le_to_cpu64 (child.addr), 0,
+		      grub_le_to_cpu32 (head->nitems), !head->level);
+      if (err)
+	return -err;
     }
-  err = grub_btrfs_read_logical (data, desc->data[desc->depth - 1].iter
-				 * sizeof (leaf)
-				 + sizeof (struct btrfs_header)
-				 + desc->data[desc->depth - 1].addr, &leaf,
-				 sizeof (leaf), 0);
+  err = get_node (data, desc->data[desc->depth - 1].addr, 0, &node, 0);
   if (err)
     return -err;
+  grub_memcpy (&leaf, node + sizeof (struct btrfs_header)
+	       + desc->data[desc->depth - 1].iter * sizeof (leaf),
+	       sizeof (leaf));
   *outsize = grub_le_to_cpu32 (leaf.size);
   *outaddr = desc->data[desc->depth - 1].addr + sizeof (struct btrfs_header)
     + grub_le_to_cpu32 (leaf.offset);
@@ -369,6 +480,7 @@ lower_bound (struct grub_btrfs_data *data,
 	     int recursion_depth)
 {
   grub_disk_addr_t addr = grub_le_to_cpu64 (root);
+  grub_uint64_t generation = 0;
   int depth = -1;
 
   if (desc)
@@ -393,122 +505,82 @@ lower_bound (struct grub_btrfs_data *data,
   while (1)
     {
       grub_err_t err;
-      struct btrfs_header head;
+      const grub_uint8_t *node, *items;
+      const struct btrfs_header *head;
+      grub_uint32_t nitems;
+      grub_size_t itemsize;
+      unsigned lo, hi;
 
-    reiter:
       depth++;
-      /* FIXME: preread few nodes into buffer. */
-      err = grub_btrfs_read_logical (data, addr, &head, sizeof (head),
-				     recursion_depth + 1);
+      err = get_node (data, addr, generation, &node, recursion_depth + 1);
       if (err)
 	return err;
-      addr += sizeof (head);
-      if (head.level)
+      head = (const struct btrfs_header *) node;
+      items = node + sizeof (*head);
+      nitems = grub_le_to_cpu32 (head->nitems);
+      itemsize = head->level ? sizeof (struct grub_btrfs_internal_node)
+	: sizeof (struct grub_btrfs_leaf_node);
+
+      /* Every item starts with its key.  Find the last one not above
+	 KEY_IN.  */
+      lo = 0;
+      hi = nitems;
+      while (lo < hi)
 	{
-	  unsigned i;
-	  struct grub_btrfs_internal_node node, node_last;
-	  int have_last = 0;
-	  grub_memset (&node_last, 0, sizeof (node_last));
-	  for (i = 0; i < grub_le_to_cpu32 (head.nitems); i++)
-	    {
-	      err = grub_btrfs_read_logical (data, addr + i * sizeof (node),
-					     &node, sizeof (node),
-					     recursion_depth + 1);
-	      if (err)
-		return err;
+	  unsigned mid = lo + (hi - lo) / 2;
+	  struct grub_btrfs_key key;
 
-	      grub_dprintf ("btrfs",
-			    "internal node (depth %d) %" PRIxGRUB_UINT64_T
-			    " %x %" PRIxGRUB_UINT64_T "\n", depth,
-			    node.key.object_id, node.key.type,
-			    node.key.offset);
+	  grub_memcpy (&key, items + mid * itemsize, sizeof (key));
+	  if (key_cmp (&key, key_in) <= 0)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
 
-	      if (key_cmp (&node.key, key_in) == 0)
-		{
-		  err = GRUB_ERR_NONE;
-		  if (desc)
-		    err = save_ref (desc, addr - sizeof (head), i,
-				    grub_le_to_cpu32 (head.nitems), 0);
-		  if (err)
-		    return err;
-		  addr = grub_le_to_cpu64 (node.addr);
-		  goto reiter;
-		}
-	      if (key_cmp (&node.key, key_in) > 0)
-		break;
-	      node_last = node;
-	      have_last = 1;
-	    }
-	  if (have_last)
-	    {
-	      err = GRUB_ERR_NONE;
-	      if (desc)
-		err = save_ref (desc, addr - sizeof (head), i - 1,
-				grub_le_to_cpu32 (head.nitems), 0);
-	      if (err)
-		return err;
-	      addr = grub_le_to_cpu64 (node_last.addr);
-	      goto reiter;
-	    }
+      if (lo == 0)
+	{
 	  *outsize = 0;
 	  *outaddr = 0;
 	  grub_memset (key_out, 0, sizeof (*key_out));
 	  if (desc)
-	    return save_ref (desc, addr - sizeof (head), -1,
-			     grub_le_to_cpu32 (head.nitems), 0);
+	    return save_ref (desc, addr, -1, nitems, !head->level);
 	  return GRUB_ERR_NONE;
 	}
-      {
-	unsigned i;
-	struct grub_btrfs_leaf_node leaf, leaf_last;
-	int have_last = 0;
-	for (i = 0; i < grub_le_to_cpu32 (head.nitems); i++)
-	  {
-	    err = grub_btrfs_read_logical (data, addr + i * sizeof (leaf),
-					   &leaf, sizeof (leaf),
-					   recursion_depth + 1);
-	    if (err)
-	      return err;
 
-	    grub_dprintf ("btrfs",
-			  "leaf (depth %d) %" PRIxGRUB_UINT64_T
-			  " %x %" PRIxGRUB_UINT64_T "\n", depth,
-			  leaf.key.object_id, leaf.key.type, leaf.key.offset);
-
-	    if (key_cmp (&leaf.key, key_in) == 0)
-	      {
-		grub_memcpy (key_out, &leaf.key, sizeof (*key_out));
-		*outsize = grub_le_to_cpu32 (leaf.size);
-		*outaddr = addr + grub_le_to_cpu32 (leaf.offset);
-		if (desc)
-		  return save_ref (desc, addr - sizeof (head), i,
-				   grub_le_to_cpu32 (head.nitems), 1);
-		return GRUB_ERR_NONE;
-	      }
-
-	    if (key_cmp (&leaf.key, key_in) > 0)
-	      break;
+      if (head->level)
+	{
+	  struct grub_btrfs_internal_node inode;
 
-	    have_last = 1;
-	    leaf_last = leaf;
-	  }
+	  grub_memcpy (&inode, items + (lo - 1) * itemsize, sizeof (inode));
+	  grub_dprintf ("btrfs",
+			"internal node (depth %d) %" PRIxGRUB_UINT64_T
+			" %x %" PRIxGRUB_UINT64_T "\n", depth,
+			inode.key.object_id, inode.key.type,
+			inode.key.offset);
+	  if (desc)
+	    {
+	      err = save_ref (desc, addr, lo - 1, nitems, 0);
+	      if (err)
+		return err;
+	    }
+	  addr = grub_le_to_cpu64 (inode.addr);
+	  generation = grub_le_to_cpu64 (inode.generation);
+	  continue;
+	}
 
-	if (have_last)
-	  {
-	    grub_memcpy (key_out, &leaf_last.key, sizeof (*key_out));
-	    *outsize = grub_le_to_cpu32 (leaf_last.size);
-	    *outaddr = addr + grub_le_to_cpu32 (leaf_last.offset);
-	    if (desc)
-	      return save_ref (desc, addr - sizeof (head), i - 1,
-			       grub_le_to_cpu32 (head.nitems), 1);
-	    return GRUB_ERR_NONE;
-	  }
-	*outsize = 0;
-	*outaddr = 0;
-	grub_memset (key_out, 0, sizeof (*key_out));
+      {
+	struct grub_btrfs_leaf_node leaf;
+
+	grub_memcpy (&leaf, items + (lo - 1) * itemsize, sizeof (leaf));
+	grub_dprintf ("btrfs",
+		      "leaf (depth %d) %" PRIxGRUB_UINT64_T
+		      " %x %" PRIxGRUB_UINT64_T "\n", depth,
+		      leaf.key.object_id, leaf.key.type, leaf.key.offset);
+	grub_memcpy (key_out, &leaf.key, sizeof (*key_out));
+	*outsize = grub_le_to_cpu32 (leaf.size);
+	*outaddr = addr + sizeof (*head) + grub_le_to_cpu32 (leaf.offset);
 	if (desc)
-	  return save_ref (desc, addr - sizeof (head), -1,
-			   grub_le_to_cpu32 (head.nitems), 1);
+	  return save_ref (desc, addr, lo - 1, nitems, 1);
 	return GRUB_ERR_NONE;
       }
     }
@@ -606,15 +678,171 @@ find_device (struct grub_btrfs_data *data, grub_uint64_t id, int do_rescan)
   return ctx.dev_found;
 }
 
+/* Context for raid56_read_stripe.  */
+struct raid56_ctx
+{
+  struct grub_btrfs_data *data;
+  struct grub_btrfs_chunk_item *chunk;
+};
+
+/* Read SIZE bytes at OFFSET into stripe DISKNR of a RAID5/6 chunk.  */
+static grub_err_t
+raid56_read_stripe (void *data, int disknr, grub_disk_addr_t offset,
+		    void *buf, grub_size_t size)
+{
+  struct raid56_ctx *ctx = data;
+  struct grub_btrfs_chunk_stripe *stripe;
+  grub_disk_addr_t paddr;
+  grub_device_t dev;
+
+  stripe = (struct grub_btrfs_chunk_stripe *) (ctx->chunk + 1) + disknr;
+  paddr = grub_le_to_cpu64 (stripe->offset) + offset;
+
+  dev = find_device (ctx->data, stripe->device_id, 1);
+  if (!dev)
+    return grub_errno;
+
+  return grub_disk_read (dev->disk, paddr >> GRUB_DISK_SECTOR_BITS,
+			 paddr & (GRUB_DISK_SECTOR_SIZE - 1), size, buf);
+}
+
+/* Rebuild SIZE bytes of data stripe STRIPEN from the rest of its row,
+   whose first parity stripe is PARITIES_POS.  Each remaining device is
+   read once for the whole range.  */
+static grub_err_t
+raid56_recover (struct grub_btrfs_data *data,
+		struct grub_btrfs_chunk_item *chunk, grub_uint64_t nparities,
+		grub_uint64_t stripen, grub_uint64_t parities_pos,
+		grub_uint64_t stripe_offset, grub_size_t size, void *buf)
+{
+  struct raid56_ctx ctx = {
+    .data = data,
+    .chunk = chunk
+  };
+  grub_uint16_t nstripes = grub_le_to_cpu16 (chunk->nstripes);
+  grub_err_t err;
+
+  grub_dprintf ("btrfs", "recovering stripe %" PRIuGRUB_UINT64_T
+		" of %u from parity\n", stripen, nstripes);
+
+  if (nparities == 1)
+    err = grub_raid5_recover_gen (&ctx, nstripes, stripen, buf,
+				  stripe_offset, size, raid56_read_stripe);
+  else
+    err = grub_raid6_recover_gen (&ctx, nstripes, stripen, parities_pos,
+				  buf, stripe_offset, size, 0,
+				  raid56_read_stripe);
+  if (err)
+    return grub_error (GRUB_ERR_READ_ERROR,
+		       "couldn't recover the RAID5/6 stripe");
+  return GRUB_ERR_NONE;
+}
+
+/* Find the chunk containing ADDR in the chunk map.  */
+static struct grub_btrfs_chunk_map *
+chunk_map_find (struct grub_btrfs_data *data, grub_uint64_t addr)
+{
+  unsigned lo = 0, hi = data->n_chunks;
+
+  while (lo < hi)
+    {
+      unsigned mid = lo + (hi - lo) / 2;
+
+      if (data->chunks[mid].start <= addr)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  if (lo == 0 || addr - data->chunks[lo - 1].start >= data->chunks[lo - 1].size)
+    return NULL;
+  return &data->chunks[lo - 1];
+}
+
+/* Add CHUNK, which must not overlap the known ones, to the chunk map.
+   The map takes ownership of CHUNK on success.  */
+static grub_err_t
+chunk_map_insert (struct grub_btrfs_data *data, grub_uint64_t start,
+		  struct grub_btrfs_chunk_item *chunk)
+{
+  unsigned i;
+
+  if (data->n_chunks == data->n_chunks_allocated)
+    {
+      struct grub_btrfs_chunk_map *chunks;
+      unsigned n = 2 * data->n_chunks_allocated + 16;
+
+      chunks = grub_realloc (data->chunks, n * sizeof (chunks[0]));
+      if (!chunks)
+	return grub_errno;
+      data->chunks = chunks;
+      data->n_chunks_allocated = n;
+    }
+
+  for (i = data->n_chunks; i > 0 && data->chunks[i - 1].start > start; i--)
+    data->chunks[i] = data->chunks[i - 1];
+  data->chunks[i].start = start;
+  data->chunks[i].size = grub_le_to_cpu64 (chunk->size);
+  data->chunks[i].chunk = chunk;
+  data->n_chunks++;
+  return GRUB_ERR_NONE;
+}
+
+/* Seed the chunk map with the system chunks from the superblock.  */
+static grub_err_t
+chunk_map_init (struct grub_btrfs_data *data)
+{
+  grub_uint8_t *ptr = data->sblock.bootstrap_mapping;
+  grub_uint8_t *end = ptr + sizeof (data->sblock.bootstrap_mapping);
+
+  while (ptr + sizeof (struct grub_btrfs_key)
+	 + sizeof (struct grub_btrfs_chunk_item) <= end)
+    {
+      struct grub_btrfs_key *key = (struct grub_btrfs_key *) ptr;
+      struct grub_btrfs_chunk_item *chunk, *copy;
+      grub_size_t chsize;
+      grub_err_t err;
+
+      if (key->type != GRUB_BTRFS_ITEM_TYPE_CHUNK)
+	break;
+      chunk = (struct grub_btrfs_chunk_item *) (key + 1);
+      chsize = sizeof (*chunk) + sizeof (struct grub_btrfs_chunk_stripe)
+	* grub_le_to_cpu16 (chunk->nstripes);
+      if (ptr + sizeof (*key) + chsize > end)
+	break;
+      ptr += sizeof (*key) + chsize;
+
+      grub_dprintf ("btrfs",
+		    "%" PRIxGRUB_UINT64_T " %" PRIxGRUB_UINT64_T " \n",
+		    grub_le_to_cpu64 (key->offset),
+		    grub_le_to_cpu64 (chunk->size));
+      if (chunk_map_find (data, grub_le_to_cpu64 (key->offset)))
+	continue;
+
+      copy = grub_malloc (chsize);
+      if (!copy)
+	return grub_errno;
+      grub_memcpy (copy, chunk, chsize);
+      err = chunk_map_insert (data, grub_le_to_cpu64 (key->offset), copy);
+      if (err)
+	{
+	  grub_free (copy);
+	  return err;
+	}
+    }
+
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			 void *buf, grub_size_t size, int recursion_depth)
 {
   while (size > 0)
     {
-      grub_uint8_t *ptr;
-      struct grub_btrfs_key *key;
+      struct grub_btrfs_chunk_map *map;
       struct grub_btrfs_chunk_item *chunk;
+      grub_uint64_t chstart;
       grub_uint64_t csize;
       grub_err_t err = 0;
       struct grub_btrfs_key key_out;
@@ -626,26 +854,12 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 
       grub_dprintf ("btrfs", "searching for laddr %" PRIxGRUB_UINT64_T "\n",
 		    addr);
-      for (ptr = data->sblock.bootstrap_mapping;
-	   ptr < data->sblock.bootstrap_mapping
-	   + sizeof (data->sblock.bootstrap_mapping)
-	   - sizeof (struct grub_btrfs_key);)
+      map = chunk_map_find (data, addr);
+      if (map)
 	{
-	  key = (struct grub_btrfs_key *) ptr;
-	  if (key->type != GRUB_BTRFS_ITEM_TYPE_CHUNK)
-	    break;
-	  chunk = (struct grub_btrfs_chunk_item *) (key + 1);
-	  grub_dprintf ("btrfs",
-			"%" PRIxGRUB_UINT64_T " %" PRIxGRUB_UINT64_T " \n",
-			grub_le_to_cpu64 (key->offset),
-			grub_le_to_cpu64 (chunk->size));
-	  if (grub_le_to_cpu64 (key->offset) <= addr
-	      && addr < grub_le_to_cpu64 (key->offset)
-	      + grub_le_to_cpu64 (chunk->size))
-	    goto chunk_found;
-	  ptr += sizeof (*key) + sizeof (*chunk)
-	    + sizeof (struct grub_btrfs_chunk_stripe)
-	    * grub_le_to_cpu16 (chunk->nstripes);
+	  chunk = map->chunk;
+	  chstart = map->start;
+	  goto chunk_found;
 	}
 
       key_in.object_id = grub_cpu_to_le64_compile_time (GRUB_BTRFS_OBJECT_ID_CHUNK);
@@ -656,12 +870,14 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			 &chaddr, &chsize, NULL, recursion_depth);
       if (err)
 	return err;
-      key = &key_out;
-      if (key->type != GRUB_BTRFS_ITEM_TYPE_CHUNK
-	  || !(grub_le_to_cpu64 (key->offset) <= addr))
+      if (key_out.type != GRUB_BTRFS_ITEM_TYPE_CHUNK
+	  || !(grub_le_to_cpu64 (key_out.offset) <= addr))
 	return grub_error (GRUB_ERR_BAD_FS,
 			   "couldn't find the chunk descriptor");
+      chstart = grub_le_to_cpu64 (key_out.offset);
 
+      if (chsize < sizeof (*chunk))
+	return grub_error (GRUB_ERR_BAD_FS, "invalid btrfs chunk item");
       chunk = grub_malloc (chsize);
       if (!chunk)
 	return grub_errno;
@@ -675,13 +891,20 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	  return err;
 	}
 
+      /* Remember the chunk for the following reads.  */
+      if (addr - chstart < grub_le_to_cpu64 (chunk->size)
+	  && chunk_map_insert (data, chstart, chunk) == GRUB_ERR_NONE)
+	challoc = 0;
+      grub_errno = GRUB_ERR_NONE;
+
     chunk_found:
       {
 	grub_uint64_t stripen;
 	grub_uint64_t stripe_offset;
-	grub_uint64_t off = addr - grub_le_to_cpu64 (key->offset);
+	grub_uint64_t off = addr - chstart;
 	grub_uint64_t chunk_stripe_length;
 	grub_uint16_t nstripes;
+	grub_uint64_t nparities = 0, parities_pos = 0;
 	unsigned redundancy = 1;
 	unsigned i, j;
 
@@ -698,7 +921,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 		      "+0x%" PRIxGRUB_UINT64_T
 		      " (%d stripes (%d substripes) of %"
 		      PRIxGRUB_UINT64_T ")\n",
-		      grub_le_to_cpu64 (key->offset),
+		      chstart,
 		      grub_le_to_cpu64 (chunk->size),
 		      nstripes,
 		      grub_le_to_cpu16 (chunk->nsubstripes),
@@ -766,6 +989,45 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	      csize = chunk_stripe_length - low;
 	      break;
 	    }
+	  case GRUB_BTRFS_CHUNK_TYPE_RAID5:
+	  case GRUB_BTRFS_CHUNK_TYPE_RAID6:
+	    {
+	      grub_uint64_t stripe_nr, high, low;
+
+	      /*
+	       * Every row holds nstripes - nparities data stripes followed
+	       * by P (and Q for RAID6), and each row is rotated one device
+	       * further than the previous one:
+	       *
+	       *   Dev 0  Dev 1  Dev 2  Dev 3
+	       *    D0     D1     P0     Q0
+	       *    Q1     D2     D3     P1
+	       *    P2     Q2     D4     D5
+	       */
+	      if (grub_le_to_cpu64 (chunk->type) & GRUB_BTRFS_CHUNK_TYPE_RAID5)
+		{
+		  grub_dprintf ("btrfs", "RAID5\n");
+		  nparities = 1;
+		}
+	      else
+		{
+		  grub_dprintf ("btrfs", "RAID6\n");
+		  nparities = 2;
+		}
+	      if (nstripes <= nparities)
+		return grub_error (GRUB_ERR_BAD_FS,
+				   "invalid RAID5/6 chunk: %u stripes",
+				   nstripes);
+
+	      stripe_nr = grub_divmod64 (off, chunk_stripe_length, &low);
+	      high = grub_divmod64 (stripe_nr, nstripes - nparities, &stripen);
+	      grub_divmod64 (high + stripen, nstripes, &stripen);
+	      grub_divmod64 (high + nstripes - nparities, nstripes,
+			     &parities_pos);
+	      stripe_offset = low + chunk_stripe_length * high;
+	      csize = chunk_stripe_length - low;
+	      break;
+	    }
 	  default:
 	    grub_dprintf ("btrfs", "unsupported RAID\n");
 	    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
@@ -786,8 +1048,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 		grub_disk_addr_t paddr;
 
 		stripe = (struct grub_btrfs_chunk_stripe *) (chunk + 1);
-		/* Right now the redundancy handling is easy.
-		   With RAID5-like it will be more difficult.  */
+		/* RAID5/6 parity is only read when recovering.  */
 		stripe += stripen + i;
 
 		paddr = grub_le_to_cpu64 (stripe->offset) + stripe_offset;
@@ -797,7 +1058,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			      " (%d stripes (%d substripes) of %"
 			      PRIxGRUB_UINT64_T ") stripe %" PRIxGRUB_UINT64_T
 			      " maps to 0x%" PRIxGRUB_UINT64_T "\n",
-			      grub_le_to_cpu64 (key->offset),
+			      chstart,
 			      grub_le_to_cpu64 (chunk->size),
 			      grub_le_to_cpu16 (chunk->nstripes),
 			      grub_le_to_cpu16 (chunk->nsubstripes),
@@ -825,6 +1086,12 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	    if (i != redundancy)
 	      break;
 	  }
+	if (err && nparities)
+	  {
+	    grub_errno = GRUB_ERR_NONE;
+	    err = raid56_recover (data, chunk, nparities, stripen, parities_pos,
+				  stripe_offset, csize, buf);
+	  }
 	if (err)
 	  return grub_errno = err;
       }
@@ -837,6 +1104,23 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
   return GRUB_ERR_NONE;
 }
 
+static void
+grub_btrfs_unmount (struct grub_btrfs_data *data)
+{
+  unsigned i;
+  /* The device 0 is closed one layer upper.  */
+  for (i = 1; i < data->n_devices_attached; i++)
+    grub_device_close (data->devices_attached[i].dev);
+  grub_free (data->devices_attached);
+  grub_free (data->extent);
+  for (i = 0; i < data->n_chunks; i++)
+    grub_free (data->chunks[i].chunk);
+  grub_free (data->chunks);
+  for (i = 0; i < GRUB_BTRFS_NODE_CACHE_SIZE; i++)
+    grub_free (data->nodes[i].node);
+  grub_free (data);
+}
+
 static struct grub_btrfs_data *
 grub_btrfs_mount (grub_device_t dev)
 {
@@ -860,6 +1144,15 @@ grub_btrfs_mount (grub_device_t dev)
       return NULL;
     }
 
+  data->nodesize = grub_le_to_cpu32 (data->sblock.nodesize);
+  if (data->nodesize < 1024 || data->nodesize > 65536
+      || (data->nodesize & (data->nodesize - 1)))
+    {
+      grub_error (GRUB_ERR_BAD_FS, "invalid btrfs node size");
+      grub_free (data);
+      return NULL;
+    }
+
   data->n_devices_allocated = 16;
   data->devices_attached = grub_malloc (sizeof (data->devices_attached[0])
 					* data->n_devices_allocated);
@@ -872,19 +1165,13 @@ grub_btrfs_mount (grub_device_t dev)
   data->devices_attached[0].dev = dev;
   data->devices_attached[0].id = data->sblock.this_device.device_id;
 
-  return data;
-}
+  if (chunk_map_init (data))
+    {
+      grub_btrfs_unmount (data);
+      return NULL;
+    }
 
-static void
-grub_btrfs_unmount (struct grub_btrfs_data *data)
-{
-  unsigned i;
-  /* The device 0 is closed one layer upper.  */
-  for (i = 1; i < data->n_devices_attached; i++)
-    grub_device_close (data->devices_attached[i].dev);
-  grub_free (data->devices_attached);
-  grub_free (data->extent);
-  grub_free (data);
+  return data;
 }
 
 static grub_err_t
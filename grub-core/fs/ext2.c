@@ -138,8 +138,12 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define EXT3_JOURNAL_FLAG_DELETED	4
 #define EXT3_JOURNAL_FLAG_LAST_TAG	8
 
+#define EXT2_INDEX_FL			0x1000
 #define EXT4_EXTENTS_FLAG		0x80000
 
+/* Superblock flags.  */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
 /* The ext2 superblock.  */
 struct grub_ext2_sblock
 {
@@ -193,6 +197,12 @@ struct grub_ext2_sblock
   grub_uint32_t first_meta_bg;
   grub_uint32_t mkfs_time;
   grub_uint32_t jnl_blocks[17];
+  grub_uint32_t total_blocks_high;
+  grub_uint32_t reserved_blocks_high;
+  grub_uint32_t free_blocks_high;
+  grub_uint16_t min_extra_inode_size;
+  grub_uint16_t want_extra_inode_size;
+  grub_uint32_t flags;
 };
 
 /* The ext2 blockgroup.  */
@@ -735,6 +745,64 @@ grub_ext2_read_symlink (grub_fshelp_node_t node)
   return symlink;
 }
 
+/* Make a node for the entry DIRENT of the directory DIRO and find its
+   type.  */
+static struct grub_fshelp_node *
+grub_ext2_dirent_node (struct grub_fshelp_node *diro,
+		       const struct ext2_dirent *dirent,
+		       enum grub_fshelp_filetype *type)
+{
+  struct grub_fshelp_node *fdiro;
+
+  *type = GRUB_FSHELP_UNKNOWN;
+
+  fdiro = grub_malloc (sizeof (struct grub_fshelp_node));
+  if (! fdiro)
+    return 0;
+
+  fdiro->data = diro->data;
+  fdiro->ino = grub_le_to_cpu32 (dirent->inode);
+
+  if (dirent->filetype != FILETYPE_UNKNOWN)
+    {
+      fdiro->inode_read = 0;
+
+      if (dirent->filetype == FILETYPE_DIRECTORY)
+	*type = GRUB_FSHELP_DIR;
+      else if (dirent->filetype == FILETYPE_SYMLINK)
+	*type = GRUB_FSHELP_SYMLINK;
+      else if (dirent->filetype == FILETYPE_REG)
+	*type = GRUB_FSHELP_REG;
+    }
+  else
+    {
+      /* The filetype can not be read from the dirent, read
+	 the inode to get more information.  */
+      grub_ext2_read_inode (diro->data,
+			    grub_le_to_cpu32 (dirent->inode),
+			    &fdiro->inode);
+      if (grub_errno)
+	{
+	  grub_free (fdiro);
+	  return 0;
+	}
+
+      fdiro->inode_read = 1;
+
+      if ((grub_le_to_cpu16 (fdiro->inode.mode)
+	   & FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY)
+	*type = GRUB_FSHELP_DIR;
+      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
+		& FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK)
+	*type = GRUB_FSHELP_SYMLINK;
+      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
+		& FILETYPE_INO_MASK) == FILETYPE_INO_REG)
+	*type = GRUB_FSHELP_REG;
+    }
+
+  return fdiro;
+}
+
 static int
 grub_ext2_iterate_dir (grub_fshelp_node_t dir,
 		       grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
@@ -766,67 +834,500 @@ grub_ext2_iterate_dir (grub_fshelp_node_t dir,
 	{
 	  char filename[MAX_NAMELEN + 1];
 	  struct grub_fshelp_node *fdiro;
-	  enum grub_fshelp_filetype type = GRUB_FSHELP_UNKNOWN;
+	  enum grub_fshelp_filetype type;
 
 	  grub_ext2_read_file (diro, 0, 0, fpos + sizeof (struct ext2_dirent),
 			       dirent.namelen, filename);
 	  if (grub_errno)
 	    return 0;
 
-	  fdiro = grub_malloc (sizeof (struct grub_fshelp_node));
+	  filename[dirent.namelen] = '\0';
+
+	  fdiro = grub_ext2_dirent_node (diro, &dirent, &type);
 	  if (! fdiro)
 	    return 0;
 
-	  fdiro->data = diro->data;
-	  fdiro->ino = grub_le_to_cpu32 (dirent.inode);
+	  if (hook (filename, type, fdiro, hook_data))
+	    return 1;
+	}
 
-	  filename[dirent.namelen] = '\0';
+      fpos += grub_le_to_cpu16 (dirent.direntlen);
+    }
+
+  return 0;
+}
+
+/* Hashed directories (dir_index).  */
+struct ext2_dx_root_info
+{
+  grub_uint32_t reserved_zero;
+  grub_uint8_t hash_version;
+  grub_uint8_t info_length;
+  grub_uint8_t indirect_levels;
+  grub_uint8_t unused_flags;
+};
+
+struct ext2_dx_countlimit
+{
+  grub_uint16_t limit;
+  grub_uint16_t count;
+};
+
+struct ext2_dx_entry
+{
+  grub_uint32_t hash;
+  grub_uint32_t block;
+};
 
-	  if (dirent.filetype != FILETYPE_UNKNOWN)
+#define EXT2_DX_HASH_LEGACY		0
+#define EXT2_DX_HASH_HALF_MD4		1
+#define EXT2_DX_HASH_TEA		2
+#define EXT2_DX_HASH_UNSIGNED		3
+
+/* At most one level of index nodes below the root without largedir.  */
+#define EXT2_DX_MAX_LEVELS		2
+
+static grub_uint32_t
+dx_hack_hash (const char *name, int len, int is_unsigned)
+{
+  grub_uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+  while (len--)
+    {
+      grub_uint32_t c = is_unsigned ? (grub_uint8_t) *name
+	: (grub_uint32_t) (grub_int32_t) (grub_int8_t) *name;
+
+      name++;
+      hash = hash1 + (hash0 ^ (c * 7152373));
+      if (hash & 0x80000000)
+	hash -= 0x7fffffff;
+      hash1 = hash0;
+      hash0 = hash;
+    }
+
+  return hash0 << 1;
+}
+
+/* Pack up to NUM words of NAME into BUF, padded with the length.  */
+static void
+dx_str2hashbuf (const char *name, int len, grub_uint32_t *buf, int num,
+		int is_unsigned)
+{
+  grub_uint32_t pad, val;
+  int i;
+
+  pad = (grub_uint32_t) len | ((grub_uint32_t) len << 8);
+  pad |= pad << 16;
+
+  val = pad;
+  if (len > num * 4)
+    len = num * 4;
+  for (i = 0; i < len; i++)
+    {
+      grub_uint32_t c = is_unsigned ? (grub_uint8_t) name[i]
+	: (grub_uint32_t) (grub_int32_t) (grub_int8_t) name[i];
+
+      val = c + (val << 8);
+      if ((i % 4) == 3)
+	{
+	  *buf++ = val;
+	  val = pad;
+	  num--;
+	}
+    }
+  if (--num >= 0)
+    *buf++ = val;
+  while (--num >= 0)
+    *buf++ = pad;
+}
+
+static void
+dx_tea_transform (grub_uint32_t buf[4], const grub_uint32_t in[4])
+{
+  grub_uint32_t sum = 0, b0 = buf[0], b1 = buf[1];
+  int n;
+
+  for (n = 0; n < 16; n++)
+    {
+      sum += 0x9e3779b9;
+      b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+      b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+
+  buf[0] += b0;
+  buf[1] += b1;
+}
+
+#define DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define DX_H(x, y, z) ((x) ^ (y) ^ (z))
+#define DX_ROUND(f, a, b, c, d, x, s) \
+  (a += f (b, c, d) + (x), a = (a << (s)) | (a >> (32 - (s))))
+#define DX_K2 013240474631U
+#define DX_K3 015666365641U
+
+static void
+dx_half_md4_transform (grub_uint32_t buf[4], const grub_uint32_t in[8])
+{
+  grub_uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+  DX_ROUND (DX_F, a, b, c, d, in[0], 3);
+  DX_ROUND (DX_F, d, a, b, c, in[1], 7);
+  DX_ROUND (DX_F, c, d, a, b, in[2], 11);
+  DX_ROUND (DX_F, b, c, d, a, in[3], 19);
+  DX_ROUND (DX_F, a, b, c, d, in[4], 3);
+  DX_ROUND (DX_F, d, a, b, c, in[5], 7);
+  DX_ROUND (DX_F, c, d, a, b, in[6], 11);
+  DX_ROUND (DX_F, b, c, d, a, in[7], 19);
+
+  DX_ROUND (DX_G, a, b, c, d, in[1] + DX_K2, 3);
+  DX_ROUND (DX_G, d, a, b, c, in[3] + DX_K2, 5);
+  DX_ROUND (DX_G, c, d, a, b, in[5] + DX_K2, 9);
+  DX_ROUND (DX_G, b, c, d, a, in[7] + DX_K2, 13);
+  DX_ROUND (DX_G, a, b, c, d, in[0] + DX_K2, 3);
+  DX_ROUND (DX_G, d, a, b, c, in[2] + DX_K2, 5);
+  DX_ROUND (DX_G, c, d, a, b, in[4] + DX_K2, 9);
+  DX_ROUND (DX_G, b, c, d, a, in[6] + DX_K2, 13);
+
+  DX_ROUND (DX_H, a, b, c, d, in[3] + DX_K3, 3);
+  DX_ROUND (DX_H, d, a, b, c, in[7] + DX_K3, 9);
+  DX_ROUND (DX_H, c, d, a, b, in[2] + DX_K3, 11);
+  DX_ROUND (DX_H, b, c, d, a, in[6] + DX_K3, 15);
+  DX_ROUND (DX_H, a, b, c, d, in[1] + DX_K3, 3);
+  DX_ROUND (DX_H, d, a, b, c, in[5] + DX_K3, 9);
+  DX_ROUND (DX_H, c, d, a, b, in[0] + DX_K3, 11);
+  DX_ROUND (DX_H, b, c, d, a, in[4] + DX_K3, 15);
+
+  buf[0] += a;
+  buf[1] += b;
+  buf[2] += c;
+  buf[3] += d;
+}
+
+/* Hash NAME the way the kernel indexes it.  Return 0 if VERSION is not
+   supported.  */
+static int
+dx_hash (struct grub_ext2_data *data, int version, const char *name,
+	 grub_uint32_t *hash)
+{
+  grub_uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+  grub_uint32_t in[8];
+  int len = grub_strlen (name);
+  int is_unsigned = 0;
+  int i;
+
+  for (i = 0; i < 4; i++)
+    if (data->sblock.hash_seed[i])
+      break;
+  if (i < 4)
+    for (i = 0; i < 4; i++)
+      buf[i] = grub_le_to_cpu32 (data->sblock.hash_seed[i]);
+
+  if (version >= EXT2_DX_HASH_UNSIGNED)
+    {
+      version -= EXT2_DX_HASH_UNSIGNED;
+      is_unsigned = 1;
+    }
+
+  switch (version)
+    {
+    case EXT2_DX_HASH_LEGACY:
+      *hash = dx_hack_hash (name, len, is_unsigned);
+      break;
+    case EXT2_DX_HASH_HALF_MD4:
+      for (; len > 0; len -= 32, name += 32)
+	{
+	  dx_str2hashbuf (name, len, in, 8, is_unsigned);
+	  dx_half_md4_transform (buf, in);
+	}
+      *hash = buf[1];
+      break;
+    case EXT2_DX_HASH_TEA:
+      for (; len > 0; len -= 16, name += 16)
+	{
+	  dx_str2hashbuf (name, len, in, 4, is_unsigned);
+	  dx_tea_transform (buf, in);
+	}
+      *hash = buf[0];
+      break;
+    default:
+      return 0;
+    }
+
+  *hash &= ~1U;
+  if (*hash == (0x7fffffffU << 1))
+    *hash = 0x7ffffffeU << 1;
+  return 1;
+}
+
+/* One level of the index walk: a copy of the index block and the entry
+   that was followed.  */
+struct ext2_dx_frame
+{
+  char *block;
+  struct ext2_dx_entry *entries;
+  unsigned count;
+  unsigned at;
+};
+
+/* Read the index block BLK and find the entry for HASH in it, at the
+   index offset OFFSET.  Return 0 if the block does not look like an
+   index.  */
+static int
+dx_read_frame (struct grub_fshelp_node *diro, grub_uint32_t blk,
+	       unsigned offset, grub_uint32_t hash,
+	       struct ext2_dx_frame *frame)
+{
+  unsigned blocksize = EXT2_BLOCK_SIZE (diro->data);
+  struct ext2_dx_countlimit *cl;
+  unsigned lo, hi;
+
+  if (grub_ext2_read_file (diro, 0, 0, (grub_off_t) blk * blocksize,
+			   blocksize, frame->block) != (grub_ssize_t) blocksize)
+    return 0;
+
+  cl = (struct ext2_dx_countlimit *) (frame->block + offset);
+  frame->entries = (struct ext2_dx_entry *) cl;
+  frame->count = grub_le_to_cpu16 (cl->count);
+  if (frame->count == 0
+      || frame->count > grub_le_to_cpu16 (cl->limit)
+      || grub_le_to_cpu16 (cl->limit)
+      > (blocksize - offset) / sizeof (struct ext2_dx_entry))
+    return 0;
+
+  /* The first entry has no hash and covers everything below the
+     second.  */
+  lo = 1;
+  hi = frame->count;
+  while (lo < hi)
+    {
+      unsigned mid = lo + (hi - lo) / 2;
+
+      if (grub_le_to_cpu32 (frame->entries[mid].hash) > hash)
+	hi = mid;
+      else
+	lo = mid + 1;
+    }
+  frame->at = lo - 1;
+  return 1;
+}
+
+static grub_uint32_t
+dx_block (const struct ext2_dx_frame *frame)
+{
+  return grub_le_to_cpu32 (frame->entries[frame->at].block) & 0x0fffffff;
+}
+
+/* Search the leaf block BLK for NAME.  */
+static struct grub_fshelp_node *
+dx_search_leaf (struct grub_fshelp_node *diro, grub_uint32_t blk, char *buf,
+		const char *name, enum grub_fshelp_filetype *type)
+{
+  unsigned blocksize = EXT2_BLOCK_SIZE (diro->data);
+  grub_size_t namelen = grub_strlen (name);
+  unsigned pos;
+
+  if (grub_ext2_read_file (diro, 0, 0, (grub_off_t) blk * blocksize,
+			   blocksize, buf) != (grub_ssize_t) blocksize)
+    return 0;
+
+  for (pos = 0; pos + sizeof (struct ext2_dirent) <= blocksize; )
+    {
+      struct ext2_dirent *dirent = (struct ext2_dirent *) (buf + pos);
+      unsigned len = grub_le_to_cpu16 (dirent->direntlen);
+
+      if (len < sizeof (*dirent) || len > blocksize - pos)
+	break;
+      if (dirent->inode != 0 && dirent->namelen == namelen
+	  && sizeof (*dirent) + namelen <= len
+	  && grub_memcmp (dirent + 1, name, namelen) == 0)
+	{
+	  struct grub_fshelp_node *fdiro;
+
+	  fdiro = grub_ext2_dirent_node (diro, dirent, type);
+	  if (fdiro && *type == GRUB_FSHELP_UNKNOWN)
 	    {
-	      fdiro->inode_read = 0;
-
-	      if (dirent.filetype == FILETYPE_DIRECTORY)
-		type = GRUB_FSHELP_DIR;
-	      else if (dirent.filetype == FILETYPE_SYMLINK)
-		type = GRUB_FSHELP_SYMLINK;
-	      else if (dirent.filetype == FILETYPE_REG)
-		type = GRUB_FSHELP_REG;
+	      grub_free (fdiro);
+	      return 0;
 	    }
-	  else
+	  return fdiro;
+	}
+      pos += len;
+    }
+
+  return 0;
+}
+
+/* Look NAME up through the hash index of DIRO.  Return 0 if the
+   directory has to be scanned instead.  */
+static int
+grub_ext2_dx_lookup (struct grub_fshelp_node *diro, const char *name,
+		     grub_fshelp_node_t *foundnode,
+		     enum grub_fshelp_filetype *foundtype)
+{
+  struct grub_ext2_data *data = diro->data;
+  struct ext2_dx_frame frames[EXT2_DX_MAX_LEVELS];
+  struct ext2_dx_root_info *info;
+  unsigned blocksize = EXT2_BLOCK_SIZE (data);
+  unsigned levels, i;
+  grub_uint32_t hash;
+  int version, ret = 0;
+  char *leaf;
+
+  grub_memset (frames, 0, sizeof (frames));
+  leaf = grub_malloc (blocksize);
+  if (! leaf)
+    return 0;
+  for (i = 0; i < EXT2_DX_MAX_LEVELS; i++)
+    {
+      frames[i].block = grub_malloc (blocksize);
+      if (! frames[i].block)
+	goto out;
+    }
+
+  /* The root block starts with the "." and ".." entries, 12 bytes each.  */
+  if (grub_ext2_read_file (diro, 0, 0, 0, blocksize, frames[0].block)
+      != (grub_ssize_t) blocksize)
+    goto out;
+  info = (struct ext2_dx_root_info *) (frames[0].block + 24);
+  levels = info->indirect_levels + 1;
+  version = info->hash_version;
+  if (version <= EXT2_DX_HASH_TEA
+      && (data->sblock.flags
+	  & grub_cpu_to_le32_compile_time (EXT2_FLAGS_UNSIGNED_HASH)))
+    version += EXT2_DX_HASH_UNSIGNED;
+  if (info->reserved_zero != 0 || info->info_length < 8
+      || levels > EXT2_DX_MAX_LEVELS
+      || ! dx_hash (data, version, name, &hash)
+      || ! dx_read_frame (diro, 0, 24 + info->info_length, hash, &frames[0]))
+    goto out;
+
+  /* Index nodes look like a single empty directory entry.  */
+  for (i = 1; i < levels; i++)
+    if (! dx_read_frame (diro, dx_block (&frames[i - 1]), 8, hash,
+			 &frames[i]))
+      goto out;
+
+  ret = 1;
+  while (1)
+    {
+      *foundnode = dx_search_leaf (diro, dx_block (&frames[levels - 1]),
+				   leaf, name, foundtype);
+      if (*foundnode || grub_errno)
+	break;
+
+      /* Entries with colliding hashes may go on in the next leaf, which
+	 then has the low bit of its hash set.  */
+      for (i = levels; i > 0; i--)
+	if (frames[i - 1].at + 1 < frames[i - 1].count)
+	  break;
+      if (i == 0)
+	break;
+      frames[i - 1].at++;
+      {
+	grub_uint32_t next = grub_le_to_cpu32
+	  (frames[i - 1].entries[frames[i - 1].at].hash);
+
+	if (! (next & 1) || (next & ~1U) != hash)
+	  break;
+      }
+      for (; i < levels; i++)
+	{
+	  if (! dx_read_frame (diro, dx_block (&frames[i - 1]), 8, 0,
+			       &frames[i]))
 	    {
-	      /* The filetype can not be read from the dirent, read
-		 the inode to get more information.  */
-	      grub_ext2_read_inode (diro->data,
-                                    grub_le_to_cpu32 (dirent.inode),
-				    &fdiro->inode);
-	      if (grub_errno)
-		{
-		  grub_free (fdiro);
-		  return 0;
-		}
-
-	      fdiro->inode_read = 1;
-
-	      if ((grub_le_to_cpu16 (fdiro->inode.mode)
-		   & FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY)
-		type = GRUB_FSHELP_DIR;
-	      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
-			& FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK)
-		type = GRUB_FSHELP_SYMLINK;
-	      else if ((grub_le_to_cpu16 (fdiro->inode.mode)
-			& FILETYPE_INO_MASK) == FILETYPE_INO_REG)
-		type = GRUB_FSHELP_REG;
+	      ret = 0;
+	      break;
 	    }
-
-	  if (hook (filename, type, fdiro, hook_data))
-	    return 1;
+	  frames[i].at = 0;
 	}
+      if (! ret)
+	break;
+    }
 
-      fpos += grub_le_to_cpu16 (dirent.direntlen);
+ out:
+  for (i = 0; i < EXT2_DX_MAX_LEVELS; i++)
+    grub_free (frames[i].block);
+  grub_free (leaf);
+  return ret;
+}
+
+/* Context for grub_ext2_lookup_file.  */
+struct grub_ext2_lookup_ctx
+{
+  const char *name;
+  grub_fshelp_node_t *foundnode;
+  enum grub_fshelp_filetype *foundtype;
+};
+
+/* Helper for grub_ext2_lookup_file.  */
+static int
+grub_ext2_lookup_iter (const char *filename,
+		       enum grub_fshelp_filetype filetype,
+		       grub_fshelp_node_t node, void *data)
+{
+  struct grub_ext2_lookup_ctx *ctx = data;
+
+  if (filetype == GRUB_FSHELP_UNKNOWN || grub_strcmp (ctx->name, filename))
+    {
+      grub_free (node);
+      return 0;
     }
 
-  return 0;
+  *ctx->foundnode = node;
+  *ctx->foundtype = filetype;
+  return 1;
+}
+
+/* Helpers for the fshelp directory cache.  */
+static grub_size_t
+grub_ext2_node_size (grub_fshelp_node_t node __attribute__ ((unused)))
+{
+  return sizeof (struct grub_fshelp_node);
+}
+
+static void
+grub_ext2_node_rebind (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  node->data = root->data;
+}
+
+static const struct grub_fshelp_dcache_ops grub_ext2_dcache_ops =
+  {
+    .node_size = grub_ext2_node_size,
+    .node_rebind = grub_ext2_node_rebind
+  };
+
+static grub_err_t
+grub_ext2_lookup_file (grub_fshelp_node_t dir, const char *name,
+		       grub_fshelp_node_t *foundnode,
+		       enum grub_fshelp_filetype *foundtype)
+{
+  struct grub_ext2_lookup_ctx ctx = {
+    .name = name,
+    .foundnode = foundnode,
+    .foundtype = foundtype
+  };
+
+  if (! dir->inode_read)
+    {
+      grub_ext2_read_inode (dir->data, dir->ino, &dir->inode);
+      if (grub_errno)
+	return grub_errno;
+      dir->inode_read = 1;
+    }
+
+  if ((dir->data->sblock.feature_compatibility
+       & grub_cpu_to_le32_compile_time (EXT2_FEATURE_COMPAT_DIR_INDEX))
+      && (dir->inode.flags & grub_cpu_to_le32_compile_time (EXT2_INDEX_FL))
+      && grub_ext2_dx_lookup (dir, name, foundnode, foundtype))
+    return grub_errno;
+
+  /* Not indexed, or an index we don't understand.  */
+  grub_errno = GRUB_ERR_NONE;
+  *foundnode = 0;
+  grub_ext2_iterate_dir (dir, grub_ext2_lookup_iter, &ctx);
+  return grub_errno;
 }
 
 /* Open a file named NAME and initialize FILE.  */
@@ -846,9 +1347,10 @@ grub_ext2_open (struct grub_file *file, const char *name)
       goto fail;
     }
 
-  err = grub_fshelp_find_file (name, &data->diropen, &fdiro,
-			       grub_ext2_iterate_dir,
-			       grub_ext2_read_symlink, GRUB_FSHELP_REG);
+  err = grub_fshelp_find_file_cached (name, &data->diropen, &fdiro,
+				      grub_ext2_lookup_file,
+				      grub_ext2_read_symlink, GRUB_FSHELP_REG,
+				      data->disk, &grub_ext2_dcache_ops);
   if (err)
     goto fail;
 
@@ -952,9 +1454,10 @@ grub_ext2_dir (grub_device_t device, const char *path, grub_fs_dir_hook_t hook,
   if (! ctx.data)
     goto fail;
 
-  grub_fshelp_find_file (path, &ctx.data->diropen, &fdiro,
-			 grub_ext2_iterate_dir, grub_ext2_read_symlink,
-			 GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (path, &ctx.data->diropen, &fdiro,
+				grub_ext2_lookup_file, grub_ext2_read_symlink,
+				GRUB_FSHELP_DIR, ctx.data->disk,
+				&grub_ext2_dcache_ops);
   if (grub_errno)
     goto fail;
 
@@ -113,6 +113,12 @@ struct grub_fat_dir_entry
       grub_uint8_t character_count;
       grub_uint16_t str[15];
     }  GRUB_PACKED  volume_label;
+    struct {
+      grub_uint8_t flags;
+      grub_uint8_t reserved[18];
+      grub_uint32_t first_cluster;
+      grub_uint64_t data_length;
+    }  GRUB_PACKED  bitmap;
   }  GRUB_PACKED type_specific;
 } GRUB_PACKED;
 
@@ -161,6 +167,28 @@ typedef struct grub_fat_dir_entry grub_fat_dir_node_t;
 
 #endif
 
+/* A stretch of consecutive clusters in a cluster chain.  */
+struct grub_fat_run
+{
+  grub_uint32_t logical;
+  grub_uint32_t cluster;
+  grub_uint32_t count;
+};
+
+/* The part of the cluster chain starting at FIRST_CLUSTER that was
+   decoded so far, as a sorted list of runs.  */
+struct grub_fat_chain
+{
+  struct grub_fat_chain *next;
+  grub_uint32_t first_cluster;
+  /* Number of clusters covered by RUNS.  */
+  grub_uint32_t num_clusters;
+  int complete;
+  unsigned num_runs;
+  unsigned alloc_runs;
+  struct grub_fat_run *runs;
+};
+
 struct grub_fat_data
 {
   int logical_sector_bits;
@@ -182,6 +210,18 @@ struct grub_fat_data
   grub_uint32_t num_clusters;
 
   grub_uint32_t uuid;
+
+  /* Chains decoded for this mount.  Nodes are freed by fshelp without
+     telling us, so the chains live here.  */
+  struct grub_fat_chain *chains;
+
+#ifdef MODE_EXFAT
+  /* Allocation bitmap of the active FAT, looked up on first use.  */
+  int active_fat;
+  int bitmap_found;
+  grub_uint32_t bitmap_cluster;
+  grub_uint64_t bitmap_size;
+#endif
 };
 
 struct grub_fshelp_node {
@@ -195,11 +235,13 @@ struct grub_fshelp_node {
   grub_uint64_t file_size;
 #endif
   grub_uint32_t file_cluster;
-  grub_uint32_t cur_cluster_num;
-  grub_uint32_t cur_cluster;
+  struct grub_fat_chain *chain;
 
 #ifdef MODE_EXFAT
   int is_contiguous;
+  /* Whether the clusters of a contiguous file were checked against the
+     allocation bitmap.  */
+  int contiguous_checked;
 #endif
 };
 
@@ -237,6 +279,10 @@ grub_fat_mount (grub_disk_t disk)
   data = (struct grub_fat_data *) grub_malloc (sizeof (*data));
   if (! data)
     goto fail;
+  data->chains = 0;
+#ifdef MODE_EXFAT
+  data->bitmap_found = 0;
+#endif
 
   /* Read the BPB.  */
   if (grub_disk_read (disk, 0, 0, sizeof (bpb), &bpb))
@@ -340,10 +386,14 @@ grub_fat_mount (grub_disk_t disk)
     data->root_cluster = grub_le_to_cpu32 (bpb.root_cluster);
     data->fat_size = 32;
     data->cluster_eof_mark = 0xffffffff;
+    data->active_fat = 0;
 
     if ((bpb.volume_flags & grub_cpu_to_le16_compile_time (0x1))
 	&& bpb.num_fats > 1)
-      data->fat_sector += data->sectors_per_fat;
+      {
+	data->fat_sector += data->sectors_per_fat;
+	data->active_fat = 1;
+      }
   }
 #else
   if (! bpb.sectors_per_fat_16)
@@ -448,6 +498,193 @@ grub_fat_mount (grub_disk_t disk)
   return 0;
 }
 
+static void
+grub_fat_unmount (struct grub_fat_data *data)
+{
+  struct grub_fat_chain *chain, *next;
+
+  if (! data)
+    return;
+
+  for (chain = data->chains; chain; chain = next)
+    {
+      next = chain->next;
+      grub_free (chain->runs);
+      grub_free (chain);
+    }
+  grub_free (data);
+}
+
+static struct grub_fat_chain *
+grub_fat_get_chain (struct grub_fat_data *data, grub_uint32_t first_cluster)
+{
+  struct grub_fat_chain *chain;
+
+  for (chain = data->chains; chain; chain = chain->next)
+    if (chain->first_cluster == first_cluster)
+      return chain;
+
+  chain = grub_zalloc (sizeof (*chain));
+  if (! chain)
+    return 0;
+  chain->first_cluster = first_cluster;
+  chain->next = data->chains;
+  data->chains = chain;
+  return chain;
+}
+
+/* Read the FAT entry of CLUSTER.  */
+static grub_err_t
+grub_fat_next_cluster (grub_disk_t disk, struct grub_fat_data *data,
+		       grub_uint32_t cluster, grub_uint32_t *next_cluster)
+{
+  grub_uint32_t fat_offset;
+
+  switch (data->fat_size)
+    {
+    case 32:
+      fat_offset = cluster << 2;
+      break;
+    case 16:
+      fat_offset = cluster << 1;
+      break;
+    default:
+      /* case 12: */
+      fat_offset = cluster + (cluster >> 1);
+      break;
+    }
+
+  /* Read the FAT.  */
+  *next_cluster = 0;
+  if (grub_disk_read (disk, data->fat_sector, fat_offset,
+		      (data->fat_size + 7) >> 3, next_cluster))
+    return grub_errno;
+
+  *next_cluster = grub_le_to_cpu32 (*next_cluster);
+  switch (data->fat_size)
+    {
+    case 16:
+      *next_cluster &= 0xFFFF;
+      break;
+    case 12:
+      if (cluster & 1)
+	*next_cluster >>= 4;
+
+      *next_cluster &= 0x0FFF;
+      break;
+    }
+
+  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
+		data->fat_size, *next_cluster);
+
+  return GRUB_ERR_NONE;
+}
+
+/* Add CLUSTER as the next one of CHAIN, merging it into the last run
+   when it follows on disk.  */
+static grub_err_t
+grub_fat_chain_append (struct grub_fat_chain *chain, grub_uint32_t cluster)
+{
+  struct grub_fat_run *run;
+
+  if (chain->num_runs)
+    {
+      run = &chain->runs[chain->num_runs - 1];
+      if (run->cluster + run->count == cluster)
+	{
+	  run->count++;
+	  chain->num_clusters++;
+	  return GRUB_ERR_NONE;
+	}
+    }
+
+  if (chain->num_runs == chain->alloc_runs)
+    {
+      unsigned alloc = chain->alloc_runs ? chain->alloc_runs * 2 : 8;
+      struct grub_fat_run *runs;
+
+      runs = grub_realloc (chain->runs, alloc * sizeof (*runs));
+      if (! runs)
+	return grub_errno;
+      chain->runs = runs;
+      chain->alloc_runs = alloc;
+    }
+
+  run = &chain->runs[chain->num_runs++];
+  run->logical = chain->num_clusters++;
+  run->cluster = cluster;
+  run->count = 1;
+  return GRUB_ERR_NONE;
+}
+
+/* Return the run of CHAIN holding LOGICAL_CLUSTER, decoding the chain
+   up to it if needed.  Return 0 past the end of the chain or on
+   error.  */
+static const struct grub_fat_run *
+grub_fat_find_run (grub_disk_t disk, struct grub_fat_data *data,
+		   struct grub_fat_chain *chain, grub_uint32_t logical_cluster)
+{
+  unsigned lo, hi;
+
+  if (! chain->num_runs && ! chain->complete)
+    {
+      if (chain->first_cluster < 2
+	  || chain->first_cluster >= data->num_clusters)
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
+		      chain->first_cluster);
+	  return 0;
+	}
+      if (grub_fat_chain_append (chain, chain->first_cluster))
+	return 0;
+    }
+
+  while (logical_cluster >= chain->num_clusters)
+    {
+      const struct grub_fat_run *last;
+      grub_uint32_t next_cluster;
+
+      if (chain->complete)
+	return 0;
+
+      last = &chain->runs[chain->num_runs - 1];
+      if (grub_fat_next_cluster (disk, data, last->cluster + last->count - 1,
+				 &next_cluster))
+	return 0;
+
+      /* Check the end.  */
+      if (next_cluster >= data->cluster_eof_mark)
+	{
+	  chain->complete = 1;
+	  return 0;
+	}
+
+      if (next_cluster < 2 || next_cluster >= data->num_clusters
+	  || chain->num_clusters >= data->num_clusters)
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
+		      next_cluster);
+	  return 0;
+	}
+
+      if (grub_fat_chain_append (chain, next_cluster))
+	return 0;
+    }
+
+  lo = 0;
+  hi = chain->num_runs;
+  while (hi - lo > 1)
+    {
+      unsigned mid = lo + (hi - lo) / 2;
+
+      if (chain->runs[mid].logical <= logical_cluster)
+	lo = mid;
+      else
+	hi = mid;
+    }
+  return &chain->runs[lo];
+}
+
 static grub_ssize_t
 grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data,
@@ -478,14 +715,20 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 #ifdef MODE_EXFAT
   if (node->is_contiguous)
     {
-      /* Read the data here.  */
-      sector = (node->data->cluster_sector
-		+ ((node->file_cluster - 2)
-		   << node->data->cluster_bits));
+      grub_disk_addr_t start;
+
+      if (node->file_cluster < 2)
+	return grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
+			   node->file_cluster);
+
+      /* No FAT chain: the whole request is one extent.  */
+      start = (node->data->cluster_sector
+	       + ((grub_disk_addr_t) (node->file_cluster - 2)
+		  << node->data->cluster_bits));
 
       disk->read_hook = read_hook;
       disk->read_hook_data = read_hook_data;
-      grub_disk_read (disk, sector + (offset >> GRUB_DISK_SECTOR_BITS),
+      grub_disk_read (disk, start + (offset >> GRUB_DISK_SECTOR_BITS),
 		      offset & (GRUB_DISK_SECTOR_SIZE - 1), len, buf);
       disk->read_hook = 0;
       if (grub_errno)
@@ -501,79 +744,31 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
   logical_cluster = offset >> logical_cluster_bits;
   offset &= (1ULL << logical_cluster_bits) - 1;
 
-  if (logical_cluster < node->cur_cluster_num)
+  if (! node->chain)
     {
-      node->cur_cluster_num = 0;
-      node->cur_cluster = node->file_cluster;
+      node->chain = grub_fat_get_chain (node->data, node->file_cluster);
+      if (! node->chain)
+	return -1;
     }
 
   while (len)
     {
-      while (logical_cluster > node->cur_cluster_num)
-	{
-	  /* Find next cluster.  */
-	  grub_uint32_t next_cluster;
-	  grub_uint32_t fat_offset;
-
-	  switch (node->data->fat_size)
-	    {
-	    case 32:
-	      fat_offset = node->cur_cluster << 2;
-	      break;
-	    case 16:
-	      fat_offset = node->cur_cluster << 1;
-	      break;
-	    default:
-	      /* case 12: */
-	      fat_offset = node->cur_cluster + (node->cur_cluster >> 1);
-	      break;
-	    }
-
-	  /* Read the FAT.  */
-	  if (grub_disk_read (disk, node->data->fat_sector, fat_offset,
-			      (node->data->fat_size + 7) >> 3,
-			      (char *) &next_cluster))
-	    return -1;
-
-	  next_cluster = grub_le_to_cpu32 (next_cluster);
-	  switch (node->data->fat_size)
-	    {
-	    case 16:
-	      next_cluster &= 0xFFFF;
-	      break;
-	    case 12:
-	      if (node->cur_cluster & 1)
-		next_cluster >>= 4;
-
-	      next_cluster &= 0x0FFF;
-	      break;
-	    }
+      const struct grub_fat_run *run;
+      grub_uint64_t avail;
 
-	  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
-			node->data->fat_size, next_cluster);
+      run = grub_fat_find_run (disk, node->data, node->chain,
+			       logical_cluster);
+      if (! run)
+	return grub_errno ? -1 : ret;
 
-	  /* Check the end.  */
-	  if (next_cluster >= node->data->cluster_eof_mark)
-	    return ret;
-
-	  if (next_cluster < 2 || next_cluster >= node->data->num_clusters)
-	    {
-	      grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
-			  next_cluster);
-	      return -1;
-	    }
-
-	  node->cur_cluster = next_cluster;
-	  node->cur_cluster_num++;
-	}
-
-      /* Read the data here.  */
+      /* Read as much of the run as is wanted at once.  */
       sector = (node->data->cluster_sector
-		+ ((node->cur_cluster - 2)
+		+ ((grub_disk_addr_t) (run->cluster - 2
+				       + logical_cluster - run->logical)
 		   << node->data->cluster_bits));
-      size = (1 << logical_cluster_bits) - offset;
-      if (size > len)
-	size = len;
+      avail = ((grub_uint64_t) (run->logical + run->count - logical_cluster)
+	       << logical_cluster_bits) - offset;
+      size = avail < len ? avail : len;
 
       disk->read_hook = read_hook;
       disk->read_hook_data = read_hook_data;
@@ -585,8 +780,9 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
       len -= size;
       buf += size;
       ret += size;
-      logical_cluster++;
-      offset = 0;
+      offset += size;
+      logical_cluster += offset >> logical_cluster_bits;
+      offset &= (1ULL << logical_cluster_bits) - 1;
     }
 
   return ret;
@@ -891,6 +1087,7 @@ static grub_err_t lookup_file (grub_fshelp_node_t node,
 	  (*foundnode)->file_size = ctxt.dir.file_size;
 	  (*foundnode)->file_cluster = ctxt.dir.first_cluster;
 	  (*foundnode)->is_contiguous = ctxt.dir.is_contiguous;
+	  (*foundnode)->contiguous_checked = 0;
 #else
 	  (*foundnode)->file_size = grub_le_to_cpu32 (ctxt.dir.file_size);
 	  (*foundnode)->file_cluster = ((grub_le_to_cpu16 (ctxt.dir.first_cluster_high) << 16)
@@ -899,7 +1096,7 @@ static grub_err_t lookup_file (grub_fshelp_node_t node,
 	  if (!(*foundnode)->file_cluster)
 	    (*foundnode)->file_cluster = node->data->root_cluster;
 #endif
-	  (*foundnode)->cur_cluster_num = ~0U;
+	  (*foundnode)->chain = 0;
 	  (*foundnode)->data = node->data;
 	  (*foundnode)->disk = node->disk;
 
@@ -918,6 +1115,28 @@ static grub_err_t lookup_file (grub_fshelp_node_t node,
 
 }
 
+/* Helpers for the fshelp directory cache.  */
+static grub_size_t
+grub_fat_node_size (grub_fshelp_node_t node __attribute__ ((unused)))
+{
+  return sizeof (struct grub_fshelp_node);
+}
+
+static void
+grub_fat_node_rebind (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  node->data = root->data;
+  node->disk = root->disk;
+  /* Cluster chains are cached per mount.  */
+  node->chain = 0;
+}
+
+static const struct grub_fshelp_dcache_ops grub_fat_dcache_ops =
+  {
+    .node_size = grub_fat_node_size,
+    .node_rebind = grub_fat_node_rebind
+  };
+
 static grub_err_t
 grub_fat_dir (grub_device_t device, const char *path, grub_fs_dir_hook_t hook,
 	      void *hook_data)
@@ -940,14 +1159,14 @@ grub_fat_dir (grub_device_t device, const char *path, grub_fs_dir_hook_t hook,
     .attr = GRUB_FAT_ATTR_DIRECTORY,
     .file_size = 0,
     .file_cluster = data->root_cluster,
-    .cur_cluster_num = ~0U,
-    .cur_cluster = 0,
+    .chain = 0,
 #ifdef MODE_EXFAT
     .is_contiguous = 0,
 #endif
   };
 
-  err = grub_fshelp_find_file_lookup (path, &root, &found, lookup_file, NULL, GRUB_FSHELP_DIR);
+  err = grub_fshelp_find_file_cached (path, &root, &found, lookup_file, NULL,
+				      GRUB_FSHELP_DIR, disk, &grub_fat_dcache_ops);
   if (err)
     goto fail;
 
@@ -981,7 +1200,7 @@ grub_fat_dir (grub_device_t device, const char *path, grub_fs_dir_hook_t hook,
   if (found != &root)
     grub_free (found);
 
-  grub_free (data);
+  grub_fat_unmount (data);
 
   grub_dl_unref (my_mod);
 
@@ -1008,14 +1227,14 @@ grub_fat_open (grub_file_t file, const char *name)
     .attr = GRUB_FAT_ATTR_DIRECTORY,
     .file_size = 0,
     .file_cluster = data->root_cluster,
-    .cur_cluster_num = ~0U,
-    .cur_cluster = 0,
+    .chain = 0,
 #ifdef MODE_EXFAT
     .is_contiguous = 0,
 #endif
   };
 
-  err = grub_fshelp_find_file_lookup (name, &root, &found, lookup_file, NULL, GRUB_FSHELP_REG);
+  err = grub_fshelp_find_file_cached (name, &root, &found, lookup_file, NULL,
+				      GRUB_FSHELP_REG, disk, &grub_fat_dcache_ops);
   if (err)
     goto fail;
 
@@ -1029,16 +1248,164 @@ grub_fat_open (grub_file_t file, const char *name)
   if (found != &root)
     grub_free (found);
 
-  grub_free (data);
+  grub_fat_unmount (data);
 
   grub_dl_unref (my_mod);
 
   return grub_errno;
 }
 
+#ifdef MODE_EXFAT
+/* Where the allocation bitmaps of recently mounted volumes are, so that
+   the root directory isn't searched again on every mount.  */
+#define BITMAP_CACHE_SIZE	4
+
+struct grub_fat_bitmap_cache
+{
+  struct grub_fshelp_volume vol;
+  int active_fat;
+  /* 0 if the entry is unused.  */
+  grub_uint32_t cluster;
+  grub_uint64_t size;
+};
+
+static struct grub_fat_bitmap_cache bitmap_cache[BITMAP_CACHE_SIZE];
+static unsigned bitmap_cache_next;
+static struct grub_fshelp_cache_generation bitmap_cache_generation;
+
+/* Find the allocation bitmap of the active FAT in the root directory.  */
+static grub_err_t
+grub_fat_find_bitmap (grub_disk_t disk, struct grub_fat_data *data)
+{
+  struct grub_fat_dir_entry dir;
+  struct grub_fat_bitmap_cache *e;
+  struct grub_fshelp_volume vol;
+  grub_ssize_t offset;
+  unsigned i;
+  struct grub_fshelp_node root = {
+    .data = data,
+    .disk = disk,
+    .attr = GRUB_FAT_ATTR_DIRECTORY,
+    .file_cluster = data->root_cluster,
+  };
+
+  if (grub_fshelp_cache_changed (&bitmap_cache_generation))
+    grub_memset (bitmap_cache, 0, sizeof (bitmap_cache));
+
+  grub_fshelp_volume_init (&vol, disk, 0);
+  for (i = 0; i < BITMAP_CACHE_SIZE; i++)
+    {
+      e = &bitmap_cache[i];
+      if (e->cluster && e->active_fat == data->active_fat
+	  && grub_fshelp_volume_eq (&e->vol, &vol))
+	{
+	  data->bitmap_cluster = e->cluster;
+	  data->bitmap_size = e->size;
+	  data->bitmap_found = 1;
+	  return GRUB_ERR_NONE;
+	}
+    }
+
+  for (offset = 0; ; offset += sizeof (dir))
+    {
+      if (grub_fat_read_data (disk, &root, 0, 0, offset, sizeof (dir),
+			      (char *) &dir) != sizeof (dir))
+	break;
+      if (dir.entry_type == 0)
+	break;
+      if (dir.entry_type != 0x81
+	  || (dir.type_specific.bitmap.flags & 1) != data->active_fat)
+	continue;
+
+      data->bitmap_cluster
+	= grub_le_to_cpu32 (dir.type_specific.bitmap.first_cluster);
+      data->bitmap_size
+	= grub_le_to_cpu64 (dir.type_specific.bitmap.data_length);
+      data->bitmap_found = 1;
+
+      e = &bitmap_cache[bitmap_cache_next++ % BITMAP_CACHE_SIZE];
+      e->vol = vol;
+      e->active_fat = data->active_fat;
+      e->cluster = data->bitmap_cluster;
+      e->size = data->bitmap_size;
+      return GRUB_ERR_NONE;
+    }
+
+  if (grub_errno)
+    return grub_errno;
+  return grub_error (GRUB_ERR_BAD_FS, "no allocation bitmap");
+}
+
+/* A file flagged NoFatChain has no FAT entries to cross-check, so make
+   sure its clusters are at least marked in use in the allocation
+   bitmap before trusting the flag.  */
+static grub_err_t
+grub_fat_check_contiguous (grub_disk_t disk, grub_fshelp_node_t node)
+{
+  struct grub_fat_data *data = node->data;
+  grub_uint64_t first, last, pos, num_clusters;
+  unsigned cluster_bits = data->cluster_bits + GRUB_DISK_SECTOR_BITS;
+  grub_uint8_t buf[512];
+  struct grub_fshelp_node bitmap = {
+    .data = data,
+    .disk = disk,
+  };
+
+  if (! node->file_size)
+    return GRUB_ERR_NONE;
+
+  if (! data->bitmap_found && grub_fat_find_bitmap (disk, data))
+    return grub_errno;
+
+  num_clusters = ((node->file_size + (1ULL << cluster_bits) - 1)
+		  >> cluster_bits);
+  first = (grub_uint64_t) node->file_cluster - 2;
+  last = first + num_clusters - 1;
+  if (node->file_cluster < 2 || (last >> 3) >= data->bitmap_size)
+    return grub_error (GRUB_ERR_BAD_FS, "invalid contiguous file");
+
+  bitmap.file_size = data->bitmap_size;
+  bitmap.file_cluster = data->bitmap_cluster;
+
+  for (pos = first; pos <= last; )
+    {
+      grub_size_t size, i;
+      grub_uint64_t base = pos & ~7ULL;
+
+      size = ((last >> 3) - (base >> 3)) + 1;
+      if (size > sizeof (buf))
+	size = sizeof (buf);
+      if (grub_fat_read_data (disk, &bitmap, 0, 0, base >> 3, size,
+			      (char *) buf) != (grub_ssize_t) size)
+	return grub_errno ? : grub_error (GRUB_ERR_BAD_FS,
+					   "allocation bitmap too short");
+
+      for (i = pos - base; i < size * 8 && base + i <= last; i++)
+	if (! (buf[i >> 3] & (1 << (i & 7))))
+	  return grub_error (GRUB_ERR_BAD_FS,
+			     "cluster %llu of contiguous file not allocated",
+			     (unsigned long long) (base + i + 2));
+      pos = base + size * 8;
+    }
+
+  return GRUB_ERR_NONE;
+}
+#endif
+
 static grub_ssize_t
 grub_fat_read (grub_file_t file, char *buf, grub_size_t len)
 {
+#ifdef MODE_EXFAT
+  grub_fshelp_node_t node = file->data;
+
+  if (node->is_contiguous && ! node->contiguous_checked)
+    {
+      if (grub_fat_check_contiguous (file->device->disk, node))
+	return -1;
+      node->contiguous_checked = 1;
+    }
+#endif
+
   return grub_fat_read_data (file->device->disk, file->data,
 			     file->read_hook, file->read_hook_data,
 			     file->offset, len, buf);
@@ -1049,7 +1416,7 @@ grub_fat_close (grub_file_t file)
 {
   grub_fshelp_node_t node = file->data;
 
-  grub_free (node->data);
+  grub_fat_unmount (node->data);
   grub_free (node);
 
   grub_dl_unref (my_mod);
@@ -1068,8 +1435,7 @@ grub_fat_label (grub_device_t device, char **label)
     .disk = disk,
     .attr = GRUB_FAT_ATTR_DIRECTORY,
     .file_size = 0,
-    .cur_cluster_num = ~0U,
-    .cur_cluster = 0,
+    .chain = 0,
     .is_contiguous = 0,
   };
 
@@ -1105,7 +1471,7 @@ grub_fat_label (grub_device_t device, char **label)
 				* GRUB_MAX_UTF8_PER_UTF16 + 1);
 	  if (!*label)
 	    {
-	      grub_free (root.data);
+	      grub_fat_unmount (root.data);
 	      return grub_errno;
 	    }
 	  chc = dir.type_specific.volume_label.character_count;
@@ -1117,7 +1483,7 @@ grub_fat_label (grub_device_t device, char **label)
 	}
     }
 
-  grub_free (root.data);
+  grub_fat_unmount (root.data);
   return grub_errno;
 }
 
@@ -1133,8 +1499,7 @@ grub_fat_label (grub_device_t device, char **label)
     .disk = disk,
     .attr = GRUB_FAT_ATTR_DIRECTORY,
     .file_size = 0,
-    .cur_cluster_num = ~0U,
-    .cur_cluster = 0,
+    .chain = 0,
   };
 
   *label = 0;
@@ -1164,7 +1529,7 @@ grub_fat_label (grub_device_t device, char **label)
 
   grub_dl_unref (my_mod);
 
-  grub_free (root.data);
+  grub_fat_unmount (root.data);
 
   return grub_errno;
 }
@@ -21,6 +21,7 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/disk.h>
+#include <grub/partition.h>
 #include <grub/fshelp.h>
 #include <grub/dl.h>
 #include <grub/i18n.h>
@@ -40,6 +41,8 @@ struct stack_element {
   struct stack_element *parent;
   grub_fshelp_node_t node;
   enum grub_fshelp_filetype type;
+  /* Directory cache id of the node, or 0.  */
+  grub_uint32_t dcache_id;
 };
 
 /* Context for grub_fshelp_find_file.  */
@@ -48,6 +51,8 @@ struct grub_fshelp_find_file_ctx
   /* Inputs.  */
   const char *path;
   grub_fshelp_node_t rootnode;
+  const struct grub_fshelp_dcache_ops *dcache;
+  grub_uint32_t root_id;
 
   /* Global options. */
   int symlinknest;
@@ -90,7 +95,8 @@ go_up_a_level (struct grub_fshelp_find_file_ctx *ctx)
 }
 
 static grub_err_t
-push_node (struct grub_fshelp_find_file_ctx *ctx, grub_fshelp_node_t node, enum grub_fshelp_filetype filetype)
+push_node (struct grub_fshelp_find_file_ctx *ctx, grub_fshelp_node_t node, enum grub_fshelp_filetype filetype,
+	   grub_uint32_t dcache_id)
 {
   struct stack_element *nst;
   nst = grub_malloc (sizeof (*nst));
@@ -98,6 +104,7 @@ push_node (struct grub_fshelp_find_file_ctx *ctx, grub_fshelp_node_t node, enum
     return grub_errno;
   nst->node = node;
   nst->type = filetype & ~GRUB_FSHELP_CASE_INSENSITIVE;
+  nst->dcache_id = dcache_id;
   nst->parent = ctx->currnode;
   ctx->currnode = nst;
   return GRUB_ERR_NONE;
@@ -107,7 +114,193 @@ static grub_err_t
 go_to_root (struct grub_fshelp_find_file_ctx *ctx)
 {
   free_stack (ctx);
-  return push_node (ctx, ctx->rootnode, GRUB_FSHELP_DIR);
+  return push_node (ctx, ctx->rootnode, GRUB_FSHELP_DIR, ctx->root_id);
+}
+
+void
+grub_fshelp_volume_init (struct grub_fshelp_volume *vol, grub_disk_t disk,
+			 grub_disk_addr_t offset)
+{
+  vol->dev_id = disk->dev->id;
+  vol->disk_id = disk->id;
+  vol->start = grub_partition_get_start (disk->partition) + offset;
+}
+
+int
+grub_fshelp_volume_eq (const struct grub_fshelp_volume *a,
+		       const struct grub_fshelp_volume *b)
+{
+  return (a->dev_id == b->dev_id && a->disk_id == b->disk_id
+	  && a->start == b->start);
+}
+
+int
+grub_fshelp_cache_changed (struct grub_fshelp_cache_generation *gen)
+{
+  if (gen->disk == grub_disk_cache_generation
+      && gen->dev == grub_disk_dev_generation)
+    return 0;
+
+  gen->disk = grub_disk_cache_generation;
+  gen->dev = grub_disk_dev_generation;
+  return 1;
+}
+
+/* Directory entry cache.  Lookups on filesystems that provide
+   grub_fshelp_dcache_ops are kept across mounts.  Like the disk cache,
+   it is direct mapped.  Entries are keyed by the id of their parent entry
+   and their name.  The roots are keyed by volume.  */
+
+#define DCACHE_SIZE	128
+#define DCACHE_VOLUMES	8
+
+struct dcache_volume
+{
+  const struct grub_fshelp_dcache_ops *ops;
+  struct grub_fshelp_volume vol;
+  grub_uint32_t id;
+};
+
+struct dcache_entry
+{
+  /* 0 if the entry is unused.  */
+  grub_uint32_t id;
+  grub_uint32_t parent;
+  enum grub_fshelp_filetype type;
+  char *name;
+  grub_fshelp_node_t node;
+  grub_size_t size;
+};
+
+static struct dcache_volume dcache_volumes[DCACHE_VOLUMES];
+static unsigned dcache_next_volume;
+static struct dcache_entry dcache_table[DCACHE_SIZE];
+static grub_uint32_t dcache_last_id;
+static struct grub_fshelp_cache_generation dcache_generation;
+
+static grub_uint32_t
+dcache_new_id (void)
+{
+  if (++dcache_last_id == 0)
+    dcache_last_id++;
+  return dcache_last_id;
+}
+
+static void
+dcache_free_entry (struct dcache_entry *e)
+{
+  grub_free (e->name);
+  grub_free (e->node);
+  grub_memset (e, 0, sizeof (*e));
+}
+
+static void
+dcache_validate (void)
+{
+  unsigned i;
+
+  if (!grub_fshelp_cache_changed (&dcache_generation))
+    return;
+
+  for (i = 0; i < DCACHE_SIZE; i++)
+    dcache_free_entry (&dcache_table[i]);
+  grub_memset (dcache_volumes, 0, sizeof (dcache_volumes));
+}
+
+/* Return the id standing for the root of the filesystem OPS on DISK.  */
+static grub_uint32_t
+dcache_volume_id (grub_disk_t disk, const struct grub_fshelp_dcache_ops *ops)
+{
+  struct grub_fshelp_volume vol;
+  struct dcache_volume *v;
+  unsigned i;
+
+  grub_fshelp_volume_init (&vol, disk, 0);
+  for (i = 0; i < DCACHE_VOLUMES; i++)
+    {
+      v = &dcache_volumes[i];
+      if (v->id && v->ops == ops && grub_fshelp_volume_eq (&v->vol, &vol))
+	return v->id;
+    }
+
+  /* Entries under a replaced volume are no longer reachable.  */
+  v = &dcache_volumes[dcache_next_volume++ % DCACHE_VOLUMES];
+  v->ops = ops;
+  v->vol = vol;
+  v->id = dcache_new_id ();
+  return v->id;
+}
+
+static struct dcache_entry *
+dcache_slot (grub_uint32_t parent, const char *name)
+{
+  unsigned h = parent;
+
+  while (*name)
+    h = h * 31 + (grub_uint8_t) *name++;
+  return &dcache_table[h % DCACHE_SIZE];
+}
+
+/* Return a copy of the cached node NAME under PARENT, or NULL.  */
+static grub_fshelp_node_t
+dcache_lookup (struct grub_fshelp_find_file_ctx *ctx, grub_uint32_t parent,
+	       const char *name, enum grub_fshelp_filetype *type,
+	       grub_uint32_t *id)
+{
+  struct dcache_entry *e = dcache_slot (parent, name);
+  grub_fshelp_node_t node;
+
+  if (!e->id || e->parent != parent || grub_strcmp (e->name, name) != 0)
+    return NULL;
+
+  node = grub_malloc (e->size);
+  if (!node)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+  grub_memcpy (node, e->node, e->size);
+  ctx->dcache->node_rebind (node, ctx->rootnode);
+  *type = e->type;
+  *id = e->id;
+  return node;
+}
+
+/* Keep a copy of NODE found as NAME under PARENT.  Return its id, or 0
+   if it wasn't stored.  */
+static grub_uint32_t
+dcache_insert (struct grub_fshelp_find_file_ctx *ctx, grub_uint32_t parent,
+	       const char *name, grub_fshelp_node_t node,
+	       enum grub_fshelp_filetype type)
+{
+  struct dcache_entry *e = dcache_slot (parent, name);
+  grub_size_t size;
+  char *name_copy;
+  grub_fshelp_node_t copy;
+
+  size = ctx->dcache->node_size (node);
+  if (!size)
+    return 0;
+
+  name_copy = grub_strdup (name);
+  copy = grub_malloc (size);
+  if (!name_copy || !copy)
+    {
+      grub_free (name_copy);
+      grub_free (copy);
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+  grub_memcpy (copy, node, size);
+
+  dcache_free_entry (e);
+  e->parent = parent;
+  e->type = type;
+  e->name = name_copy;
+  e->node = copy;
+  e->size = size;
+  e->id = dcache_new_id ();
+  return e->id;
 }
 
 struct grub_fshelp_find_file_iter_ctx
@@ -171,6 +364,7 @@ find_file (char *currpath,
       char c;
       grub_fshelp_node_t foundnode = NULL;
       enum grub_fshelp_filetype foundtype = 0;
+      grub_uint32_t dcache_id = 0;
 
       /* Remove all leading slashes.  */
       while (*name == '/')
@@ -202,10 +396,18 @@ find_file (char *currpath,
       /* Iterate over the directory.  */
       c = *next;
       *next = '\0';
-      if (lookup_file)
+      if (ctx->currnode->dcache_id)
+	foundnode = dcache_lookup (ctx, ctx->currnode->dcache_id, name,
+				   &foundtype, &dcache_id);
+      if (foundnode)
+	err = GRUB_ERR_NONE;
+      else if (lookup_file)
 	err = lookup_file (ctx->currnode->node, name, &foundnode, &foundtype);
       else
 	err = directory_find_file (ctx->currnode->node, name, &foundnode, &foundtype, iterate_dir);
+      if (!err && foundnode && !dcache_id && ctx->currnode->dcache_id)
+	dcache_id = dcache_insert (ctx, ctx->currnode->dcache_id, name,
+				   foundnode, foundtype);
       *next = c;
 
       if (err)
@@ -214,7 +416,7 @@ find_file (char *currpath,
       if (!foundnode)
 	break;
 
-      push_node (ctx, foundnode, foundtype);
+      push_node (ctx, foundnode, foundtype, dcache_id);
  
       /* Read in the symlink and follow it.  */
       if (ctx->currnode->type == GRUB_FSHELP_SYMLINK)
@@ -264,11 +466,15 @@ grub_fshelp_find_file_real (const char *path, grub_fshelp_node_t rootnode,
 			    iterate_dir_func iterate_dir,
 			    lookup_file_func lookup_file,
 			    read_symlink_func read_symlink,
-			    enum grub_fshelp_filetype expecttype)
+			    enum grub_fshelp_filetype expecttype,
+			    grub_disk_t disk,
+			    const struct grub_fshelp_dcache_ops *dcache)
 {
   struct grub_fshelp_find_file_ctx ctx = {
     .path = path,
     .rootnode = rootnode,
+    .dcache = dcache,
+    .root_id = 0,
     .symlinknest = 0,
     .currnode = 0
   };
@@ -281,6 +487,12 @@ grub_fshelp_find_file_real (const char *path, grub_fshelp_node_t rootnode,
       return grub_error (GRUB_ERR_BAD_FILENAME, N_("invalid file name `%s'"), path);
     }
 
+  if (dcache)
+    {
+      dcache_validate ();
+      ctx.root_id = dcache_volume_id (disk, dcache);
+    }
+
   err = go_to_root (&ctx);
   if (err)
     return err;
@@ -327,7 +539,7 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 {
   return grub_fshelp_find_file_real (path, rootnode, foundnode,
 				     iterate_dir, NULL, 
-				     read_symlink, expecttype);
+				     read_symlink, expecttype, NULL, NULL);
 
 }
 
@@ -340,8 +552,42 @@ grub_fshelp_find_file_lookup (const char *path, grub_fshelp_node_t rootnode,
 {
   return grub_fshelp_find_file_real (path, rootnode, foundnode,
 				     NULL, lookup_file, 
-				     read_symlink, expecttype);
+				     read_symlink, expecttype, NULL, NULL);
+
+}
 
+/* Like grub_fshelp_find_file_lookup, but keep the nodes found in the
+   directory cache.  DISK is the disk the filesystem is on and DCACHE
+   describes how its nodes are copied.  */
+grub_err_t
+grub_fshelp_find_file_cached (const char *path, grub_fshelp_node_t rootnode,
+			      grub_fshelp_node_t *foundnode,
+			      lookup_file_func lookup_file,
+			      read_symlink_func read_symlink,
+			      enum grub_fshelp_filetype expecttype,
+			      grub_disk_t disk,
+			      const struct grub_fshelp_dcache_ops *dcache)
+{
+  return grub_fshelp_find_file_real (path, rootnode, foundnode,
+				     NULL, lookup_file,
+				     read_symlink, expecttype, disk, dcache);
+}
+
+/* Like grub_fshelp_find_file, but keep the nodes found in the directory
+   cache.  */
+grub_err_t
+grub_fshelp_find_file_iterate_cached (const char *path,
+				      grub_fshelp_node_t rootnode,
+				      grub_fshelp_node_t *foundnode,
+				      iterate_dir_func iterate_dir,
+				      read_symlink_func read_symlink,
+				      enum grub_fshelp_filetype expecttype,
+				      grub_disk_t disk,
+				      const struct grub_fshelp_dcache_ops *dcache)
+{
+  return grub_fshelp_find_file_real (path, rootnode, foundnode,
+				     iterate_dir, NULL,
+				     read_symlink, expecttype, disk, dcache);
 }
 
 /* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
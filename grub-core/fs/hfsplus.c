@@ -138,70 +138,268 @@ grub_hfsplus_find_block (struct grub_hfsplus_extent *extent,
 static int grub_hfsplus_cmp_extkey (struct grub_hfsplus_key *keya,
 				    struct grub_hfsplus_key_internal *keyb);
 
+/* B-tree nodes and the extents of fragmented forks are kept across
+   mounts.  Both caches are direct mapped and keyed by the volume they
+   belong to.  */
+#define NODE_CACHE_SIZE		64
+#define EXTENT_CACHE_SIZE	16
+
+struct node_cache_entry
+{
+  struct grub_fshelp_volume vol;
+  grub_uint32_t fileid;
+  grub_uint64_t nodenum;
+  grub_size_t nodesize;
+  /* NULL if the entry is unused.  */
+  char *buf;
+};
+
+/* An extent of a fork, with the file block it starts at.  */
+struct extent_run
+{
+  grub_uint32_t fileblock;
+  grub_uint32_t start;
+  grub_uint32_t count;
+};
+
+/* The extents of a fork found in the extent overflow file.  */
+struct extent_cache_entry
+{
+  struct grub_fshelp_volume vol;
+  grub_uint32_t fileid;
+  grub_uint8_t type;
+  /* The file block the first record starts at.  */
+  grub_uint32_t first;
+  grub_size_t count, alloc;
+  /* NULL if the entry is unused.  */
+  struct extent_run *runs;
+};
+
+static struct node_cache_entry node_cache[NODE_CACHE_SIZE];
+static struct extent_cache_entry extent_cache[EXTENT_CACHE_SIZE];
+static struct grub_fshelp_cache_generation cache_generation;
+
+static void
+cache_flush (void)
+{
+  unsigned i;
+
+  for (i = 0; i < NODE_CACHE_SIZE; i++)
+    grub_free (node_cache[i].buf);
+  grub_memset (node_cache, 0, sizeof (node_cache));
+  for (i = 0; i < EXTENT_CACHE_SIZE; i++)
+    grub_free (extent_cache[i].runs);
+  grub_memset (extent_cache, 0, sizeof (extent_cache));
+}
+
+static void
+cache_validate (void)
+{
+  if (grub_fshelp_cache_changed (&cache_generation))
+    cache_flush ();
+}
+
+/* Read the node NODENUM of BTREE into BUF.  Return what
+   grub_hfsplus_read_file does.  */
+static grub_ssize_t
+grub_hfsplus_btree_read_node (struct grub_hfsplus_btree *btree,
+			      grub_uint64_t nodenum, char *buf)
+{
+  struct grub_fshelp_volume vol;
+  struct node_cache_entry *e;
+  grub_ssize_t ret;
+
+  cache_validate ();
+  grub_fshelp_volume_init (&vol, btree->file.data->disk,
+			   btree->file.data->embedded_offset);
+  e = &node_cache[(btree->file.fileid * 31 + nodenum) % NODE_CACHE_SIZE];
+  if (e->buf && e->fileid == btree->file.fileid && e->nodenum == nodenum
+      && e->nodesize == btree->nodesize
+      && grub_fshelp_volume_eq (&e->vol, &vol))
+    {
+      grub_memcpy (buf, e->buf, btree->nodesize);
+      return btree->nodesize;
+    }
+
+  ret = grub_hfsplus_read_file (&btree->file, 0, 0,
+				nodenum * btree->nodesize,
+				btree->nodesize, buf);
+  if (ret != (grub_ssize_t) btree->nodesize)
+    return ret;
+
+  if (e->buf && e->nodesize != btree->nodesize)
+    {
+      grub_free (e->buf);
+      e->buf = 0;
+    }
+  if (!e->buf)
+    e->buf = grub_malloc (btree->nodesize);
+  if (!e->buf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return ret;
+    }
+  grub_memcpy (e->buf, buf, btree->nodesize);
+  e->vol = vol;
+  e->fileid = btree->file.fileid;
+  e->nodenum = nodenum;
+  e->nodesize = btree->nodesize;
+  return ret;
+}
+
+static int
+grub_hfsplus_btree_iterate_node (struct grub_hfsplus_btree *btree,
+				 struct grub_hfsplus_btnode *first_node,
+				 grub_disk_addr_t first_rec,
+				 int (*hook) (void *record, void *hook_arg),
+				 void *hook_arg);
+
+/* Helper for extent_cache_get.  Append the extents of the record if it
+   continues the fork.  */
+static int
+extent_cache_add (void *record, void *hook_arg)
+{
+  struct extent_cache_entry *e = hook_arg;
+  struct grub_hfsplus_extkey *key = record;
+  struct grub_hfsplus_extent *extents = (struct grub_hfsplus_extent *) (key + 1);
+  grub_uint32_t next = e->first;
+  int i;
+
+  if (e->count)
+    next = e->runs[e->count - 1].fileblock + e->runs[e->count - 1].count;
+
+  if (grub_be_to_cpu32 (key->fileid) != e->fileid || key->type != e->type
+      || grub_be_to_cpu32 (key->start) != next)
+    return 1;
+
+  for (i = 0; i < 8; i++)
+    {
+      grub_uint32_t count = grub_be_to_cpu32 (extents[i].count);
+
+      if (!count)
+	return 1;
+
+      if (e->count == e->alloc)
+	{
+	  struct extent_run *runs;
+	  grub_size_t alloc = e->alloc ? e->alloc * 2 : 16;
+
+	  runs = grub_realloc (e->runs, alloc * sizeof (runs[0]));
+	  if (!runs)
+	    return 1;
+	  e->runs = runs;
+	  e->alloc = alloc;
+	}
+
+      e->runs[e->count].fileblock = next;
+      e->runs[e->count].start = grub_be_to_cpu32 (extents[i].start);
+      e->runs[e->count].count = count;
+      e->count++;
+      next += count;
+    }
+
+  return 0;
+}
+
+/* Return the extents of the fork TYPE of NODE found in the extent
+   overflow file, the first one starting at the file block FIRST.  */
+static struct extent_cache_entry *
+extent_cache_get (grub_fshelp_node_t node, grub_uint8_t type,
+		  grub_uint32_t first)
+{
+  struct grub_hfsplus_btree *tree = &node->data->extoverflow_tree;
+  struct grub_hfsplus_key_internal key;
+  struct grub_hfsplus_btnode *bnode = 0;
+  struct extent_cache_entry *e;
+  struct grub_fshelp_volume vol;
+  grub_off_t ptr;
+
+  cache_validate ();
+  grub_fshelp_volume_init (&vol, node->data->disk,
+			   node->data->embedded_offset);
+  e = &extent_cache[(node->fileid * 2 + !!type) % EXTENT_CACHE_SIZE];
+  if (e->runs && e->fileid == node->fileid && e->type == type
+      && e->first == first && grub_fshelp_volume_eq (&e->vol, &vol))
+    return e;
+
+  grub_free (e->runs);
+  grub_memset (e, 0, sizeof (*e));
+
+  key.extkey.fileid = node->fileid;
+  key.extkey.type = type;
+  key.extkey.start = first;
+  if (grub_hfsplus_btree_search (tree, &key, grub_hfsplus_cmp_extkey,
+				 &bnode, &ptr) || !bnode)
+    return NULL;
+
+  e->fileid = node->fileid;
+  e->type = type;
+  e->first = first;
+  grub_hfsplus_btree_iterate_node (tree, bnode, ptr, extent_cache_add, e);
+  grub_free (bnode);
+
+  if (grub_errno || !e->count)
+    {
+      grub_free (e->runs);
+      grub_memset (e, 0, sizeof (*e));
+      return NULL;
+    }
+  e->vol = vol;
+  return e;
+}
+
 /* Search for the block FILEBLOCK inside the file NODE.  Return the
    blocknumber of this block on disk.  */
 static grub_disk_addr_t
 grub_hfsplus_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 {
-  struct grub_hfsplus_btnode *nnode = 0;
   grub_disk_addr_t blksleft = fileblock;
   struct grub_hfsplus_extent *extents = node->compressed 
     ? &node->resource_extents[0] : &node->extents[0];
+  struct extent_cache_entry *e;
+  grub_disk_addr_t blk;
+
+  /* Try to find this block in the extents stored with the file.  */
+  blk = grub_hfsplus_find_block (extents, &blksleft);
+  if (blk != 0xffffffffffffffffULL)
+    return blk;
+
+  /* For the extent overflow file, extra extents can't be found in
+     the extent overflow file.  If this happens, you found a
+     bug...  */
+  if (node->fileid == GRUB_HFSPLUS_FILEID_OVERFLOW)
+    {
+      grub_error (GRUB_ERR_READ_ERROR,
+		  "extra extents found in an extend overflow file");
+      return -1;
+    }
 
-  while (1)
+  /* The rest of the fork is described in the extent overflow file.  */
+  e = extent_cache_get (node, node->compressed ? 0xff : 0,
+			fileblock - blksleft);
+  if (e)
     {
-      struct grub_hfsplus_extkey *key;
-      struct grub_hfsplus_key_internal extoverflow;
-      grub_disk_addr_t blk;
-      grub_off_t ptr;
-
-      /* Try to find this block in the current set of extents.  */
-      blk = grub_hfsplus_find_block (extents, &blksleft);
-
-      /* The previous iteration of this loop allocated memory.  The
-	 code above used this memory, it can be freed now.  */
-      grub_free (nnode);
-      nnode = 0;
-
-      if (blk != 0xffffffffffffffffULL)
-	return blk;
-
-      /* For the extent overflow file, extra extents can't be found in
-	 the extent overflow file.  If this happens, you found a
-	 bug...  */
-      if (node->fileid == GRUB_HFSPLUS_FILEID_OVERFLOW)
-	{
-	  grub_error (GRUB_ERR_READ_ERROR,
-		      "extra extents found in an extend overflow file");
-	  break;
-	}
+      grub_size_t lo = 0, hi = e->count;
 
-      /* Set up the key to look for in the extent overflow file.  */
-      extoverflow.extkey.fileid = node->fileid;
-      extoverflow.extkey.type = 0;
-      extoverflow.extkey.start = fileblock - blksleft;
-      extoverflow.extkey.type = node->compressed ? 0xff : 0;
-      if (grub_hfsplus_btree_search (&node->data->extoverflow_tree,
-				     &extoverflow,
-				     grub_hfsplus_cmp_extkey, &nnode, &ptr)
-	  || !nnode)
+      /* Find the last extent starting at or before FILEBLOCK.  */
+      while (lo < hi)
 	{
-	  grub_error (GRUB_ERR_READ_ERROR,
-		      "no block found for the file id 0x%x and the block offset 0x%x",
-		      node->fileid, fileblock);
-	  break;
-	}
+	  grub_size_t mid = lo + (hi - lo) / 2;
 
-      /* The extent overflow file has 8 extents right after the key.  */
-      key = (struct grub_hfsplus_extkey *)
-	grub_hfsplus_btree_recptr (&node->data->extoverflow_tree, nnode, ptr);
-      extents = (struct grub_hfsplus_extent *) (key + 1);
-
-      /* The block wasn't found.  Perhaps the next iteration will find
-	 it.  The last block we found is stored in BLKSLEFT now.  */
+	  if (e->runs[mid].fileblock <= fileblock)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      if (lo && fileblock - e->runs[lo - 1].fileblock < e->runs[lo - 1].count)
+	return (e->runs[lo - 1].start
+		+ (fileblock - e->runs[lo - 1].fileblock));
     }
 
-  grub_free (nnode);
+  if (!grub_errno)
+    grub_error (GRUB_ERR_READ_ERROR,
+		"no block found for the file id 0x%x and the block offset 0x%llx",
+		node->fileid, (unsigned long long) fileblock);
 
   /* Too bad, you lose.  */
   return -1;
@@ -525,11 +723,9 @@ grub_hfsplus_btree_iterate_node (struct grub_hfsplus_btree *btree,
 	saved_node = first_node->next;
       node_count++;
 
-      if (grub_hfsplus_read_file (&btree->file, 0, 0,
-				  (((grub_disk_addr_t)
-				    grub_be_to_cpu32 (first_node->next))
-				   * btree->nodesize),
-				  btree->nodesize, cnode) <= 0)
+      if (grub_hfsplus_btree_read_node (btree,
+					grub_be_to_cpu32 (first_node->next),
+					cnode) <= 0)
 	return 1;
 
       /* Don't skip any record in the next iteration.  */
@@ -584,10 +780,7 @@ grub_hfsplus_btree_search (struct grub_hfsplus_btree *btree,
       node_count++;
 
       /* Read a node.  */
-      if (grub_hfsplus_read_file (&btree->file, 0, 0,
-				  (grub_disk_addr_t) currnode
-				  * (grub_disk_addr_t) btree->nodesize,
-				  btree->nodesize, (char *) node) <= 0)
+      if (grub_hfsplus_btree_read_node (btree, currnode, node) <= 0)
 	{
 	  grub_free (node);
 	  return grub_error (GRUB_ERR_BAD_FS, "couldn't read i-node");
@@ -1101,4 +1294,5 @@ GRUB_MOD_INIT(hfsplus)
 GRUB_MOD_FINI(hfsplus)
 {
   grub_fs_unregister (&grub_hfsplus_fs);
+  cache_flush ();
 }
@@ -838,6 +838,370 @@ grub_iso9660_iterate_dir (grub_fshelp_node_t dir,
 
 
 
+/* Decoded directories.  Looking a name up means parsing the SUSP entries
+   of every record before it, so each directory is decoded once into an
+   index sorted by case-folded name.  The indexes are kept across
+   mounts.  */
+#define DIR_INDEX_NUM	8
+
+struct dir_index_entry
+{
+  char *name;
+  enum grub_fshelp_filetype type;
+  /* A copy of the node, trimmed to the records and symlink it uses.  */
+  struct grub_fshelp_node *node;
+  grub_size_t node_size;
+};
+
+struct dir_index
+{
+  struct grub_fshelp_volume vol;
+  int joliet;
+  grub_uint32_t extent;
+  grub_off_t size;
+  /* In directory order.  */
+  struct dir_index_entry *entries;
+  grub_size_t count, alloc;
+  /* Entries sorted by case-folded name, NULL if the index is unused.  */
+  grub_size_t *sorted;
+  /* Number of walks in progress and whether to drop it once done.  */
+  int busy;
+  int stale;
+};
+
+static struct dir_index dir_indexes[DIR_INDEX_NUM];
+static unsigned dir_index_next;
+static struct grub_fshelp_cache_generation dir_index_generation;
+
+static void
+dir_index_free (struct dir_index *idx)
+{
+  grub_size_t i;
+
+  for (i = 0; i < idx->count; i++)
+    {
+      grub_free (idx->entries[i].name);
+      grub_free (idx->entries[i].node);
+    }
+  grub_free (idx->entries);
+  grub_free (idx->sorted);
+  grub_memset (idx, 0, sizeof (*idx));
+}
+
+static void
+dir_index_validate (void)
+{
+  unsigned i;
+
+  if (!grub_fshelp_cache_changed (&dir_index_generation))
+    return;
+
+  for (i = 0; i < DIR_INDEX_NUM; i++)
+    if (dir_indexes[i].busy)
+      dir_indexes[i].stale = 1;
+    else
+      dir_index_free (&dir_indexes[i]);
+}
+
+/* The symlink target is stored right after the last record.  */
+static grub_size_t
+node_used_size (grub_fshelp_node_t node)
+{
+  char *end = (node->symlink
+	       + node->have_dirents * sizeof (node->dirents[0])
+	       - sizeof (node->dirents));
+
+  if (node->have_symlink)
+    end += grub_strlen (end) + 1;
+  return end - (char *) node;
+}
+
+/* Helper for dir_index_get.  */
+static int
+dir_index_add (const char *filename, enum grub_fshelp_filetype type,
+	       grub_fshelp_node_t node, void *data)
+{
+  struct dir_index *idx = data;
+  struct dir_index_entry *e;
+  grub_size_t size = node_used_size (node);
+
+  if (idx->count == idx->alloc)
+    {
+      grub_size_t alloc = idx->alloc ? idx->alloc * 2 : 32;
+
+      e = grub_realloc (idx->entries, alloc * sizeof (*e));
+      if (!e)
+	goto fail;
+      idx->entries = e;
+      idx->alloc = alloc;
+    }
+
+  e = &idx->entries[idx->count];
+  e->name = grub_strdup (filename);
+  e->node = grub_malloc (size);
+  if (!e->name || !e->node)
+    {
+      grub_free (e->name);
+      grub_free (e->node);
+      goto fail;
+    }
+  grub_memcpy (e->node, node, size);
+  e->node->data = NULL;
+  if (e->node->have_dirents > ARRAY_SIZE (e->node->dirents))
+    e->node->alloc_dirents = e->node->have_dirents;
+  else
+    e->node->alloc_dirents = ARRAY_SIZE (e->node->dirents);
+  e->node_size = size;
+  e->type = type;
+  idx->count++;
+
+  grub_free (node);
+  return 0;
+
+ fail:
+  grub_free (node);
+  return 1;
+}
+
+static int
+dir_index_cmp (const struct dir_index *idx, grub_size_t a, grub_size_t b)
+{
+  return grub_strcasecmp (idx->entries[a].name, idx->entries[b].name);
+}
+
+/* Stable bottom-up merge sort, so that equal names keep the directory
+   order and the first match wins as with a linear scan.  */
+static void
+dir_index_sort (struct dir_index *idx, grub_size_t *tmp)
+{
+  grub_size_t *from = idx->sorted, *to = tmp, *t;
+  grub_size_t n = idx->count, width, i;
+
+  for (i = 0; i < n; i++)
+    from[i] = i;
+
+  for (width = 1; width < n; width *= 2)
+    {
+      for (i = 0; i < n; i += 2 * width)
+	{
+	  grub_size_t l = i, k = i;
+	  grub_size_t mid = (i + width < n) ? i + width : n;
+	  grub_size_t end = (i + 2 * width < n) ? i + 2 * width : n;
+	  grub_size_t r = mid;
+
+	  while (l < mid && r < end)
+	    to[k++] = (dir_index_cmp (idx, from[r], from[l]) < 0
+		       ? from[r++] : from[l++]);
+	  while (l < mid)
+	    to[k++] = from[l++];
+	  while (r < end)
+	    to[k++] = from[r++];
+	}
+      t = from;
+      from = to;
+      to = t;
+    }
+
+  if (from != idx->sorted)
+    grub_memcpy (idx->sorted, from, n * sizeof (idx->sorted[0]));
+}
+
+/* Return the index of directory DIR, decoding it if needed.  Return NULL
+   with grub_errno set if the directory couldn't be read, or with
+   grub_errno clear if it should be walked without an index.  */
+static struct dir_index *
+dir_index_get (grub_fshelp_node_t dir)
+{
+  struct grub_fshelp_volume vol;
+  grub_uint32_t extent = grub_le_to_cpu32 (dir->dirents[0].first_sector);
+  grub_off_t size = get_node_size (dir);
+  struct dir_index *idx;
+  grub_size_t *tmp;
+  unsigned i;
+
+  dir_index_validate ();
+  grub_fshelp_volume_init (&vol, dir->data->disk, 0);
+
+  for (i = 0; i < DIR_INDEX_NUM; i++)
+    {
+      idx = &dir_indexes[i];
+      if (idx->sorted && !idx->stale && idx->extent == extent
+	  && idx->size == size && idx->joliet == dir->data->joliet
+	  && grub_fshelp_volume_eq (&idx->vol, &vol))
+	return idx;
+    }
+
+  for (i = 0; i < DIR_INDEX_NUM; i++)
+    {
+      idx = &dir_indexes[dir_index_next++ % DIR_INDEX_NUM];
+      if (!idx->busy)
+	break;
+    }
+  if (idx->busy)
+    return NULL;
+  dir_index_free (idx);
+
+  if (grub_iso9660_iterate_dir (dir, dir_index_add, idx) || grub_errno)
+    goto fail;
+
+  idx->sorted = grub_malloc ((idx->count + 1) * sizeof (idx->sorted[0]));
+  tmp = grub_malloc ((idx->count + 1) * sizeof (tmp[0]));
+  if (!idx->sorted || !tmp)
+    {
+      grub_free (tmp);
+      goto fail;
+    }
+  dir_index_sort (idx, tmp);
+  grub_free (tmp);
+
+  idx->vol = vol;
+  idx->joliet = dir->data->joliet;
+  idx->extent = extent;
+  idx->size = size;
+  return idx;
+
+ fail:
+  dir_index_free (idx);
+  if (grub_errno == GRUB_ERR_OUT_OF_MEMORY)
+    grub_errno = GRUB_ERR_NONE;
+  return NULL;
+}
+
+/* Return a copy of the indexed node E belonging to the mount DATA.  */
+static grub_fshelp_node_t
+dir_index_node (const struct dir_index_entry *e,
+		struct grub_iso9660_data *data)
+{
+  grub_fshelp_node_t node;
+
+  node = grub_malloc (e->node_size < sizeof (*node)
+		      ? sizeof (*node) : e->node_size);
+  if (!node)
+    return NULL;
+  grub_memcpy (node, e->node, e->node_size);
+  node->data = data;
+  return node;
+}
+
+/* Like grub_iso9660_iterate_dir, but from the index of DIR.  */
+static int
+grub_iso9660_iterate_index (grub_fshelp_node_t dir,
+			    grub_fshelp_iterate_dir_hook_t hook,
+			    void *hook_data)
+{
+  struct dir_index *idx;
+  grub_size_t i;
+  int ret = 0;
+
+  idx = dir_index_get (dir);
+  if (!idx)
+    return grub_errno ? 0 : grub_iso9660_iterate_dir (dir, hook, hook_data);
+
+  /* The hook may look other directories up, keep this one meanwhile.  */
+  idx->busy++;
+  for (i = 0; i < idx->count; i++)
+    {
+      grub_fshelp_node_t node = dir_index_node (&idx->entries[i], dir->data);
+
+      if (!node)
+	break;
+      if (hook (idx->entries[i].name, idx->entries[i].type, node, hook_data))
+	{
+	  ret = 1;
+	  break;
+	}
+    }
+  if (--idx->busy == 0 && idx->stale)
+    dir_index_free (idx);
+
+  return ret;
+}
+
+/* Context for the fallback of grub_iso9660_lookup_file.  */
+struct grub_iso9660_lookup_ctx
+{
+  const char *name;
+  grub_fshelp_node_t *foundnode;
+  enum grub_fshelp_filetype *foundtype;
+};
+
+/* Helper for grub_iso9660_lookup_file.  */
+static int
+grub_iso9660_lookup_iter (const char *filename,
+			  enum grub_fshelp_filetype filetype,
+			  grub_fshelp_node_t node, void *data)
+{
+  struct grub_iso9660_lookup_ctx *ctx = data;
+
+  if (filetype == GRUB_FSHELP_UNKNOWN
+      || ((filetype & GRUB_FSHELP_CASE_INSENSITIVE)
+	  ? grub_strcasecmp (ctx->name, filename)
+	  : grub_strcmp (ctx->name, filename)))
+    {
+      grub_free (node);
+      return 0;
+    }
+
+  *ctx->foundnode = node;
+  *ctx->foundtype = filetype;
+  return 1;
+}
+
+static grub_err_t
+grub_iso9660_lookup_file (grub_fshelp_node_t dir, const char *name,
+			  grub_fshelp_node_t *foundnode,
+			  enum grub_fshelp_filetype *foundtype)
+{
+  struct dir_index *idx;
+  grub_size_t lo, hi;
+
+  *foundnode = NULL;
+
+  idx = dir_index_get (dir);
+  if (!idx)
+    {
+      struct grub_iso9660_lookup_ctx ctx = { name, foundnode, foundtype };
+
+      if (grub_errno)
+	return grub_errno;
+      grub_iso9660_iterate_dir (dir, grub_iso9660_lookup_iter, &ctx);
+      return *foundnode ? GRUB_ERR_NONE : grub_errno;
+    }
+
+  /* Find the first name equal to NAME when case-folded.  */
+  lo = 0;
+  hi = idx->count;
+  while (lo < hi)
+    {
+      grub_size_t mid = lo + (hi - lo) / 2;
+
+      if (grub_strcasecmp (idx->entries[idx->sorted[mid]].name, name) < 0)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  for (; lo < idx->count; lo++)
+    {
+      struct dir_index_entry *e = &idx->entries[idx->sorted[lo]];
+
+      if (grub_strcasecmp (e->name, name) != 0)
+	break;
+      if (e->type == GRUB_FSHELP_UNKNOWN
+	  || (!(e->type & GRUB_FSHELP_CASE_INSENSITIVE)
+	      && grub_strcmp (e->name, name) != 0))
+	continue;
+
+      *foundnode = dir_index_node (e, dir->data);
+      if (!*foundnode)
+	return grub_errno;
+      *foundtype = e->type;
+      break;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
 /* Context for grub_iso9660_dir.  */
 struct grub_iso9660_dir_ctx
 {
@@ -884,15 +1248,15 @@ grub_iso9660_dir (grub_device_t device, const char *path,
   rootnode.dirents[0] = data->voldesc.rootdir;
 
   /* Use the fshelp function to traverse the path.  */
-  if (grub_fshelp_find_file (path, &rootnode,
-			     &foundnode,
-			     grub_iso9660_iterate_dir,
-			     grub_iso9660_read_symlink,
-			     GRUB_FSHELP_DIR))
+  if (grub_fshelp_find_file_lookup (path, &rootnode,
+				    &foundnode,
+				    grub_iso9660_lookup_file,
+				    grub_iso9660_read_symlink,
+				    GRUB_FSHELP_DIR))
     goto fail;
 
   /* List the files in the directory.  */
-  grub_iso9660_iterate_dir (foundnode, grub_iso9660_dir_iter, &ctx);
+  grub_iso9660_iterate_index (foundnode, grub_iso9660_dir_iter, &ctx);
 
   if (foundnode != &rootnode)
     grub_free (foundnode);
@@ -927,11 +1291,11 @@ grub_iso9660_open (struct grub_file *file, const char *name)
   rootnode.dirents[0] = data->voldesc.rootdir;
 
   /* Use the fshelp function to traverse the path.  */
-  if (grub_fshelp_find_file (name, &rootnode,
-			     &foundnode,
-			     grub_iso9660_iterate_dir,
-			     grub_iso9660_read_symlink,
-			     GRUB_FSHELP_REG))
+  if (grub_fshelp_find_file_lookup (name, &rootnode,
+				    &foundnode,
+				    grub_iso9660_lookup_file,
+				    grub_iso9660_read_symlink,
+				    GRUB_FSHELP_REG))
     goto fail;
 
   data->node = foundnode;
@@ -1121,5 +1485,9 @@ GRUB_MOD_INIT(iso9660)
 
 GRUB_MOD_FINI(iso9660)
 {
+  unsigned i;
+
   grub_fs_unregister (&grub_iso9660_fs);
+  for (i = 0; i < DIR_INDEX_NUM; i++)
+    dir_index_free (&dir_indexes[i]);
 }
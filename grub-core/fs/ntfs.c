@@ -108,6 +108,9 @@ init_attr (struct grub_ntfs_attr *at, struct grub_ntfs_file *mft)
   at->flags = (mft == &mft->data->mmft) ? GRUB_NTFS_AF_MMFT : 0;
   at->attr_nxt = mft->buf + u16at (mft->buf, 0x14);
   at->attr_end = at->emft_buf = at->edat_buf = at->sbuf = NULL;
+  at->runs_attr = NULL;
+  at->runs = NULL;
+  at->num_runs = 0;
 }
 
 static void
@@ -116,6 +119,7 @@ free_attr (struct grub_ntfs_attr *at)
   grub_free (at->emft_buf);
   grub_free (at->edat_buf);
   grub_free (at->sbuf);
+  grub_free (at->runs);
 }
 
 static grub_uint8_t *
@@ -362,6 +366,113 @@ grub_ntfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t block)
 					 ctx->curr_vcn + ctx->curr_lcn);
 }
 
+/* Decode the whole run list of the non-resident attribute PA into AT.  */
+static grub_err_t
+cache_runs (struct grub_ntfs_attr *at, grub_uint8_t *pa)
+{
+  grub_uint8_t *run, *end;
+  grub_uint64_t vcn;
+  grub_disk_addr_t lcn;
+  grub_size_t n;
+
+  grub_free (at->runs);
+  at->runs = NULL;
+  at->runs_attr = NULL;
+  at->num_runs = 0;
+
+  end = pa + u16at (pa, 4);
+  n = 0;
+  for (run = pa + u16at (pa, 0x20); run < end && (*run & 0x7);
+       run += 1 + (*run & 0x7) + ((*run >> 4) & 0x7))
+    n++;
+  if (run > end)
+    return grub_error (GRUB_ERR_BAD_FS, "run list overflown");
+
+  at->runs = grub_malloc ((n ? n : 1) * sizeof (at->runs[0]));
+  if (!at->runs)
+    return grub_errno;
+
+  vcn = u64at (pa, 0x10);
+  lcn = 0;
+  for (run = pa + u16at (pa, 0x20); at->num_runs < n; at->num_runs++)
+    {
+      struct grub_ntfs_run *r = &at->runs[at->num_runs];
+      grub_uint8_t c1, c2;
+      grub_disk_addr_t val;
+
+      c1 = (*run) & 0x7;
+      c2 = ((*run) >> 4) & 0x7;
+      run++;
+      r->vcn = vcn;
+      r->count = read_run_data (run, c1, 0);
+      run += c1;
+      val = read_run_data (run, c2, 1);
+      run += c2;
+      lcn += val;
+      r->lcn = val ? lcn : 0;
+      vcn += r->count;
+    }
+
+  at->runs_attr = pa;
+  return GRUB_ERR_NONE;
+}
+
+/* Read from the non-resident attribute PA, one extent at a time.  */
+static grub_err_t
+read_runs (struct grub_ntfs_attr *at, grub_uint8_t *pa, grub_uint8_t *dest,
+	   grub_disk_addr_t ofs, grub_size_t len,
+	   grub_disk_read_hook_t read_hook, void *read_hook_data)
+{
+  struct grub_ntfs_data *data = at->mft->data;
+  int shift = data->log_spc + GRUB_NTFS_BLK_SHR;
+
+  if (at->runs_attr != pa && cache_runs (at, pa))
+    return grub_errno;
+
+  while (len > 0)
+    {
+      grub_uint64_t vcn = ofs >> shift;
+      grub_size_t lo = 0, hi = at->num_runs, n;
+      struct grub_ntfs_run *r;
+
+      while (lo < hi)
+	{
+	  grub_size_t mid = (lo + hi) / 2;
+
+	  if (at->runs[mid].vcn + at->runs[mid].count <= vcn)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      if (lo == at->num_runs || at->runs[lo].vcn > vcn)
+	return grub_error (GRUB_ERR_BAD_FS, "run list overflown");
+      r = &at->runs[lo];
+
+      n = ((r->vcn + r->count) << shift) - ofs;
+      if (n > len)
+	n = len;
+
+      if (r->lcn == 0)
+	grub_memset (dest, 0, n);
+      else
+	{
+	  data->disk->read_hook = read_hook;
+	  data->disk->read_hook_data = read_hook_data;
+	  grub_disk_read (data->disk, (r->lcn + vcn - r->vcn) << data->log_spc,
+			  ofs & ((1ULL << shift) - 1), n, dest);
+	  data->disk->read_hook = 0;
+	  if (grub_errno)
+	    return grub_errno;
+	}
+
+      dest += n;
+      ofs += n;
+      len -= n;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 read_data (struct grub_ntfs_attr *at, grub_uint8_t *pa, grub_uint8_t *dest,
 	   grub_disk_addr_t ofs, grub_size_t len, int cached,
@@ -405,6 +516,11 @@ read_data (struct grub_ntfs_attr *at, grub_uint8_t *pa, grub_uint8_t *dest,
 		      "ntfscomp");
     }
 
+  /* Records found through an attribute list live in a shared buffer, so
+     only the runs of base records are kept.  */
+  if (!(at->flags & (GRUB_NTFS_AF_ALST | GRUB_NTFS_AF_GPOS)))
+    return read_runs (at, pa, dest, ofs, len, read_hook, read_hook_data);
+
   ctx->target_vcn = ofs >> (GRUB_NTFS_BLK_SHR + ctx->comp.log_spc);
   while (ctx->next_vcn <= ctx->target_vcn)
     {
@@ -571,6 +687,32 @@ get_utf8 (grub_uint8_t *in, grub_size_t len)
   return (char *) buf;
 }
 
+/* Create the node for the index entry at POS and store its type.  */
+static struct grub_ntfs_file *
+make_file_node (struct grub_ntfs_file *diro, grub_uint8_t *pos,
+		enum grub_fshelp_filetype *type)
+{
+  struct grub_ntfs_file *fdiro;
+  grub_uint32_t attr;
+
+  attr = u32at (pos, 0x48);
+  if (attr & GRUB_NTFS_ATTR_REPARSE)
+    *type = GRUB_FSHELP_SYMLINK;
+  else if (attr & GRUB_NTFS_ATTR_DIRECTORY)
+    *type = GRUB_FSHELP_DIR;
+  else
+    *type = GRUB_FSHELP_REG;
+
+  fdiro = grub_zalloc (sizeof (struct grub_ntfs_file));
+  if (!fdiro)
+    return NULL;
+
+  fdiro->data = diro->data;
+  fdiro->ino = u64at (pos, 0) & 0xffffffffffffULL;
+  fdiro->mtime = u64at (pos, 0x20);
+  return fdiro;
+}
+
 static int
 list_file (struct grub_ntfs_file *diro, grub_uint8_t *pos,
 	   grub_fshelp_iterate_dir_hook_t hook, void *hook_data)
@@ -598,24 +740,11 @@ list_file (struct grub_ntfs_file *diro, grub_uint8_t *pos,
 	{
 	  enum grub_fshelp_filetype type;
 	  struct grub_ntfs_file *fdiro;
-	  grub_uint32_t attr;
-
-	  attr = u32at (pos, 0x48);
-	  if (attr & GRUB_NTFS_ATTR_REPARSE)
-	    type = GRUB_FSHELP_SYMLINK;
-	  else if (attr & GRUB_NTFS_ATTR_DIRECTORY)
-	    type = GRUB_FSHELP_DIR;
-	  else
-	    type = GRUB_FSHELP_REG;
 
-	  fdiro = grub_zalloc (sizeof (struct grub_ntfs_file));
+	  fdiro = make_file_node (diro, pos, &type);
 	  if (!fdiro)
 	    return 0;
 
-	  fdiro->data = diro->data;
-	  fdiro->ino = u64at (pos, 0) & 0xffffffffffffULL;
-	  fdiro->mtime = u64at (pos, 0x20);
-
 	  ustr = get_utf8 (np, ns);
 	  if (ustr == NULL)
 	    {
@@ -883,6 +1012,339 @@ done:
   return ret;
 }
 
+#define GRUB_NTFS_UPCASE_SIZE		(0x10000 * sizeof (grub_uint16_t))
+#define GRUB_NTFS_MAX_INDEX_DEPTH	8
+
+/* Context for grub_ntfs_lookup_file.  */
+struct grub_ntfs_lookup_ctx
+{
+  struct grub_ntfs_file *dir;
+  const char *name;
+  grub_uint16_t *name16;
+  grub_size_t len16;
+  struct grub_ntfs_attr alloc;
+  int alloc_found;
+  grub_fshelp_node_t *foundnode;
+  enum grub_fshelp_filetype *foundtype;
+};
+
+/* Return the $UpCase table of the volume, or NULL if it can't be read.  */
+static grub_uint16_t *
+get_upcase (struct grub_ntfs_data *data)
+{
+  struct grub_ntfs_file up;
+  grub_uint16_t *table;
+
+  if (data->upcase_read)
+    return data->upcase;
+  data->upcase_read = 1;
+
+  grub_memset (&up, 0, sizeof (up));
+  up.data = data;
+  table = grub_malloc (GRUB_NTFS_UPCASE_SIZE);
+  if (table && !init_file (&up, GRUB_NTFS_FILE_UPCASE)
+      && up.size >= GRUB_NTFS_UPCASE_SIZE
+      && !read_attr (&up.attr, (grub_uint8_t *) table, 0,
+		     GRUB_NTFS_UPCASE_SIZE, 0, 0, 0))
+    {
+      data->upcase = table;
+      table = NULL;
+    }
+  free_file (&up);
+  grub_free (table);
+  grub_errno = GRUB_ERR_NONE;
+  return data->upcase;
+}
+
+static int
+upcase_char (struct grub_ntfs_data *data, grub_uint16_t c)
+{
+  grub_uint16_t *table;
+
+  /* Every upcase table maps ASCII the usual way.  */
+  if (c < 0x80)
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+
+  table = get_upcase (data);
+  if (!table)
+    return -1;
+  return grub_le_to_cpu16 (table[c]);
+}
+
+/* Compare the name being looked up with the one of the index entry at POS
+   in filename collation order, ignoring case.  Return -1 if that needs the
+   upcase table and it can't be read.  */
+static int
+collate_name (struct grub_ntfs_lookup_ctx *ctx, grub_uint8_t *pos, int *cmp)
+{
+  grub_size_t keylen = pos[0x50], i;
+
+  for (i = 0; i < ctx->len16 && i < keylen; i++)
+    {
+      int a = ctx->name16[i], b = u16at (pos, 0x52 + 2 * i);
+
+      if (a == b)
+	continue;
+      a = upcase_char (ctx->dir->data, a);
+      b = upcase_char (ctx->dir->data, b);
+      if (a < 0 || b < 0)
+	return -1;
+      if (a != b)
+	{
+	  *cmp = (a < b) ? -1 : 1;
+	  return 0;
+	}
+    }
+
+  *cmp = (ctx->len16 > keylen) - (ctx->len16 < keylen);
+  return 0;
+}
+
+/* Check the index entry at POS against the name the way a directory scan
+   does.  */
+static int
+match_entry (struct grub_ntfs_lookup_ctx *ctx, grub_uint8_t *pos)
+{
+  grub_uint8_t namespace = pos[0x51];
+  char *ustr;
+  int ret;
+
+  if (!pos[0x50] || namespace == 2)
+    return 0;
+
+  ustr = get_utf8 (pos + 0x52, pos[0x50]);
+  if (!ustr)
+    return -1;
+  ret = !(namespace ? grub_strcasecmp (ctx->name, ustr)
+	  : grub_strcmp (ctx->name, ustr));
+  grub_free (ustr);
+  return ret;
+}
+
+static int search_node (struct grub_ntfs_lookup_ctx *ctx, grub_uint64_t vcn,
+			int depth);
+
+/* Search the index entries from POS to END and the subnodes between them.
+   Names equal but for case sort together, so look at all of them.  Return
+   1 if found, 0 if not there, or -1 if the index can't be used.  */
+static int
+search_index (struct grub_ntfs_lookup_ctx *ctx, grub_uint8_t *pos,
+	      grub_uint8_t *end, int depth)
+{
+  while (1)
+    {
+      grub_uint16_t len;
+      int cmp = -1, ret;
+
+      if (pos + 0x10 > end)
+	return -1;
+      len = u16at (pos, 8);
+      if (len < 0x10 || pos + len > end)
+	return -1;
+
+      if (!(pos[0xC] & 2))
+	{
+	  if (len < 0x52 || 0x52 + 2 * pos[0x50] > len)
+	    return -1;
+	  if (collate_name (ctx, pos, &cmp))
+	    return -1;
+	}
+
+      if (cmp <= 0 && (pos[0xC] & 1))
+	{
+	  if (len < 0x18)
+	    return -1;
+	  ret = search_node (ctx, u64at (pos, len - 8), depth + 1);
+	  if (ret)
+	    return ret;
+	}
+
+      if ((pos[0xC] & 2) || cmp < 0)
+	return 0;
+
+      if (cmp == 0)
+	{
+	  ret = match_entry (ctx, pos);
+	  if (ret < 0)
+	    return -1;
+	  if (ret)
+	    {
+	      *ctx->foundnode = make_file_node (ctx->dir, pos, ctx->foundtype);
+	      return *ctx->foundnode ? 1 : -1;
+	    }
+	}
+
+      pos += len;
+    }
+}
+
+/* Search the $INDEX_ALLOCATION block at VCN.  */
+static int
+search_node (struct grub_ntfs_lookup_ctx *ctx, grub_uint64_t vcn, int depth)
+{
+  struct grub_ntfs_data *data = ctx->dir->data;
+  grub_size_t size = data->idx_size << GRUB_NTFS_BLK_SHR;
+  grub_uint8_t *indx;
+  int ret;
+
+  if (depth > GRUB_NTFS_MAX_INDEX_DEPTH)
+    return -1;
+
+  if (!ctx->alloc_found)
+    {
+      grub_uint8_t *cur_pos;
+
+      cur_pos = locate_attr (&ctx->alloc, ctx->dir,
+			     GRUB_NTFS_AT_INDEX_ALLOCATION);
+      while (cur_pos != NULL)
+	{
+	  /* Non-resident, Namelen=4, Offset=0x40, Flags=0, Name="$I30" */
+	  if ((u32at (cur_pos, 8) == 0x400401) &&
+	      (u32at (cur_pos, 0x40) == 0x490024) &&
+	      (u32at (cur_pos, 0x44) == 0x300033))
+	    break;
+	  cur_pos = find_attr (&ctx->alloc, GRUB_NTFS_AT_INDEX_ALLOCATION);
+	}
+      if (cur_pos == NULL)
+	return -1;
+      ctx->alloc_found = 1;
+    }
+
+  indx = grub_malloc (size);
+  if (indx == NULL)
+    return -1;
+
+  if (read_attr (&ctx->alloc, indx, vcn << data->log_idx_vcn, size, 0, 0, 0)
+      || fixup (indx, data->idx_size, (const grub_uint8_t *) "INDX")
+      || u64at (indx, 0x10) != vcn
+      || u32at (indx, 0x1C) > size - 0x18)
+    ret = -1;
+  else
+    ret = search_index (ctx, indx + 0x18 + u32at (indx, 0x18),
+			indx + 0x18 + u32at (indx, 0x1C), depth);
+
+  grub_free (indx);
+  return ret;
+}
+
+/* Look the name up by descending the $I30 index from its root.  */
+static int
+lookup_index (struct grub_ntfs_lookup_ctx *ctx)
+{
+  struct grub_ntfs_attr attr;
+  grub_uint8_t *cur_pos, *hdr;
+  int ret = -1;
+
+  init_attr (&attr, ctx->dir);
+  while ((cur_pos = find_attr (&attr, GRUB_NTFS_AT_INDEX_ROOT)) != NULL)
+    {
+      /* Resident, Namelen=4, Offset=0x18, Flags=0x00, Name="$I30" */
+      if ((u32at (cur_pos, 8) == 0x180400) &&
+	  (u32at (cur_pos, 0x18) == 0x490024) &&
+	  (u32at (cur_pos, 0x1C) == 0x300033))
+	break;
+    }
+
+  /* Filename index collated by name.  */
+  if (cur_pos != NULL && u32at (cur_pos, 0x10) >= 0x20)
+    {
+      grub_uint8_t *value = cur_pos + u16at (cur_pos, 0x14);
+
+      hdr = value + 0x10;
+      if (u32at (value, 0) == GRUB_NTFS_AT_FILENAME && u32at (value, 4) == 1
+	  && u32at (hdr, 4) <= u32at (cur_pos, 0x10) - 0x10)
+	ret = search_index (ctx, hdr + u32at (hdr, 0), hdr + u32at (hdr, 4), 0);
+    }
+
+  free_attr (&attr);
+  return ret;
+}
+
+/* Helper for grub_ntfs_lookup_file.  */
+static int
+grub_ntfs_lookup_iter (const char *filename,
+		       enum grub_fshelp_filetype filetype,
+		       grub_fshelp_node_t node, void *data)
+{
+  struct grub_ntfs_lookup_ctx *ctx = data;
+
+  if ((filetype & GRUB_FSHELP_CASE_INSENSITIVE)
+      ? grub_strcasecmp (ctx->name, filename)
+      : grub_strcmp (ctx->name, filename))
+    {
+      grub_free (node);
+      return 0;
+    }
+
+  *ctx->foundnode = node;
+  *ctx->foundtype = filetype;
+  return 1;
+}
+
+/* Helpers for the fshelp directory cache.  */
+static grub_size_t
+grub_ntfs_node_size (grub_fshelp_node_t node __attribute__ ((unused)))
+{
+  return sizeof (struct grub_ntfs_file);
+}
+
+/* The MFT record is read again by the new mount.  */
+static void
+grub_ntfs_node_rebind (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  node->data = root->data;
+  node->buf = NULL;
+  node->inode_read = 0;
+  grub_memset (&node->attr, 0, sizeof (node->attr));
+}
+
+static const struct grub_fshelp_dcache_ops grub_ntfs_dcache_ops =
+  {
+    .node_size = grub_ntfs_node_size,
+    .node_rebind = grub_ntfs_node_rebind
+  };
+
+static grub_err_t
+grub_ntfs_lookup_file (grub_fshelp_node_t dir, const char *name,
+		       grub_fshelp_node_t *foundnode,
+		       enum grub_fshelp_filetype *foundtype)
+{
+  struct grub_ntfs_lookup_ctx ctx = {
+    .dir = dir,
+    .name = name,
+    .foundnode = foundnode,
+    .foundtype = foundtype
+  };
+  grub_size_t len = grub_strlen (name);
+  int ret = -1;
+
+  *foundnode = 0;
+
+  if (!dir->inode_read && init_file (dir, dir->ino))
+    return grub_errno;
+
+  ctx.name16 = grub_malloc ((len + 1) * sizeof (ctx.name16[0]));
+  if (ctx.name16)
+    {
+      ctx.len16 = grub_utf8_to_utf16 (ctx.name16, len,
+				      (const grub_uint8_t *) name, len, NULL);
+      init_attr (&ctx.alloc, dir);
+      ret = lookup_index (&ctx);
+      free_attr (&ctx.alloc);
+      grub_free (ctx.name16);
+    }
+
+  if (ret < 0)
+    {
+      grub_dprintf ("ntfs", "scanning directory 0x%llx for %s\n",
+		    (unsigned long long) dir->ino, name);
+      grub_errno = GRUB_ERR_NONE;
+      grub_ntfs_iterate_dir (dir, grub_ntfs_lookup_iter, &ctx);
+    }
+
+  return grub_errno;
+}
+
 static struct grub_ntfs_data *
 grub_ntfs_mount (grub_disk_t disk)
 {
@@ -933,6 +1395,14 @@ grub_ntfs_mount (grub_disk_t disk)
   else
     data->idx_size = 1ULL << (-bpb.clusters_per_index - GRUB_NTFS_BLK_SHR);
 
+  /* Index blocks smaller than a cluster are addressed in sectors.  */
+  if (data->idx_size >= (1ULL << data->log_spc))
+    data->log_idx_vcn = data->log_spc + GRUB_NTFS_BLK_SHR;
+  else
+    for (data->log_idx_vcn = GRUB_NTFS_BLK_SHR;
+	 (1U << data->log_idx_vcn) < grub_le_to_cpu16 (bpb.bytes_per_sector);
+	 data->log_idx_vcn++);
+
   data->mft_start = grub_le_to_cpu64 (bpb.mft_lcn) << data->log_spc;
 
   if ((data->mft_size > GRUB_NTFS_MAX_MFT) || (data->idx_size > GRUB_NTFS_MAX_IDX))
@@ -969,6 +1439,7 @@ fail:
     {
       free_file (&data->mmft);
       free_file (&data->cmft);
+      grub_free (data->upcase);
       grub_free (data);
     }
   return 0;
@@ -1013,8 +1484,9 @@ grub_ntfs_dir (grub_device_t device, const char *path,
   if (!data)
     goto fail;
 
-  grub_fshelp_find_file (path, &data->cmft, &fdiro, grub_ntfs_iterate_dir,
-			 grub_ntfs_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (path, &data->cmft, &fdiro,
+				grub_ntfs_lookup_file, grub_ntfs_read_symlink,
+				GRUB_FSHELP_DIR, data->disk, &grub_ntfs_dcache_ops);
 
   if (grub_errno)
     goto fail;
@@ -1031,6 +1503,7 @@ fail:
     {
       free_file (&data->mmft);
       free_file (&data->cmft);
+      grub_free (data->upcase);
       grub_free (data);
     }
 
@@ -1051,8 +1524,9 @@ grub_ntfs_open (grub_file_t file, const char *name)
   if (!data)
     goto fail;
 
-  grub_fshelp_find_file (name, &data->cmft, &mft, grub_ntfs_iterate_dir,
-			 grub_ntfs_read_symlink, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_cached (name, &data->cmft, &mft,
+				grub_ntfs_lookup_file, grub_ntfs_read_symlink,
+				GRUB_FSHELP_REG, data->disk, &grub_ntfs_dcache_ops);
 
   if (grub_errno)
     goto fail;
@@ -1080,6 +1554,7 @@ fail:
     {
       free_file (&data->mmft);
       free_file (&data->cmft);
+      grub_free (data->upcase);
       grub_free (data);
     }
 
@@ -1113,6 +1588,7 @@ grub_ntfs_close (grub_file_t file)
     {
       free_file (&data->mmft);
       free_file (&data->cmft);
+      grub_free (data->upcase);
       grub_free (data);
     }
 
@@ -1136,8 +1612,8 @@ grub_ntfs_label (grub_device_t device, char **label)
   if (!data)
     goto fail;
 
-  grub_fshelp_find_file ("/$Volume", &data->cmft, &mft, grub_ntfs_iterate_dir,
-			 0, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_lookup ("/$Volume", &data->cmft, &mft,
+				grub_ntfs_lookup_file, 0, GRUB_FSHELP_REG);
 
   if (grub_errno)
     goto fail;
@@ -1173,6 +1649,7 @@ fail:
     {
       free_file (&data->mmft);
       free_file (&data->cmft);
+      grub_free (data->upcase);
       grub_free (data);
     }
 
@@ -1199,6 +1676,7 @@ grub_ntfs_uuid (grub_device_t device, char **uuid)
 	  *ptr = grub_toupper (*ptr);
       free_file (&data->mmft);
       free_file (&data->cmft);
+      grub_free (data->upcase);
       grub_free (data);
     }
   else
@@ -189,6 +189,21 @@ enum
 #define SQUASH_CHUNK_SIZE 0x2000
 #define XZBUFSIZ 0x2000
 
+/* Decompressed blocks kept per mount.  Fragment blocks can be as large
+   as the block size, so fewer of them are kept.  */
+#define SQUASH_META_CACHE_SIZE 16
+#define SQUASH_FRAG_CACHE_SIZE 2
+
+struct grub_squash_cache_block
+{
+  /* Disk offset of the compressed block.  */
+  grub_uint64_t start;
+  int valid;
+  grub_size_t size;
+  grub_uint64_t last_used;
+  char *buf;
+};
+
 struct grub_squash_data
 {
   grub_disk_t disk;
@@ -202,6 +217,9 @@ struct grub_squash_data
 			      struct grub_squash_data *data);
   struct xz_dec *xzdec;
   char *xzbuf;
+  struct grub_squash_cache_block meta_cache[SQUASH_META_CACHE_SIZE];
+  struct grub_squash_cache_block frag_cache[SQUASH_FRAG_CACHE_SIZE];
+  grub_uint64_t cache_tick;
 };
 
 struct grub_fshelp_node
@@ -216,12 +234,86 @@ struct grub_fshelp_node
   } stack[1];
 };
 
+/* Return the block at disk offset START, of CSIZE bytes on disk and
+   at most MAXSIZE bytes once decompressed, from CACHE or else read it
+   into the least recently used slot.  */
+static struct grub_squash_cache_block *
+read_cached_block (struct grub_squash_data *data,
+		   struct grub_squash_cache_block *cache, unsigned ncache,
+		   grub_uint64_t start, grub_size_t csize, int compressed,
+		   grub_size_t maxsize)
+{
+  struct grub_squash_cache_block *slot = &cache[0];
+  grub_ssize_t size;
+  unsigned i;
+
+  for (i = 0; i < ncache; i++)
+    {
+      if (cache[i].valid && cache[i].start == start)
+	{
+	  cache[i].last_used = ++data->cache_tick;
+	  return &cache[i];
+	}
+      if (! cache[i].valid
+	  || (slot->valid && cache[i].last_used < slot->last_used))
+	slot = &cache[i];
+    }
+
+  slot->valid = 0;
+  if (! slot->buf)
+    {
+      slot->buf = grub_malloc (maxsize);
+      if (! slot->buf)
+	return 0;
+    }
+
+  if (! compressed)
+    {
+      if (csize > maxsize)
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "incorrect uncompressed chunk");
+	  return 0;
+	}
+      if (grub_disk_read (data->disk, start >> GRUB_DISK_SECTOR_BITS,
+			  start & (GRUB_DISK_SECTOR_SIZE - 1),
+			  csize, slot->buf))
+	return 0;
+      size = csize;
+    }
+  else
+    {
+      char *tmp;
+
+      tmp = grub_malloc (csize);
+      if (! tmp)
+	return 0;
+      if (grub_disk_read (data->disk, start >> GRUB_DISK_SECTOR_BITS,
+			  start & (GRUB_DISK_SECTOR_SIZE - 1),
+			  csize, tmp))
+	{
+	  grub_free (tmp);
+	  return 0;
+	}
+      size = data->decompress (tmp, csize, 0, slot->buf, maxsize, data);
+      grub_free (tmp);
+      if (size < 0)
+	return 0;
+    }
+
+  slot->start = start;
+  slot->size = size;
+  slot->valid = 1;
+  slot->last_used = ++data->cache_tick;
+  return slot;
+}
+
 static grub_err_t
 read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
 	    grub_uint64_t chunk_start, grub_off_t offset)
 {
   while (len > 0)
     {
+      struct grub_squash_cache_block *block;
       grub_uint64_t csize;
       grub_uint16_t d;
       grub_err_t err;
@@ -242,42 +334,29 @@ read_chunk (struct grub_squash_data *data, void *buf, grub_size_t len,
       csize = SQUASH_CHUNK_SIZE - offset;
       if (csize > len)
 	csize = len;
-  
-      if (grub_le_to_cpu16 (d) & SQUASH_CHUNK_UNCOMPRESSED)
+
+      block = read_cached_block (data, data->meta_cache,
+				 ARRAY_SIZE (data->meta_cache),
+				 chunk_start + 2,
+				 grub_le_to_cpu16 (d) & ~SQUASH_CHUNK_FLAGS,
+				 !(grub_le_to_cpu16 (d)
+				   & SQUASH_CHUNK_UNCOMPRESSED),
+				 SQUASH_CHUNK_SIZE);
+      if (!block)
+	return grub_errno;
+
+      /* The last chunk of a table may be short.  */
+      if (offset < block->size)
 	{
-	  grub_disk_addr_t a = chunk_start + 2 + offset;
-	  err = grub_disk_read (data->disk, (a >> GRUB_DISK_SECTOR_BITS),
-				a & (GRUB_DISK_SECTOR_SIZE - 1),
-				csize, buf);
-	  if (err)
-	    return err;
+	  grub_size_t avail = block->size - offset;
+
+	  grub_memcpy (buf, block->buf + offset, avail < csize ? avail : csize);
+	  if (avail < csize)
+	    grub_memset ((char *) buf + avail, 0, csize - avail);
 	}
       else
-	{
-	  char *tmp;
-	  grub_size_t bsize = grub_le_to_cpu16 (d) & ~SQUASH_CHUNK_FLAGS; 
-	  grub_disk_addr_t a = chunk_start + 2;
-	  tmp = grub_malloc (bsize);
-	  if (!tmp)
-	    return grub_errno;
-	  /* FIXME: buffer uncompressed data.  */
-	  err = grub_disk_read (data->disk, (a >> GRUB_DISK_SECTOR_BITS),
-				a & (GRUB_DISK_SECTOR_SIZE - 1),
-				bsize, tmp);
-	  if (err)
-	    {
-	      grub_free (tmp);
-	      return err;
-	    }
+	grub_memset (buf, 0, csize);
 
-	  if (data->decompress (tmp, bsize, offset,
-				buf, csize, data) < 0)
-	    {
-	      grub_free (tmp);
-	      return grub_errno;
-	    }
-	  grub_free (tmp);
-	}
       len -= csize;
       offset += csize;
       buf = (char *) buf + csize;
@@ -314,6 +393,10 @@ lzo_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
       grub_free (udata);
       return -1;
     }
+  if (off > usize)
+    off = usize;
+  if (len > usize - off)
+    len = usize - off;
   grub_memcpy (outbuf, udata + off, len);
   grub_free (udata);
   return len;
@@ -628,6 +711,12 @@ make_root_node (struct grub_squash_data *data, struct grub_fshelp_node *root)
 static void
 squash_unmount (struct grub_squash_data *data)
 {
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (data->meta_cache); i++)
+    grub_free (data->meta_cache[i].buf);
+  for (i = 0; i < ARRAY_SIZE (data->frag_cache); i++)
+    grub_free (data->frag_cache[i].buf);
   if (data->xzdec)
     xz_dec_end (data->xzdec);
   grub_free (data->xzbuf);
@@ -637,6 +726,25 @@ squash_unmount (struct grub_squash_data *data)
 }
 
 
+/* Helpers for the fshelp directory cache.  */
+static grub_size_t
+grub_squash_node_size (grub_fshelp_node_t node)
+{
+  return sizeof (*node) + node->stsize * sizeof (node->stack[0]);
+}
+
+static void
+grub_squash_node_rebind (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  node->data = root->data;
+}
+
+static const struct grub_fshelp_dcache_ops grub_squash_dcache_ops =
+  {
+    .node_size = grub_squash_node_size,
+    .node_rebind = grub_squash_node_rebind
+  };
+
 /* Context for grub_squash_dir.  */
 struct grub_squash_dir_ctx
 {
@@ -678,8 +786,11 @@ grub_squash_dir (grub_device_t device, const char *path,
   if (err)
     return err;
 
-  grub_fshelp_find_file (path, &root, &fdiro, grub_squash_iterate_dir,
-			 grub_squash_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_iterate_cached (path, &root, &fdiro,
+					grub_squash_iterate_dir,
+					grub_squash_read_symlink,
+					GRUB_FSHELP_DIR, data->disk,
+					&grub_squash_dcache_ops);
   if (!grub_errno)
     grub_squash_iterate_dir (fdiro, grub_squash_dir_iter, &ctx);
 
@@ -704,8 +815,11 @@ grub_squash_open (struct grub_file *file, const char *name)
   if (err)
     return err;
 
-  grub_fshelp_find_file (name, &root, &fdiro, grub_squash_iterate_dir,
-			 grub_squash_read_symlink, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_iterate_cached (name, &root, &fdiro,
+					grub_squash_iterate_dir,
+					grub_squash_read_symlink,
+					GRUB_FSHELP_REG, data->disk,
+					&grub_squash_dcache_ops);
   if (grub_errno)
     {
       squash_unmount (data);
@@ -935,32 +1049,22 @@ grub_squash_read (grub_file_t file, char *buf, grub_size_t len)
   else
     b = grub_le_to_cpu32 (ino->ino.file.offset) + off;
   
-  /* FIXME: cache uncompressed chunks.  */
+  /* Many small files share a fragment block, so keep it around.  */
   if (compressed)
     {
-      char *block;
-      block = grub_malloc (grub_le_to_cpu32 (frag.size));
+      struct grub_squash_cache_block *block;
+
+      block = read_cached_block (data, data->frag_cache,
+				 ARRAY_SIZE (data->frag_cache), a,
+				 grub_le_to_cpu32 (frag.size), 1, data->blksz);
       if (!block)
 	return -1;
-      err = grub_disk_read (data->disk,
-			    a >> GRUB_DISK_SECTOR_BITS,
-			    a & (GRUB_DISK_SECTOR_SIZE - 1),
-			    grub_le_to_cpu32 (frag.size), block);
-      if (err)
-	{
-	  grub_free (block);
-	  return -1;
-	}
-      if (data->decompress (block, grub_le_to_cpu32 (frag.size),
-			    b, buf, len, data)
-	  != (grub_ssize_t) len)
+      if (b > block->size || len > block->size - b)
 	{
-	  grub_free (block);
-	  if (!grub_errno)
-	    grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+	  grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
 	  return -1;
 	}
-      grub_free (block);
+      grub_memcpy (buf, block->buf + b, len);
     }
   else
     {
@@ -28,6 +28,7 @@
 #include <grub/charset.h>
 #include <grub/datetime.h>
 #include <grub/udf.h>
+#include <grub/i18n.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -355,10 +356,23 @@ struct grub_udf_data
   int npd, npm, lbshift;
 };
 
+/* An extent of a file.  */
+struct grub_udf_extent
+{
+  /* Offset in the file, in bytes.  */
+  grub_uint64_t offset;
+  grub_uint32_t length;
+  /* The first block on disk, 0 if the extent isn't recorded.  */
+  grub_uint32_t block;
+};
+
 struct grub_fshelp_node
 {
   struct grub_udf_data *data;
   int part_ref;
+  /* The extents of an opened file, NULL if they weren't loaded.  */
+  struct grub_udf_extent *extents;
+  grub_size_t num_extents;
   union
   {
     struct grub_udf_file_entry fe;
@@ -420,16 +434,26 @@ grub_udf_read_icb (struct grub_udf_data *data,
 
   node->part_ref = icb->block.part_ref;
   node->data = data;
+  node->extents = NULL;
+  node->num_extents = 0;
   return 0;
 }
 
-static grub_disk_addr_t
-grub_udf_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+/* Call HOOK for every extent described by the allocation descriptors of
+   NODE, following the allocation extent descriptors.  Stop when HOOK
+   returns 1.  */
+static grub_err_t
+grub_udf_iterate_ads (grub_fshelp_node_t node,
+		      int (*hook) (const struct grub_udf_extent *ext,
+				   void *hook_data),
+		      void *hook_data)
 {
+  struct grub_udf_extent ext = { 0, 0, 0 };
+  grub_uint32_t bsize = U32 (node->data->lvd.bsize);
   char *buf = NULL;
   char *ptr;
-  grub_ssize_t len;
-  grub_disk_addr_t filebytes;
+  grub_ssize_t len, adsize;
+  int is_short;
 
   switch (U16 (node->block.fe.tag.tag_ident))
     {
@@ -444,126 +468,250 @@ grub_udf_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
       break;
 
     default:
-      grub_error (GRUB_ERR_BAD_FS, "invalid file entry");
-      return 0;
+      return grub_error (GRUB_ERR_BAD_FS, "invalid file entry");
     }
 
-  if ((U16 (node->block.fe.icbtag.flags) & GRUB_UDF_ICBTAG_FLAG_AD_MASK)
-      == GRUB_UDF_ICBTAG_FLAG_AD_SHORT)
+  is_short = ((U16 (node->block.fe.icbtag.flags) & GRUB_UDF_ICBTAG_FLAG_AD_MASK)
+	      == GRUB_UDF_ICBTAG_FLAG_AD_SHORT);
+  adsize = (is_short ? sizeof (struct grub_udf_short_ad)
+	    : sizeof (struct grub_udf_long_ad));
+
+  while (len >= adsize)
     {
-      struct grub_udf_short_ad *ad = (struct grub_udf_short_ad *) ptr;
+      grub_uint32_t adlen, adtype, pos;
+      grub_uint16_t part_ref;
 
-      filebytes = fileblock * U32 (node->data->lvd.bsize);
-      while (len >= (grub_ssize_t) sizeof (struct grub_udf_short_ad))
+      if (is_short)
 	{
-	  grub_uint32_t adlen = U32 (ad->length) & 0x3fffffff;
-	  grub_uint32_t adtype = U32 (ad->length) >> 30;
-	  if (adtype == 3)
-	    {
-	      struct grub_udf_aed *extension;
-	      grub_disk_addr_t sec = grub_udf_get_block(node->data,
-							node->part_ref,
-							ad->position);
-	      if (!buf)
-		{
-		  buf = grub_malloc (U32 (node->data->lvd.bsize));
-		  if (!buf)
-		    return 0;
-		}
-	      if (grub_disk_read (node->data->disk, sec << node->data->lbshift,
-				  0, adlen, buf))
-		goto fail;
+	  struct grub_udf_short_ad *ad = (struct grub_udf_short_ad *) ptr;
 
-	      extension = (struct grub_udf_aed *) buf;
-	      if (U16 (extension->tag.tag_ident) != GRUB_UDF_TAG_IDENT_AED)
-		{
-		  grub_error (GRUB_ERR_BAD_FS, "invalid aed tag");
-		  goto fail;
-		}
+	  adlen = U32 (ad->length);
+	  pos = ad->position;
+	  part_ref = node->part_ref;
+	}
+      else
+	{
+	  struct grub_udf_long_ad *ad = (struct grub_udf_long_ad *) ptr;
+
+	  adlen = U32 (ad->length);
+	  pos = ad->block.block_num;
+	  part_ref = ad->block.part_ref;
+	}
+      adtype = adlen >> 30;
+      adlen &= 0x3fffffff;
+
+      if (adtype == 3)
+	{
+	  struct grub_udf_aed *extension;
+	  grub_disk_addr_t sec = grub_udf_get_block (node->data, part_ref, pos);
 
-	      len = U32 (extension->ae_len);
-	      ad = (struct grub_udf_short_ad *)
-		    (buf + sizeof (struct grub_udf_aed));
-	      continue;
+	  if (grub_errno)
+	    break;
+	  if (adlen < sizeof (*extension) || adlen > bsize)
+	    {
+	      grub_error (GRUB_ERR_BAD_FS, "invalid aed length");
+	      break;
 	    }
+	  if (!buf)
+	    {
+	      buf = grub_malloc (bsize);
+	      if (!buf)
+		break;
+	    }
+	  if (grub_disk_read (node->data->disk, sec << node->data->lbshift,
+			      0, adlen, buf))
+	    break;
 
-	  if (filebytes < adlen)
+	  extension = (struct grub_udf_aed *) buf;
+	  if (U16 (extension->tag.tag_ident) != GRUB_UDF_TAG_IDENT_AED)
 	    {
-	      grub_uint32_t ad_pos = ad->position;
-	      grub_free (buf);
-	      return ((U32 (ad_pos) & GRUB_UDF_EXT_MASK) ? 0 :
-		      (grub_udf_get_block (node->data, node->part_ref, ad_pos)
-		       + (filebytes >> (GRUB_DISK_SECTOR_BITS
-					+ node->data->lbshift))));
+	      grub_error (GRUB_ERR_BAD_FS, "invalid aed tag");
+	      break;
 	    }
 
-	  filebytes -= adlen;
-	  ad++;
-	  len -= sizeof (struct grub_udf_short_ad);
+	  len = U32 (extension->ae_len);
+	  if (len > (grub_ssize_t) (adlen - sizeof (*extension)))
+	    len = adlen - sizeof (*extension);
+	  ptr = buf + sizeof (*extension);
+	  continue;
 	}
+
+      ext.length = adlen;
+      ext.block = (adtype ? 0
+		   : grub_udf_get_block (node->data, part_ref, pos));
+      if (grub_errno)
+	break;
+      if (hook (&ext, hook_data))
+	break;
+
+      ext.offset += adlen;
+      ptr += adsize;
+      len -= adsize;
     }
-  else
+
+  grub_free (buf);
+  return grub_errno;
+}
+
+/* Return the extent of NODE holding the byte OFFSET, or NULL.  */
+static const struct grub_udf_extent *
+grub_udf_find_extent (grub_fshelp_node_t node, grub_uint64_t offset)
+{
+  grub_size_t lo = 0, hi = node->num_extents;
+
+  while (lo < hi)
     {
-      struct grub_udf_long_ad *ad = (struct grub_udf_long_ad *) ptr;
+      grub_size_t mid = lo + (hi - lo) / 2;
 
-      filebytes = fileblock * U32 (node->data->lvd.bsize);
-      while (len >= (grub_ssize_t) sizeof (struct grub_udf_long_ad))
-	{
-	  grub_uint32_t adlen = U32 (ad->length) & 0x3fffffff;
-	  grub_uint32_t adtype = U32 (ad->length) >> 30;
-	  if (adtype == 3)
-	    {
-	      struct grub_udf_aed *extension;
-	      grub_disk_addr_t sec = grub_udf_get_block(node->data,
-							ad->block.part_ref,
-							ad->block.block_num);
-	      if (!buf)
-		{
-		  buf = grub_malloc (U32 (node->data->lvd.bsize));
-		  if (!buf)
-		    return 0;
-		}
-	      if (grub_disk_read (node->data->disk, sec << node->data->lbshift,
-				  0, adlen, buf))
-		goto fail;
+      if (node->extents[mid].offset <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
 
-	      extension = (struct grub_udf_aed *) buf;
-	      if (U16 (extension->tag.tag_ident) != GRUB_UDF_TAG_IDENT_AED)
-		{
-		  grub_error (GRUB_ERR_BAD_FS, "invalid aed tag");
-		  goto fail;
-		}
+  if (lo && offset - node->extents[lo - 1].offset < node->extents[lo - 1].length)
+    return &node->extents[lo - 1];
+  return NULL;
+}
 
-	      len = U32 (extension->ae_len);
-	      ad = (struct grub_udf_long_ad *)
-		    (buf + sizeof (struct grub_udf_aed));
-	      continue;
-	    }
-	      
-	  if (filebytes < adlen)
-	    {
-	      grub_uint32_t ad_block_num = ad->block.block_num;
-	      grub_uint32_t ad_part_ref = ad->block.part_ref;
-	      grub_free (buf);
-	      return ((U32 (ad_block_num) & GRUB_UDF_EXT_MASK) ?  0 :
-		      (grub_udf_get_block (node->data, ad_part_ref,
-					   ad_block_num)
-		       + (filebytes >> (GRUB_DISK_SECTOR_BITS
-				        + node->data->lbshift))));
-	    }
+/* Context for grub_udf_read_block.  */
+struct grub_udf_read_block_ctx
+{
+  grub_uint64_t filebytes;
+  struct grub_udf_extent ext;
+  int found;
+};
 
-	  filebytes -= adlen;
-	  ad++;
-	  len -= sizeof (struct grub_udf_long_ad);
-	}
+/* Helper for grub_udf_read_block.  */
+static int
+grub_udf_read_block_iter (const struct grub_udf_extent *ext, void *data)
+{
+  struct grub_udf_read_block_ctx *ctx = data;
+
+  if (ctx->filebytes - ext->offset >= ext->length)
+    return 0;
+
+  ctx->ext = *ext;
+  ctx->found = 1;
+  return 1;
+}
+
+static grub_disk_addr_t
+grub_udf_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+{
+  struct grub_udf_read_block_ctx ctx = {
+    .filebytes = fileblock * U32 (node->data->lvd.bsize),
+    .found = 0
+  };
+  const struct grub_udf_extent *ext;
+
+  if (node->extents)
+    ext = grub_udf_find_extent (node, ctx.filebytes);
+  else
+    {
+      if (grub_udf_iterate_ads (node, grub_udf_read_block_iter, &ctx))
+	return 0;
+      ext = ctx.found ? &ctx.ext : NULL;
     }
 
-fail:
-  grub_free (buf);
+  if (!ext || !ext->block)
+    return 0;
+  return ext->block + ((ctx.filebytes - ext->offset)
+		       >> (GRUB_DISK_SECTOR_BITS + node->data->lbshift));
+}
 
+/* Helper for grub_udf_load_extents.  */
+static int
+grub_udf_load_extents_iter (const struct grub_udf_extent *ext, void *data)
+{
+  grub_fshelp_node_t node = data;
+  grub_size_t n = node->num_extents;
+
+  /* The array holds 16 extents, then doubles whenever it is full.  */
+  if (n == 0 || (n >= 16 && (n & (n - 1)) == 0))
+    {
+      grub_size_t alloc = n ? n * 2 : 16;
+      struct grub_udf_extent *extents;
+
+      extents = grub_realloc (node->extents, alloc * sizeof (extents[0]));
+      if (!extents)
+	return 1;
+      node->extents = extents;
+    }
+
+  node->extents[node->num_extents++] = *ext;
   return 0;
 }
 
+/* Resolve the allocation descriptors of NODE into an array of extents,
+   so that reading it doesn't walk them again for every block.  Leave
+   NODE as it was if this fails.  */
+static void
+grub_udf_load_extents (grub_fshelp_node_t node)
+{
+  if ((U16 (node->block.fe.icbtag.flags) & GRUB_UDF_ICBTAG_FLAG_AD_MASK)
+      == GRUB_UDF_ICBTAG_FLAG_AD_IN_ICB)
+    return;
+
+  if (grub_udf_iterate_ads (node, grub_udf_load_extents_iter, node)
+      || !node->extents)
+    {
+      grub_free (node->extents);
+      node->extents = NULL;
+      node->num_extents = 0;
+      grub_errno = GRUB_ERR_NONE;
+    }
+}
+
+/* Read LEN bytes at POS of NODE, which has its extents loaded, with one
+   disk read per extent.  */
+static grub_ssize_t
+grub_udf_read_extents (grub_fshelp_node_t node,
+		       grub_disk_read_hook_t read_hook, void *read_hook_data,
+		       grub_off_t pos, grub_size_t len, char *buf)
+{
+  grub_disk_t disk = node->data->disk;
+  grub_uint64_t size = U64 (node->block.fe.file_size);
+  grub_size_t done = 0;
+
+  if (pos > size)
+    {
+      grub_error (GRUB_ERR_OUT_OF_RANGE,
+		  N_("attempt to read past the end of file"));
+      return -1;
+    }
+
+  if (pos + len > size)
+    len = size - pos;
+
+  while (done < len)
+    {
+      grub_uint64_t offset = pos + done;
+      const struct grub_udf_extent *ext = grub_udf_find_extent (node, offset);
+      grub_size_t n = len - done;
+
+      if (ext && ext->offset + ext->length - offset < n)
+	n = ext->offset + ext->length - offset;
+
+      /* Blocks that aren't recorded read as zeroes.  */
+      if (!ext || !ext->block)
+	grub_memset (buf + done, 0, n);
+      else
+	{
+	  disk->read_hook = read_hook;
+	  disk->read_hook_data = read_hook_data;
+	  grub_disk_read (disk, (grub_disk_addr_t) ext->block << node->data->lbshift,
+			  offset - ext->offset, n, buf + done);
+	  disk->read_hook = 0;
+	  if (grub_errno)
+	    return -1;
+	}
+      done += n;
+    }
+
+  return len;
+}
+
 static grub_ssize_t
 grub_udf_read_file (grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data,
@@ -591,6 +739,10 @@ grub_udf_read_file (grub_fshelp_node_t node,
       return 0;
     }
 
+  if (node->extents)
+    return grub_udf_read_extents (node, read_hook, read_hook_data,
+				  pos, len, buf);
+
   return grub_fshelp_read_file (node->data->disk, node,
 				read_hook, read_hook_data,
 				pos, len, buf, grub_udf_read_block,
@@ -874,6 +1026,8 @@ grub_udf_iterate_dir (grub_fshelp_node_t dir,
 
   /* The current directory is not stored.  */
   grub_memcpy (child, dir, get_fshelp_size (dir->data));
+  child->extents = NULL;
+  child->num_extents = 0;
 
   if (hook (".", GRUB_FSHELP_DIR, child, hook_data))
     return 1;
@@ -1078,6 +1232,28 @@ grub_udf_dir_iter (const char *filename, enum grub_fshelp_filetype filetype,
   return ctx->hook (filename, &info, ctx->hook_data);
 }
 
+/* Helpers for the fshelp directory cache.  */
+static grub_size_t
+grub_udf_node_size (grub_fshelp_node_t node)
+{
+  return get_fshelp_size (node->data);
+}
+
+static void
+grub_udf_node_rebind (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  node->data = root->data;
+  /* The extents belong to the node they were loaded for.  */
+  node->extents = NULL;
+  node->num_extents = 0;
+}
+
+static const struct grub_fshelp_dcache_ops grub_udf_dcache_ops =
+  {
+    .node_size = grub_udf_node_size,
+    .node_rebind = grub_udf_node_rebind
+  };
+
 static grub_err_t
 grub_udf_dir (grub_device_t device, const char *path,
 	      grub_fs_dir_hook_t hook, void *hook_data)
@@ -1100,13 +1276,17 @@ grub_udf_dir (grub_device_t device, const char *path,
   if (grub_udf_read_icb (data, &data->root_icb, rootnode))
     goto fail;
 
-  if (grub_fshelp_find_file (path, rootnode,
-			     &foundnode,
-			     grub_udf_iterate_dir, grub_udf_read_symlink,
-			     GRUB_FSHELP_DIR))
+  if (grub_fshelp_find_file_iterate_cached (path, rootnode, &foundnode,
+					    grub_udf_iterate_dir,
+					    grub_udf_read_symlink,
+					    GRUB_FSHELP_DIR, data->disk,
+					    &grub_udf_dcache_ops))
     goto fail;
 
+  grub_udf_load_extents (foundnode);
   grub_udf_iterate_dir (foundnode, grub_udf_dir_iter, &ctx);
+  grub_free (foundnode->extents);
+  foundnode->extents = NULL;
 
   if (foundnode != rootnode)
     grub_free (foundnode);
@@ -1141,12 +1321,15 @@ grub_udf_open (struct grub_file *file, const char *name)
   if (grub_udf_read_icb (data, &data->root_icb, rootnode))
     goto fail;
 
-  if (grub_fshelp_find_file (name, rootnode,
-			     &foundnode,
-			     grub_udf_iterate_dir, grub_udf_read_symlink,
-			     GRUB_FSHELP_REG))
+  if (grub_fshelp_find_file_iterate_cached (name, rootnode, &foundnode,
+					    grub_udf_iterate_dir,
+					    grub_udf_read_symlink,
+					    GRUB_FSHELP_REG, data->disk,
+					    &grub_udf_dcache_ops))
     goto fail;
 
+  grub_udf_load_extents (foundnode);
+
   file->data = foundnode;
   file->offset = 0;
   file->size = U64 (foundnode->block.fe.file_size);
@@ -1181,6 +1364,7 @@ grub_udf_close (grub_file_t file)
       struct grub_fshelp_node *node = (struct grub_fshelp_node *) file->data;
 
       grub_free (node->data);
+      grub_free (node->extents);
       grub_free (node);
     }
 
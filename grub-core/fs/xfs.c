@@ -45,6 +45,7 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define	XFS_SB_VERSION_SECTORBIT	0x0800
 #define	XFS_SB_VERSION_EXTFLGBIT	0x1000
 #define	XFS_SB_VERSION_DIRV2BIT		0x2000
+#define	XFS_SB_VERSION_BORGBIT		0x4000	/* ASCII only case-insens. */
 #define XFS_SB_VERSION_MOREBITSBIT	0x8000
 #define XFS_SB_VERSION_BITS_SUPPORTED \
 	(XFS_SB_VERSION_NUMBITS | \
@@ -201,6 +202,40 @@ struct grub_xfs_dirblock_tail
   grub_uint32_t leaf_stale;
 } GRUB_PACKED;
 
+/* Leaf and node blocks of directories, past the data blocks.  */
+#define XFS_DIR2_LEAF_OFFSET	(1ULL << 35)
+
+#define XFS_DIR2_LEAF1_MAGIC	0xd2f1
+#define XFS_DIR2_LEAFN_MAGIC	0xd2ff
+#define XFS_DA_NODE_MAGIC	0xfebe
+#define XFS_DIR3_LEAF1_MAGIC	0x3df1
+#define XFS_DIR3_LEAFN_MAGIC	0x3dff
+#define XFS_DA3_NODE_MAGIC	0x3ebe
+
+#define XFS_DA_NODE_MAXDEPTH	5
+
+/* Common start of leaf and node blocks.  In V5 here follow crc, blkno,
+   etc.  */
+struct grub_xfs_da_blkinfo
+{
+  grub_uint32_t forw;
+  grub_uint32_t back;
+  grub_uint16_t magic;
+  grub_uint16_t pad;
+} GRUB_PACKED;
+
+struct grub_xfs_da_node_entry
+{
+  grub_uint32_t hashval;
+  grub_uint32_t before;
+} GRUB_PACKED;
+
+struct grub_xfs_dir2_leaf_entry
+{
+  grub_uint32_t hashval;
+  grub_uint32_t address;
+} GRUB_PACKED;
+
 struct grub_fshelp_node
 {
   struct grub_xfs_data *data;
@@ -690,27 +725,37 @@ struct grub_xfs_iterate_dir_ctx
   struct grub_fshelp_node *diro;
 };
 
-/* Helper for grub_xfs_iterate_dir.  */
-static int iterate_dir_call_hook (grub_uint64_t ino, const char *filename,
-				  struct grub_xfs_iterate_dir_ctx *ctx)
+static struct grub_fshelp_node *
+grub_xfs_make_node (struct grub_xfs_data *data, grub_uint64_t ino)
 {
   struct grub_fshelp_node *fdiro;
-  grub_err_t err;
 
-  fdiro = grub_malloc (grub_xfs_fshelp_size(ctx->diro->data) + 1);
+  fdiro = grub_malloc (grub_xfs_fshelp_size(data) + 1);
   if (!fdiro)
-    {
-      grub_print_error ();
-      return 0;
-    }
+    return 0;
 
   /* The inode should be read, otherwise the filetype can
      not be determined.  */
   fdiro->ino = ino;
   fdiro->inode_read = 1;
-  fdiro->data = ctx->diro->data;
-  err = grub_xfs_read_inode (ctx->diro->data, ino, &fdiro->inode);
-  if (err)
+  fdiro->data = data;
+  if (grub_xfs_read_inode (data, ino, &fdiro->inode))
+    {
+      grub_free (fdiro);
+      return 0;
+    }
+
+  return fdiro;
+}
+
+/* Helper for grub_xfs_iterate_dir.  */
+static int iterate_dir_call_hook (grub_uint64_t ino, const char *filename,
+				  struct grub_xfs_iterate_dir_ctx *ctx)
+{
+  struct grub_fshelp_node *fdiro;
+
+  fdiro = grub_xfs_make_node (ctx->diro->data, ino);
+  if (!fdiro)
     {
       grub_print_error ();
       return 0;
@@ -883,6 +928,330 @@ grub_xfs_iterate_dir (grub_fshelp_node_t dir,
 }
 
 
+/* Return the hash XFS keeps directory entries of NAME under.  */
+static grub_uint32_t
+grub_xfs_da_hashname (const grub_uint8_t *name, int namelen)
+{
+  grub_uint32_t hash;
+
+  for (hash = 0; namelen >= 4; namelen -= 4, name += 4)
+    hash = ((grub_uint32_t) name[0] << 21) ^ ((grub_uint32_t) name[1] << 14)
+      ^ ((grub_uint32_t) name[2] << 7) ^ name[3]
+      ^ ((hash << 28) | (hash >> 4));
+
+  switch (namelen)
+    {
+    case 3:
+      return ((grub_uint32_t) name[0] << 14) ^ ((grub_uint32_t) name[1] << 7)
+	^ name[2] ^ ((hash << 21) | (hash >> 11));
+    case 2:
+      return ((grub_uint32_t) name[0] << 7) ^ name[1]
+	^ ((hash << 14) | (hash >> 18));
+    case 1:
+      return name[0] ^ ((hash << 7) | (hash >> 25));
+    default:
+      return hash;
+    }
+}
+
+/* Read the directory block at byte offset POS of DIR.  The leaf and
+   node blocks live far beyond the size of the directory.  */
+static grub_err_t
+grub_xfs_read_dirblock (grub_fshelp_node_t dir, grub_uint64_t pos, char *buf)
+{
+  int dirblk_size = 1 << (dir->data->sblock.log2_bsize
+			  + dir->data->sblock.log2_dirblk);
+
+  if (grub_fshelp_read_file (dir->data->disk, dir, 0, 0, pos, dirblk_size,
+			     buf, grub_xfs_read_block, pos + dirblk_size,
+			     dir->data->sblock.log2_bsize
+			     - GRUB_DISK_SECTOR_BITS, 0) != dirblk_size)
+    return grub_errno ? grub_errno : grub_error (GRUB_ERR_BAD_FS,
+						 "short XFS directory block");
+  return GRUB_ERR_NONE;
+}
+
+/* Return the index of the first of the COUNT leaf entries at ENTS with
+   a hash not below HASH.  */
+static grub_uint32_t
+grub_xfs_leaf_lower_bound (const struct grub_xfs_dir2_leaf_entry *ents,
+			   grub_uint32_t count, grub_uint32_t hash)
+{
+  grub_uint32_t lo = 0, hi = count;
+
+  while (lo < hi)
+    {
+      grub_uint32_t mid = lo + (hi - lo) / 2;
+
+      if (grub_be_to_cpu32 (ents[mid].hashval) < hash)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* State of a hashed lookup in a directory.  */
+struct grub_xfs_hash_lookup
+{
+  grub_fshelp_node_t dir;
+  const char *name;
+  int namelen;
+  grub_uint32_t hash;
+  /* The data block last read, and its position.  */
+  char *datablock;
+  grub_uint64_t datapos;
+  grub_fshelp_node_t *foundnode;
+};
+
+/* Look for the entry of the name in the COUNT sorted leaf entries at
+   ENTS.  Return 1 if entries with its hash may go on past them.  */
+static int
+grub_xfs_search_leaf (struct grub_xfs_hash_lookup *lk,
+		      const struct grub_xfs_dir2_leaf_entry *ents,
+		      grub_uint32_t count)
+{
+  int dirblk_size = 1 << (lk->dir->data->sblock.log2_bsize
+			  + lk->dir->data->sblock.log2_dirblk);
+  grub_uint32_t i;
+
+  for (i = grub_xfs_leaf_lower_bound (ents, count, lk->hash);
+       i < count && grub_be_to_cpu32 (ents[i].hashval) == lk->hash; i++)
+    {
+      grub_uint64_t addr = ((grub_uint64_t) grub_be_to_cpu32 (ents[i].address)
+			    << 3);
+      grub_uint32_t off = addr & (dirblk_size - 1);
+      struct grub_xfs_dir2_entry *de;
+
+      /* Stale entry.  */
+      if (!addr)
+	continue;
+
+      if (lk->datapos != addr - off)
+	{
+	  lk->datapos = ~0ULL;
+	  if (grub_xfs_read_dirblock (lk->dir, addr - off, lk->datablock))
+	    return 0;
+	  lk->datapos = addr - off;
+	}
+
+      de = (struct grub_xfs_dir2_entry *) (lk->datablock + off);
+      if (off + sizeof (*de) + lk->namelen > (grub_uint32_t) dirblk_size
+	  || de->len != lk->namelen
+	  || grub_memcmp (de + 1, lk->name, lk->namelen) != 0)
+	continue;
+
+      *lk->foundnode = grub_xfs_make_node (lk->dir->data,
+					   grub_be_to_cpu64 (de->inode));
+      return 0;
+    }
+
+  return i == count;
+}
+
+/* Look NAME up through the hash-ordered leaves of DIR.  Return 0 if the
+   directory has to be scanned instead.  */
+static int
+grub_xfs_lookup_hashed (grub_fshelp_node_t dir, const char *name,
+			grub_fshelp_node_t *foundnode)
+{
+  struct grub_xfs_data *data = dir->data;
+  int dirblk_size = 1 << (data->sblock.log2_bsize + data->sblock.log2_dirblk);
+  /* Leaf and node headers end with 16-bit counts.  */
+  int hdr_size = data->hascrc ? 64 : 16;
+  int count_pos = data->hascrc ? 56 : 12;
+  struct grub_xfs_hash_lookup lk = {
+    .dir = dir,
+    .name = name,
+    .namelen = grub_strlen (name),
+    .datapos = ~0ULL,
+    .foundnode = foundnode
+  };
+  char *leaf = 0;
+  int ret = 0, depth;
+
+  lk.hash = grub_xfs_da_hashname ((const grub_uint8_t *) name, lk.namelen);
+  lk.datablock = grub_malloc (dirblk_size);
+  if (!lk.datablock)
+    goto out;
+
+  if (grub_xfs_read_dirblock (dir, 0, lk.datablock))
+    goto out;
+  lk.datapos = 0;
+
+  if (grub_memcmp (lk.datablock, data->hascrc ? "XDB3" : "XD2B", 4) == 0)
+    {
+      /* Single block directory: the leaf entries sit before the tail.  */
+      struct grub_xfs_dirblock_tail *tail = grub_xfs_dir_tail (data,
+							       lk.datablock);
+      grub_uint32_t count = grub_be_to_cpu32 (tail->leaf_count);
+
+      if (count > (dirblk_size - sizeof (*tail) - hdr_size)
+		  / sizeof (struct grub_xfs_dir2_leaf_entry))
+	goto out;
+      ret = 1;
+      grub_xfs_search_leaf (&lk, (struct grub_xfs_dir2_leaf_entry *) tail
+			    - count, count);
+      goto out;
+    }
+
+  if (grub_memcmp (lk.datablock, data->hascrc ? "XDD3" : "XD2D", 4) != 0)
+    goto out;
+
+  leaf = grub_malloc (dirblk_size);
+  if (!leaf || grub_xfs_read_dirblock (dir, XFS_DIR2_LEAF_OFFSET, leaf))
+    goto out;
+
+  /* Walk down the da-btree to the first leaf that can hold the hash.  */
+  for (depth = 0; ; depth++)
+    {
+      struct grub_xfs_da_blkinfo *info = (struct grub_xfs_da_blkinfo *) leaf;
+      struct grub_xfs_da_node_entry *ents;
+      grub_uint32_t count, lo, hi;
+
+      if (info->magic != grub_cpu_to_be16 (data->hascrc ? XFS_DA3_NODE_MAGIC
+					   : XFS_DA_NODE_MAGIC))
+	break;
+
+      count = grub_be_to_cpu16 (grub_get_unaligned16 (leaf + count_pos));
+      ents = (struct grub_xfs_da_node_entry *) (leaf + hdr_size);
+      if (depth >= XFS_DA_NODE_MAXDEPTH || count == 0
+	  || count > (dirblk_size - hdr_size) / sizeof (*ents))
+	goto out;
+
+      /* Each entry holds the highest hash below it.  */
+      lo = 0;
+      hi = count - 1;
+      while (lo < hi)
+	{
+	  grub_uint32_t mid = lo + (hi - lo) / 2;
+
+	  if (grub_be_to_cpu32 (ents[mid].hashval) < lk.hash)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      if (grub_xfs_read_dirblock (dir, (grub_uint64_t)
+				  grub_be_to_cpu32 (ents[lo].before)
+				  << data->sblock.log2_bsize, leaf))
+	goto out;
+    }
+
+  while (1)
+    {
+      struct grub_xfs_da_blkinfo *info = (struct grub_xfs_da_blkinfo *) leaf;
+      grub_uint32_t count;
+      int is_leafn;
+
+      is_leafn = (info->magic
+		  == grub_cpu_to_be16 (data->hascrc ? XFS_DIR3_LEAFN_MAGIC
+				       : XFS_DIR2_LEAFN_MAGIC));
+      if (!is_leafn
+	  && info->magic != grub_cpu_to_be16 (data->hascrc
+					      ? XFS_DIR3_LEAF1_MAGIC
+					      : XFS_DIR2_LEAF1_MAGIC))
+	goto out;
+
+      count = grub_be_to_cpu16 (grub_get_unaligned16 (leaf + count_pos));
+      if (count > (dirblk_size - hdr_size)
+		  / sizeof (struct grub_xfs_dir2_leaf_entry))
+	goto out;
+
+      /* From here on the answer is final.  */
+      ret = 1;
+      if (!grub_xfs_search_leaf (&lk, (struct grub_xfs_dir2_leaf_entry *)
+				 (leaf + hdr_size), count)
+	  || !is_leafn || !info->forw)
+	break;
+
+      if (grub_xfs_read_dirblock (dir, (grub_uint64_t)
+				  grub_be_to_cpu32 (info->forw)
+				  << data->sblock.log2_bsize, leaf))
+	break;
+    }
+
+ out:
+  grub_free (leaf);
+  grub_free (lk.datablock);
+  return ret || grub_errno;
+}
+
+/* Context for grub_xfs_lookup_file.  */
+struct grub_xfs_lookup_ctx
+{
+  const char *name;
+  grub_fshelp_node_t *foundnode;
+};
+
+/* Helper for grub_xfs_lookup_file.  */
+static int
+grub_xfs_lookup_iter (const char *filename,
+		      enum grub_fshelp_filetype filetype __attribute__ ((unused)),
+		      grub_fshelp_node_t node, void *data)
+{
+  struct grub_xfs_lookup_ctx *ctx = data;
+
+  if (grub_strcmp (ctx->name, filename) != 0)
+    {
+      grub_free (node);
+      return 0;
+    }
+
+  *ctx->foundnode = node;
+  return 1;
+}
+
+/* Helpers for the fshelp directory cache.  */
+static grub_size_t
+grub_xfs_node_size (grub_fshelp_node_t node)
+{
+  return grub_xfs_fshelp_size (node->data) + 1;
+}
+
+static void
+grub_xfs_node_rebind (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  node->data = root->data;
+}
+
+static const struct grub_fshelp_dcache_ops grub_xfs_dcache_ops =
+  {
+    .node_size = grub_xfs_node_size,
+    .node_rebind = grub_xfs_node_rebind
+  };
+
+static grub_err_t
+grub_xfs_lookup_file (grub_fshelp_node_t dir, const char *name,
+		      grub_fshelp_node_t *foundnode,
+		      enum grub_fshelp_filetype *foundtype)
+{
+  struct grub_xfs_lookup_ctx ctx = {
+    .name = name,
+    .foundnode = foundnode
+  };
+
+  *foundnode = 0;
+
+  /* Hashes of case-insensitive directories are not the plain ones.  */
+  if ((dir->inode.format == XFS_INODE_FORMAT_EXT
+       || dir->inode.format == XFS_INODE_FORMAT_BTREE)
+      && !(dir->data->sblock.version
+	   & grub_cpu_to_be16_compile_time (XFS_SB_VERSION_BORGBIT))
+      && grub_xfs_lookup_hashed (dir, name, foundnode))
+    ;
+  else
+    {
+      grub_dprintf ("xfs", "scanning directory %" PRIuGRUB_UINT64_T
+		    " for %s\n", dir->ino, name);
+      grub_errno = GRUB_ERR_NONE;
+      grub_xfs_iterate_dir (dir, grub_xfs_lookup_iter, &ctx);
+    }
+
+  if (*foundnode)
+    *foundtype = grub_xfs_mode_to_filetype ((*foundnode)->inode.mode);
+  return grub_errno;
+}
+
 static struct grub_xfs_data *
 grub_xfs_mount (grub_disk_t disk)
 {
@@ -976,8 +1345,9 @@ grub_xfs_dir (grub_device_t device, const char *path,
   if (!data)
     goto mount_fail;
 
-  grub_fshelp_find_file (path, &data->diropen, &fdiro, grub_xfs_iterate_dir,
-			 grub_xfs_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (path, &data->diropen, &fdiro,
+				grub_xfs_lookup_file, grub_xfs_read_symlink,
+				GRUB_FSHELP_DIR, data->disk, &grub_xfs_dcache_ops);
   if (grub_errno)
     goto fail;
 
@@ -1009,8 +1379,9 @@ grub_xfs_open (struct grub_file *file, const char *name)
   if (!data)
     goto mount_fail;
 
-  grub_fshelp_find_file (name, &data->diropen, &fdiro, grub_xfs_iterate_dir,
-			 grub_xfs_read_symlink, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_cached (name, &data->diropen, &fdiro,
+				grub_xfs_lookup_file, grub_xfs_read_symlink,
+				GRUB_FSHELP_REG, data->disk, &grub_xfs_dcache_ops);
   if (grub_errno)
     goto fail;
 
@@ -55,6 +55,8 @@
 #include <grub/deflate.h>
 #include <grub/crypto.h>
 #include <grub/i18n.h>
+#include <grub/env.h>
+#include <grub/gf256.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -1273,41 +1275,44 @@ scan_devices (struct grub_zfs_data *data)
   return GRUB_ERR_NONE;
 }
 
-/* x**y.  */
-static grub_uint8_t powx[255 * 2];
-/* Such an s that x**s = y */
-static int powx_inv[256];
-static const grub_uint8_t poly = 0x1d;
-
 /* perform the operation a ^= b * (x ** (known_idx * recovery_pow) ) */
 static inline void
 xor_out (grub_uint8_t *a, const grub_uint8_t *b, grub_size_t s,
 	 unsigned known_idx, unsigned recovery_pow)
 {
-  unsigned add;
+  grub_gf256_muladd_region (a, b, grub_gf256_pow (known_idx * recovery_pow),
+			    s);
+}
+
+#define MAX_NBUFS 4
+
+/* Replace the S bytes of the NBUFS buffers with their product by
+   MATRIX.  */
+static grub_err_t
+apply_matrix (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
+	      grub_uint8_t matrix[MAX_NBUFS][MAX_NBUFS])
+{
+  grub_uint8_t *orig;
+  int j, k;
+
+  orig = grub_malloc (s * nbufs);
+  if (!orig)
+    return grub_errno;
+
+  for (k = 0; k < nbufs; k++)
+    grub_memcpy (orig + k * s, bufs[k], s);
 
-  /* Simple xor.  */
-  if (known_idx == 0 || recovery_pow == 0)
+  for (j = 0; j < nbufs; j++)
     {
-      grub_crypto_xor (a, a, b, s);
-      return;
+      grub_memset (bufs[j], 0, s);
+      for (k = 0; k < nbufs; k++)
+	grub_gf256_muladd_region (bufs[j], orig + k * s, matrix[j][k], s);
     }
-  add = (known_idx * recovery_pow) % 255;
-  for (;s--; b++, a++)
-    if (*b)
-      *a ^= powx[powx_inv[*b] + add];
-}
 
-static inline grub_uint8_t
-gf_mul (grub_uint8_t a, grub_uint8_t b)
-{
-  if (a == 0 || b == 0)
-    return 0;
-  return powx[powx_inv[a] + powx_inv[b]];
+  grub_free (orig);
+  return GRUB_ERR_NONE;
 }
 
-#define MAX_NBUFS 4
-
 static grub_err_t
 recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
 	  const unsigned *powers,
@@ -1322,44 +1327,33 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
       /* Easy: r_0 = bufs[0] / (x << (powers[i] * idx[j])).  */
     case 1:
       {
-	int add;
-	grub_uint8_t *a;
 	if (powers[0] == 0 || idx[0] == 0)
 	  return GRUB_ERR_NONE;
-	add = 255 - ((powers[0] * idx[0]) % 255);
-	for (a = bufs[0]; s--; a++)
-	  if (*a)
-	    *a = powx[powx_inv[*a] + add];
+	grub_gf256_mul_region (bufs[0],
+			       grub_gf256_pow (255 - ((powers[0] * idx[0])
+						      % 255)), s);
 	return GRUB_ERR_NONE;
       }
       /* Case 2x2: Let's use the determinant formula.  */
     case 2:
       {
 	grub_uint8_t det, det_inv;
-	grub_uint8_t matrixinv[2][2];
-	unsigned i;
+	grub_uint8_t matrixinv[MAX_NBUFS][MAX_NBUFS];
 	/* The determinant is: */
-	det = (powx[(powers[0] * idx[0] + powers[1] * idx[1]) % 255]
-	       ^ powx[(powers[0] * idx[1] + powers[1] * idx[0]) % 255]);
+	det = (grub_gf256_pow (powers[0] * idx[0] + powers[1] * idx[1])
+	       ^ grub_gf256_pow (powers[0] * idx[1] + powers[1] * idx[0]));
 	if (det == 0)
 	  return grub_error (GRUB_ERR_BAD_FS, "singular recovery matrix");
-	det_inv = powx[255 - powx_inv[det]];
-	matrixinv[0][0] = gf_mul (powx[(powers[1] * idx[1]) % 255], det_inv);
-	matrixinv[1][1] = gf_mul (powx[(powers[0] * idx[0]) % 255], det_inv);
-	matrixinv[0][1] = gf_mul (powx[(powers[0] * idx[1]) % 255], det_inv);
-	matrixinv[1][0] = gf_mul (powx[(powers[1] * idx[0]) % 255], det_inv);
-	for (i = 0; i < s; i++)
-	  {
-	    grub_uint8_t b0, b1;
-	    b0 = bufs[0][i];
-	    b1 = bufs[1][i];
-
-	    bufs[0][i] = (gf_mul (b0, matrixinv[0][0])
-			  ^ gf_mul (b1, matrixinv[0][1]));
-	    bufs[1][i] = (gf_mul (b0, matrixinv[1][0])
-			  ^ gf_mul (b1, matrixinv[1][1]));
-	  }
-	return GRUB_ERR_NONE;
+	det_inv = grub_gf256_inv (det);
+	matrixinv[0][0] = grub_gf256_mul (grub_gf256_pow (powers[1] * idx[1]),
+					  det_inv);
+	matrixinv[1][1] = grub_gf256_mul (grub_gf256_pow (powers[0] * idx[0]),
+					  det_inv);
+	matrixinv[0][1] = grub_gf256_mul (grub_gf256_pow (powers[0] * idx[1]),
+					  det_inv);
+	matrixinv[1][0] = grub_gf256_mul (grub_gf256_pow (powers[1] * idx[0]),
+					  det_inv);
+	return apply_matrix (bufs, s, nbufs, matrixinv);
       }
       /* Otherwise use Gauss.  */
     case 3:
@@ -1369,7 +1363,7 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
 
 	for (i = 0; i < nbufs; i++)
 	  for (j = 0; j < nbufs; j++)
-	    matrix1[i][j] = powx[(powers[i] * idx[j]) % 255];
+	    matrix1[i][j] = grub_gf256_pow (powers[i] * idx[j]);
 	for (i = 0; i < nbufs; i++)
 	  for (j = 0; j < nbufs; j++)
 	    matrix2[i][j] = 0;
@@ -1403,18 +1397,18 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
 		    matrix2[i][j] = t;
 		  }
 	      }
-	    mul = powx[255 - powx_inv[matrix1[i][i]]];
+	    mul = grub_gf256_inv (matrix1[i][i]);
 	    for (j = 0; j < nbufs; j++)
-	      matrix1[i][j] = gf_mul (matrix1[i][j], mul);
+	      matrix1[i][j] = grub_gf256_mul (matrix1[i][j], mul);
 	    for (j = 0; j < nbufs; j++)
-	      matrix2[i][j] = gf_mul (matrix2[i][j], mul);
+	      matrix2[i][j] = grub_gf256_mul (matrix2[i][j], mul);
 	    for (j = i + 1; j < nbufs; j++)
 	      {
 		mul = matrix1[j][i];
 		for (k = 0; k < nbufs; k++)
-		  matrix1[j][k] ^= gf_mul (matrix1[i][k], mul);
+		  matrix1[j][k] ^= grub_gf256_mul (matrix1[i][k], mul);
 		for (k = 0; k < nbufs; k++)
-		  matrix2[j][k] ^= gf_mul (matrix2[i][k], mul);
+		  matrix2[j][k] ^= grub_gf256_mul (matrix2[i][k], mul);
 	      }
 	  }
 	for (i = nbufs - 1; i >= 0; i--)
@@ -1424,25 +1418,13 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
 		grub_uint8_t mul;
 		mul = matrix1[j][i];
 		for (k = 0; k < nbufs; k++)
-		  matrix1[j][k] ^= gf_mul (matrix1[i][k], mul);
+		  matrix1[j][k] ^= grub_gf256_mul (matrix1[i][k], mul);
 		for (k = 0; k < nbufs; k++)
-		  matrix2[j][k] ^= gf_mul (matrix2[i][k], mul);
+		  matrix2[j][k] ^= grub_gf256_mul (matrix2[i][k], mul);
 	      }
 	  }
 
-	for (i = 0; i < (int) s; i++)
-	  {
-	    grub_uint8_t b[MAX_NBUFS];
-	    for (j = 0; j < nbufs; j++)
-	      b[j] = bufs[j][i];
-	    for (j = 0; j < nbufs; j++)
-	      {
-		bufs[j][i] = 0;
-		for (k = 0; k < nbufs; k++)
-		  bufs[j][i] ^= gf_mul (matrix2[j][k], b[k]);
-	      }
-	  }
-	return GRUB_ERR_NONE;
+	return apply_matrix (bufs, s, nbufs, matrix2);
       }
     default:
       return grub_error (GRUB_ERR_BUG, "too big matrix");
@@ -1578,22 +1560,6 @@ read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
 	    unsigned i, j;
 	    grub_err_t err;
 
-	    /* Compute mul. x**s has a period of 255.  */
-	    if (powx[0] == 0)
-	      {
-		grub_uint8_t cur = 1;
-		for (i = 0; i < 255; i++)
-		  {
-		    powx[i] = cur;
-		    powx[i + 255] = cur;
-		    powx_inv[cur] = i;
-		    if (cur & 0x80)
-		      cur = (cur << 1) ^ poly;
-		    else
-		      cur <<= 1;
-		  }
-	      }
-
 	    /* Read redundancy data.  */
 	    for (n_redundancy = 0, cur_redundancy_pow = 0;
 		 n_redundancy < failed_devices;
@@ -1838,6 +1804,213 @@ decode_embedded_bp_compressed(const blkptr_t *bp, void *buf)
   return GRUB_ERR_NONE;
 }
 
+/*
+ * Cache of verified, decompressed metadata blocks, shared by all pools.
+ * Blocks are never overwritten in place, so the pool, the first DVA and
+ * the birth txg of a block pointer identify its contents.  Like the ARC,
+ * blocks used once and blocks used again are kept on separate LRU lists,
+ * so that a long scan does not evict the frequently used blocks.
+ */
+struct zfs_cache_entry
+{
+  struct zfs_cache_entry *hash_next;
+  struct zfs_cache_entry *lru_next;
+  struct zfs_cache_entry *lru_prev;
+  struct zfs_cache_list *list;
+  grub_uint64_t guid;
+  grub_uint64_t dva[2];
+  grub_uint64_t birth;
+  grub_size_t size;
+  char buf[0];
+};
+
+struct zfs_cache_list
+{
+  struct zfs_cache_entry *head;
+  struct zfs_cache_entry *tail;
+  grub_size_t size;
+};
+
+#define ZFS_CACHE_HASHSZ	256
+/* Used unless the zfs_cache_size variable says otherwise.  */
+#define ZFS_CACHE_DEFAULT_SIZE	(8 << 20)
+
+static struct zfs_cache_entry *zfs_cache_hash[ZFS_CACHE_HASHSZ];
+static struct zfs_cache_list zfs_cache_recent;
+static struct zfs_cache_list zfs_cache_frequent;
+
+static grub_size_t
+zfs_cache_max (void)
+{
+  const char *val;
+  unsigned long long max;
+
+  val = grub_env_get ("zfs_cache_size");
+  if (! val)
+    return ZFS_CACHE_DEFAULT_SIZE;
+
+  max = grub_strtoull (val, 0, 0);
+  if (grub_errno)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return ZFS_CACHE_DEFAULT_SIZE;
+    }
+
+  return max;
+}
+
+/* Compute the key of BP into ENTRY.  Return 0 if the block is not
+   cached.  */
+static int
+zfs_cache_key (blkptr_t *bp, grub_zfs_endian_t endian,
+	       struct grub_zfs_data *data, struct zfs_cache_entry *entry)
+{
+  grub_uint64_t prop = grub_zfs_to_cpu64 (bp->blk_prop, endian);
+
+  /* File contents have their own cache, and encrypted blocks must not
+     be readable without their key.  */
+  if (BP_IS_EMBEDDED (bp) || BP_IS_HOLE (bp) || ! data->guid
+      || ((prop >> 60) & 3)
+      || (((prop >> 48) & 0xff) == DMU_OT_PLAIN_FILE_CONTENTS
+	  && ((prop >> 56) & 0x1f) == 0))
+    return 0;
+
+  entry->guid = data->guid;
+  entry->dva[0] = grub_zfs_to_cpu64 (bp->blk_dva[0].dva_word[0], endian);
+  entry->dva[1] = grub_zfs_to_cpu64 (bp->blk_dva[0].dva_word[1], endian);
+  entry->birth = grub_zfs_to_cpu64 (bp->blk_birth, endian);
+
+  return 1;
+}
+
+static struct zfs_cache_entry **
+zfs_cache_bucket (const struct zfs_cache_entry *key)
+{
+  grub_uint64_t h;
+
+  h = key->guid ^ key->dva[0] ^ (key->dva[1] * 0x9e3779b97f4a7c15ULL)
+    ^ key->birth;
+  return &zfs_cache_hash[(h ^ (h >> 32)) % ZFS_CACHE_HASHSZ];
+}
+
+static void
+zfs_cache_unlink (struct zfs_cache_entry *entry)
+{
+  struct zfs_cache_list *list = entry->list;
+
+  if (entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    list->head = entry->lru_next;
+  if (entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    list->tail = entry->lru_prev;
+  list->size -= entry->size;
+}
+
+static void
+zfs_cache_link (struct zfs_cache_list *list, struct zfs_cache_entry *entry)
+{
+  entry->list = list;
+  entry->lru_prev = 0;
+  entry->lru_next = list->head;
+  if (list->head)
+    list->head->lru_prev = entry;
+  else
+    list->tail = entry;
+  list->head = entry;
+  list->size += entry->size;
+}
+
+/* Evict blocks until the cache holds at most MAX bytes.  Blocks used
+   once go first, as long as they take at least half of the cache.  */
+static void
+zfs_cache_evict (grub_size_t max)
+{
+  while (zfs_cache_recent.size + zfs_cache_frequent.size > max)
+    {
+      struct zfs_cache_entry *victim, **p;
+
+      if (zfs_cache_recent.tail
+	  && (zfs_cache_recent.size >= max / 2 || ! zfs_cache_frequent.tail))
+	victim = zfs_cache_recent.tail;
+      else
+	victim = zfs_cache_frequent.tail;
+
+      zfs_cache_unlink (victim);
+      for (p = zfs_cache_bucket (victim); *p != victim; p = &(*p)->hash_next);
+      *p = victim->hash_next;
+      grub_free (victim);
+    }
+}
+
+/* Return a copy of the cached block BP in BUF, or set BUF to 0 if it is
+   not cached.  */
+static grub_err_t
+zfs_cache_get (blkptr_t *bp, grub_zfs_endian_t endian,
+	       struct grub_zfs_data *data, void **buf)
+{
+  struct zfs_cache_entry key, *entry;
+
+  *buf = 0;
+  if (! zfs_cache_key (bp, endian, data, &key))
+    return GRUB_ERR_NONE;
+
+  for (entry = *zfs_cache_bucket (&key); entry; entry = entry->hash_next)
+    if (entry->guid == key.guid && entry->dva[0] == key.dva[0]
+	&& entry->dva[1] == key.dva[1] && entry->birth == key.birth)
+      break;
+  if (! entry)
+    return GRUB_ERR_NONE;
+
+  *buf = grub_malloc (entry->size);
+  if (! *buf)
+    return grub_errno;
+  grub_memcpy (*buf, entry->buf, entry->size);
+
+  zfs_cache_unlink (entry);
+  zfs_cache_link (&zfs_cache_frequent, entry);
+
+  return GRUB_ERR_NONE;
+}
+
+static void
+zfs_cache_put (blkptr_t *bp, grub_zfs_endian_t endian,
+	       struct grub_zfs_data *data, const void *buf, grub_size_t size)
+{
+  struct zfs_cache_entry key, *entry, **bucket;
+  grub_size_t max = zfs_cache_max ();
+
+  if (! zfs_cache_key (bp, endian, data, &key))
+    return;
+
+  /* Do not let a single block take over the cache.  */
+  if (size > max / 4)
+    {
+      zfs_cache_evict (max);
+      return;
+    }
+
+  zfs_cache_evict (max - size);
+
+  entry = grub_malloc (sizeof (*entry) + size);
+  if (! entry)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  *entry = key;
+  entry->size = size;
+  grub_memcpy (entry->buf, buf, size);
+
+  bucket = zfs_cache_bucket (entry);
+  entry->hash_next = *bucket;
+  *bucket = entry;
+  zfs_cache_link (&zfs_cache_recent, entry);
+}
+
 /*
  * Read in a block of data, verify its checksum, decompress if needed,
  * and put the uncompressed data in buf.
@@ -1888,6 +2061,10 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
     return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
 		       "compression algorithm %s not supported\n", decomp_table[comp].name);
 
+  err = zfs_cache_get (bp, endian, data, buf);
+  if (err || *buf)
+    return err;
+
   if (comp != ZIO_COMPRESS_OFF)
     /* It's not really necessary to align to 16, just for safety.  */
     compbuf = grub_malloc (ALIGN_UP (psize, 16));
@@ -1992,6 +2169,8 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
 	}
     }
 
+  zfs_cache_put (bp, endian, data, *buf, lsize);
+
   return GRUB_ERR_NONE;
 }
 
@@ -4375,4 +4554,5 @@ GRUB_MOD_INIT (zfs)
 GRUB_MOD_FINI (zfs)
 {
   grub_fs_unregister (&grub_zfs_fs);
+  zfs_cache_evict (0);
 }
@@ -95,6 +95,7 @@ typedef struct _U64_S {
 #define	MINMATCH 4
 
 #define	COPYLENGTH 8
+#define	WIDECOPYLENGTH 16
 #define	LASTLITERALS 5
 
 #define	ML_BITS 4
@@ -130,6 +131,12 @@ typedef struct _U64_S {
 
 /* Macros */
 #define	LZ4_WILDCOPY(s, d, e) do { LZ4_COPYPACKET(s, d) } while (d < e);
+/*
+ * Same with 16 bytes per round, for when the buffers have that much
+ * slack.  The steps stay sequential so matches at offset 8 are fine.
+ */
+#define	LZ4_WIDECOPY(s, d, e) \
+	do { LZ4_COPYPACKET(s, d) LZ4_COPYPACKET(s, d) } while (d < e);
 
 /* Decompression functions */
 grub_err_t
@@ -210,7 +217,12 @@ LZ4_uncompress_unknownOutputSize(const char *source,
 			/* Necessarily EOF, due to parsing restrictions. */
 			break;
 		}
-		LZ4_WILDCOPY(ip, op, cpy);
+		if (cpy <= oend - WIDECOPYLENGTH &&
+		    ip + length <= iend - WIDECOPYLENGTH) {
+			LZ4_WIDECOPY(ip, op, cpy);
+		} else {
+			LZ4_WILDCOPY(ip, op, cpy);
+		}
 		ip -= (op - cpy);
 		op = cpy;
 
@@ -273,7 +285,12 @@ LZ4_uncompress_unknownOutputSize(const char *source,
 				break;
 			continue;
 		}
-		LZ4_SECURECOPY(ref, op, cpy);
+		if (cpy <= oend - WIDECOPYLENGTH) {
+			if (op < cpy)
+				LZ4_WIDECOPY(ref, op, cpy);
+		} else {
+			LZ4_SECURECOPY(ref, op, cpy);
+		}
 		op = cpy;	/* correction */
 	}
 
@@ -70,6 +70,16 @@ lzjb_decompress (void *s_start, void *d_start, grub_size_t s_len,
 	{
 	  copymask = 1;
 	  copymap = *src++;
+
+	  /* A whole group of literals is moved in one go.  */
+	  if (copymap == 0 && src + NBBY <= s_end && dst + NBBY <= d_end)
+	    {
+	      grub_set_unaligned64 (dst, grub_get_unaligned64 (src));
+	      src += NBBY;
+	      dst += NBBY;
+	      copymask = 1 << (NBBY - 1);
+	      continue;
+	    }
 	}
       if (src >= s_end)
 	return grub_error (GRUB_ERR_BAD_FS, "lzjb decompression failed");
@@ -81,8 +91,27 @@ lzjb_decompress (void *s_start, void *d_start, grub_size_t s_len,
 	  cpy = dst - offset;
 	  if (src > s_end || cpy < (grub_uint8_t *) d_start)
 	    return grub_error (GRUB_ERR_BAD_FS, "lzjb decompression failed");
-	  while (--mlen >= 0 && dst < d_end)
-	    *dst++ = *cpy++;
+	  /*
+	   * Copy 8 bytes at a time when the source does not overlap a
+	   * single step and the overrun still lands in the output buffer,
+	   * where it is overwritten by what follows.
+	   */
+	  if (offset >= 8 && dst + mlen + 8 <= d_end)
+	    {
+	      grub_uint8_t *end = dst + mlen;
+
+	      do
+		{
+		  grub_set_unaligned64 (dst, grub_get_unaligned64 (cpy));
+		  dst += 8;
+		  cpy += 8;
+		}
+	      while (dst < end);
+	      dst = end;
+	    }
+	  else
+	    while (--mlen >= 0 && dst < d_end)
+	      *dst++ = *cpy++;
 	}
       else
 	*dst++ = *src++;
@@ -21,6 +21,7 @@
 #include <grub/command.h>
 
 grub_command_t grub_command_list;
+unsigned long grub_command_generation;
 
 grub_command_t
 grub_register_command_prio (const char *name,
@@ -74,6 +75,8 @@ grub_register_command_prio (const char *name,
   if (! inactive)
     cmd->prio |= GRUB_COMMAND_FLAG_ACTIVE;
 
+  grub_command_generation++;
+
   return cmd;
 }
 
@@ -84,4 +87,5 @@ grub_unregister_command (grub_command_t cmd)
     cmd->next->prio |= GRUB_COMMAND_FLAG_ACTIVE;
   grub_list_remove (GRUB_AS_LIST (cmd));
   grub_free (cmd);
+  grub_command_generation++;
 }
@@ -36,7 +36,7 @@ struct grub_disk_cache grub_disk_cache_table[GRUB_DISK_CACHE_NUM];
 void (*grub_disk_firmware_fini) (void);
 int grub_disk_firmware_is_tainted;
 
-#if DISK_CACHE_STATS
+#if DISK_CACHE_STATS || defined (GRUB_UTIL)
 static unsigned long grub_disk_cache_hits;
 static unsigned long grub_disk_cache_misses;
 
@@ -55,11 +55,15 @@ grub_err_t (*grub_disk_write_weak) (grub_disk_t disk,
 				    const void *buf);
 #include "disk_common.c"
 
+unsigned long grub_disk_cache_generation;
+
 void
 grub_disk_cache_invalidate_all (void)
 {
   unsigned i;
 
+  grub_disk_cache_generation++;
+
   for (i = 0; i < GRUB_DISK_CACHE_NUM; i++)
     {
       struct grub_disk_cache *cache = grub_disk_cache_table + i;
@@ -86,13 +90,13 @@ grub_disk_cache_fetch (unsigned long dev_id, unsigned long disk_id,
       && cache->sector == sector)
     {
       cache->lock = 1;
-#if DISK_CACHE_STATS
+#if DISK_CACHE_STATS || defined (GRUB_UTIL)
       grub_disk_cache_hits++;
 #endif
       return cache->data;
     }
 
-#if DISK_CACHE_STATS
+#if DISK_CACHE_STATS || defined (GRUB_UTIL)
   grub_disk_cache_misses++;
 #endif
 
@@ -145,12 +149,14 @@ grub_disk_cache_store (unsigned long dev_id, unsigned long disk_id,
 
 
 grub_disk_dev_t grub_disk_dev_list;
+unsigned long grub_disk_dev_generation;
 
 void
 grub_disk_dev_register (grub_disk_dev_t dev)
 {
   dev->next = grub_disk_dev_list;
   grub_disk_dev_list = dev;
+  grub_disk_dev_generation++;
 }
 
 void
@@ -164,6 +170,7 @@ grub_disk_dev_unregister (grub_disk_dev_t dev)
         *p = q->next;
 	break;
       }
+  grub_disk_dev_generation++;
 }
 
 /* Return the location of the first ',', if any, which is not
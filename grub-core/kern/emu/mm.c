@@ -25,10 +25,15 @@
 #include <string.h>
 #include <grub/i18n.h>
 
+unsigned long grub_mm_alloc_count;
+grub_uint64_t grub_mm_alloc_bytes;
+
 void *
 grub_malloc (grub_size_t size)
 {
   void *ret;
+  grub_mm_alloc_count++;
+  grub_mm_alloc_bytes += size;
   ret = malloc (size);
   if (!ret)
     grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
@@ -57,6 +62,8 @@ void *
 grub_realloc (void *ptr, grub_size_t size)
 {
   void *ret;
+  grub_mm_alloc_count++;
+  grub_mm_alloc_bytes += size;
   ret = realloc (ptr, size);
   if (!ret)
     grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
@@ -28,38 +28,129 @@ static struct grub_env_context initial_context;
 /* The current context.  */
 struct grub_env_context *grub_current_context = &initial_context;
 
-/* Return the hash representation of the string S.  */
-static unsigned int
+/* Return the hash representation of the string S (32-bit FNV-1a).  */
+static grub_uint32_t
 grub_env_hashval (const char *s)
 {
-  unsigned int i = 0;
+  grub_uint32_t hash = 2166136261U;
 
-  /* XXX: This can be done much more efficiently.  */
   while (*s)
-    i += 5 * *(s++);
+    {
+      hash ^= (grub_uint8_t) *s++;
+      hash *= 16777619;
+    }
 
-  return i % HASHSZ;
+  return hash;
 }
 
 static struct grub_env_var *
-grub_env_find (const char *name)
+grub_env_find_in_context (struct grub_env_context *context, const char *name,
+			  grub_uint32_t hash)
 {
   struct grub_env_var *var;
-  int idx = grub_env_hashval (name);
 
-  /* Look for the variable in the current context.  */
-  for (var = grub_current_context->vars[idx]; var; var = var->next)
+  if (! context->size)
+    return 0;
+
+  for (var = context->vars[hash & (context->size - 1)]; var; var = var->next)
     if (grub_strcmp (var->name, name) == 0)
       return var;
 
   return 0;
 }
 
-static void
+/* Look for the variable NAME as seen from the current context, skipping
+   the variables of the current context itself if INHERITED_ONLY is set.
+   The context owning the variable is returned in OWNER.  Variables
+   without value are returned too.  */
+static struct grub_env_var *
+grub_env_lookup (const char *name, int inherited_only,
+		 struct grub_env_context **owner)
+{
+  struct grub_env_context *context, *child = 0;
+  grub_uint32_t hash = grub_env_hashval (name);
+
+  for (context = grub_current_context; context;
+       child = context, context = context->prev)
+    {
+      struct grub_env_var *var;
+
+      if (inherited_only && ! child)
+	continue;
+
+      var = grub_env_find_in_context (context, name, hash);
+      if (! var)
+	continue;
+
+      /* A variable that crossed a context boundary is exported in the
+	 inner context, so only the outermost boundary matters.  */
+      if (child && ! var->global && ! child->inherit_all)
+	return 0;
+
+      *owner = context;
+      return var;
+    }
+
+  return 0;
+}
+
+static struct grub_env_var *
+grub_env_find (const char *name)
+{
+  struct grub_env_context *owner;
+  struct grub_env_var *var;
+
+  var = grub_env_lookup (name, 0, &owner);
+  if (var && ! var->value)
+    return 0;
+
+  return var;
+}
+
+static grub_err_t
 grub_env_insert (struct grub_env_context *context,
 		 struct grub_env_var *var)
 {
-  int idx = grub_env_hashval (var->name);
+  grub_uint32_t idx;
+
+  /* Grow the table, keeping at most one variable per bucket on average.
+     If that fails, the current table is still usable.  */
+  if (context->count >= context->size)
+    {
+      grub_size_t size = context->size ? context->size * 2
+	: GRUB_ENV_INITIAL_HASHSZ;
+      struct grub_env_var **vars;
+
+      vars = grub_zalloc (size * sizeof (vars[0]));
+      if (vars)
+	{
+	  grub_size_t i;
+
+	  for (i = 0; i < context->size; i++)
+	    while (context->vars[i])
+	      {
+		struct grub_env_var *v = context->vars[i];
+
+		context->vars[i] = v->next;
+		idx = grub_env_hashval (v->name) & (size - 1);
+		v->prevp = &vars[idx];
+		v->next = vars[idx];
+		if (v->next)
+		  v->next->prevp = &(v->next);
+		vars[idx] = v;
+	      }
+
+	  grub_free (context->vars);
+	  context->vars = vars;
+	  context->size = size;
+	}
+      else if (context->size)
+	grub_errno = GRUB_ERR_NONE;
+      else
+	return grub_errno;
+    }
+
+  idx = grub_env_hashval (var->name) & (context->size - 1);
 
   /* Insert the variable into the hashtable.  */
   var->prevp = &context->vars[idx];
@@ -67,24 +158,93 @@ grub_env_insert (struct grub_env_context *context,
   if (var->next)
     var->next->prevp = &(var->next);
   context->vars[idx] = var;
+  context->count++;
+
+  return GRUB_ERR_NONE;
 }
 
 static void
-grub_env_remove (struct grub_env_var *var)
+grub_env_remove (struct grub_env_context *context, struct grub_env_var *var)
 {
   /* Remove the entry from the variable table.  */
   *var->prevp = var->next;
   if (var->next)
     var->next->prevp = var->prevp;
+  context->count--;
+}
+
+/* Create a variable named NAME in the current context, with value VAL
+   unless it is NULL.  */
+static struct grub_env_var *
+grub_env_create (const char *name, const char *val)
+{
+  struct grub_env_var *var;
+
+  var = grub_zalloc (sizeof (*var));
+  if (! var)
+    return 0;
+
+  var->name = grub_strdup (name);
+  if (! var->name)
+    goto fail;
+
+  if (val)
+    {
+      var->value = grub_strdup (val);
+      if (! var->value)
+	goto fail;
+    }
+
+  if (grub_env_insert (grub_current_context, var) != GRUB_ERR_NONE)
+    goto fail;
+
+  return var;
+
+ fail:
+  grub_free (var->name);
+  grub_free (var->value);
+  grub_free (var);
+
+  return 0;
+}
+
+/* Copy the inherited variable VAR to the current context, so that it
+   can be modified there.  */
+static struct grub_env_var *
+grub_env_copy (struct grub_env_var *var)
+{
+  struct grub_env_var *copy;
+
+  copy = grub_env_create (var->name, var->value);
+  if (! copy)
+    return 0;
+
+  copy->read_hook = var->read_hook;
+  copy->write_hook = var->write_hook;
+  copy->global = 1;
+
+  return copy;
 }
 
 grub_err_t
 grub_env_set (const char *name, const char *val)
 {
+  struct grub_env_context *owner;
   struct grub_env_var *var;
 
+  var = grub_env_lookup (name, 0, &owner);
+
+  /* An inherited variable is copied before it is changed.  */
+  if (var && var->value && owner != grub_current_context)
+    {
+      var = grub_env_copy (var);
+      if (! var)
+	return grub_errno;
+    }
+  else if (var && owner != grub_current_context)
+    var = 0;
+
   /* If the variable does already exist, just update the variable.  */
-  var = grub_env_find (name);
   if (var)
     {
       char *old = var->value;
@@ -105,28 +265,10 @@ grub_env_set (const char *name, const char *val)
     }
 
   /* The variable does not exist, so create a new one.  */
-  var = grub_zalloc (sizeof (*var));
-  if (! var)
+  if (! grub_env_create (name, val))
     return grub_errno;
 
-  var->name = grub_strdup (name);
-  if (! var->name)
-    goto fail;
-
-  var->value = grub_strdup (val);
-  if (! var->value)
-    goto fail;
-
-  grub_env_insert (grub_current_context, var);
-
   return GRUB_ERR_NONE;
-
- fail:
-  grub_free (var->name);
-  grub_free (var->value);
-  grub_free (var);
-
-  return grub_errno;
 }
 
 const char *
@@ -147,10 +289,11 @@ grub_env_get (const char *name)
 void
 grub_env_unset (const char *name)
 {
-  struct grub_env_var *var;
+  struct grub_env_context *owner;
+  struct grub_env_var *var, *inherited;
 
-  var = grub_env_find (name);
-  if (! var)
+  var = grub_env_lookup (name, 0, &owner);
+  if (! var || ! var->value)
     return;
 
   if (var->read_hook || var->write_hook)
@@ -159,7 +302,25 @@ grub_env_unset (const char *name)
       return;
     }
 
-  grub_env_remove (var);
+  /* Keep a variable without value, if there is an inherited one to
+     hide.  */
+  inherited = var;
+  if (owner == grub_current_context)
+    inherited = grub_env_lookup (name, 1, &owner);
+  if (inherited && inherited->value)
+    {
+      if (inherited == var)
+	{
+	  grub_env_create (name, 0);
+	  return;
+	}
+      grub_free (var->value);
+      var->value = 0;
+      var->global = 0;
+      return;
+    }
+
+  grub_env_remove (grub_current_context, var);
 
   grub_free (var->name);
   grub_free (var->value);
@@ -170,27 +331,32 @@ struct grub_env_var *
 grub_env_update_get_sorted (void)
 {
   struct grub_env_var *sorted_list = 0;
-  int i;
+  struct grub_env_context *context;
+  grub_size_t i;
 
-  /* Add variables associated with this context into a sorted list.  */
-  for (i = 0; i < HASHSZ; i++)
-    {
-      struct grub_env_var *var;
+  /* Add variables visible in this context into a sorted list.  */
+  for (context = grub_current_context; context; context = context->prev)
+    for (i = 0; i < context->size; i++)
+      {
+	struct grub_env_var *var;
 
-      for (var = grub_current_context->vars[i]; var; var = var->next)
-	{
-	  struct grub_env_var *p, **q;
+	for (var = context->vars[i]; var; var = var->next)
+	  {
+	    struct grub_env_var *p, **q;
 
-	  for (q = &sorted_list, p = *q; p; q = &((*q)->sorted_next), p = *q)
-	    {
-	      if (grub_strcmp (p->name, var->name) > 0)
-		break;
-	    }
+	    if (grub_env_find (var->name) != var)
+	      continue;
 
-	  var->sorted_next = *q;
-	  *q = var;
-	}
-    }
+	    for (q = &sorted_list, p = *q; p; q = &((*q)->sorted_next), p = *q)
+	      {
+		if (grub_strcmp (p->name, var->name) > 0)
+		  break;
+	      }
+
+	    var->sorted_next = *q;
+	    *q = var;
+	  }
+      }
 
   return sorted_list;
 }
@@ -200,9 +366,10 @@ grub_register_variable_hook (const char *name,
 			     grub_env_read_hook_t read_hook,
 			     grub_env_write_hook_t write_hook)
 {
-  struct grub_env_var *var = grub_env_find (name);
+  struct grub_env_context *owner;
+  struct grub_env_var *var = grub_env_lookup (name, 0, &owner);
 
-  if (! var)
+  if (! var || ! var->value)
     {
       if (grub_env_set (name, "") != GRUB_ERR_NONE)
 	return grub_errno;
@@ -210,6 +377,12 @@ grub_register_variable_hook (const char *name,
       var = grub_env_find (name);
       /* XXX Insert an assertion?  */
     }
+  else if (owner != grub_current_context)
+    {
+      var = grub_env_copy (var);
+      if (! var)
+	return grub_errno;
+    }
 
   var->read_hook = read_hook;
   var->write_hook = write_hook;
@@ -220,10 +393,11 @@ grub_register_variable_hook (const char *name,
 grub_err_t
 grub_env_export (const char *name)
 {
+  struct grub_env_context *owner;
   struct grub_env_var *var;
 
-  var = grub_env_find (name);
-  if (! var)
+  var = grub_env_lookup (name, 0, &owner);
+  if (! var || ! var->value)
     {
       grub_err_t err;
       
@@ -231,7 +405,10 @@ grub_env_export (const char *name)
       if (err)
 	return err;
       var = grub_env_find (name);
-    }    
+    }
+  /* Inherited variables are exported in this context already.  */
+  else if (owner != grub_current_context)
+    return GRUB_ERR_NONE;
   var->global = 1;
 
   return GRUB_ERR_NONE;
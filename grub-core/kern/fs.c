@@ -228,10 +228,12 @@ grub_fs_blocklist_read (grub_file_t file, char *buf, grub_size_t len)
 			      size, buf) != GRUB_ERR_NONE)
 	    return -1;
 
+	  buf += size;
 	  ret += size;
 	  len -= size;
-	  sector -= ((size + offset) >> GRUB_DISK_SECTOR_BITS);
-	  offset = ((size + offset) & (GRUB_DISK_SECTOR_SIZE - 1));
+	  /* Either LEN is exhausted or the rest starts at the next block.  */
+	  sector = 0;
+	  offset = 0;
 	}
       else
 	sector -= p->length;
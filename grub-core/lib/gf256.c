@@ -0,0 +1,148 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/gf256.h>
+#include <grub/crypto.h>
+#include <grub/misc.h>
+#include <grub/dl.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* x**y.  */
+static grub_uint8_t powx[255 * 2];
+/* Such an s that x**s = y */
+static unsigned powx_inv[256];
+static const grub_uint8_t poly = 0x1d;
+
+static void
+init_tables (void)
+{
+  unsigned i;
+  grub_uint8_t cur = 1;
+
+  if (powx[0])
+    return;
+
+  for (i = 0; i < 255; i++)
+    {
+      powx[i] = cur;
+      powx[i + 255] = cur;
+      powx_inv[cur] = i;
+      if (cur & 0x80)
+	cur = (cur << 1) ^ poly;
+      else
+	cur <<= 1;
+    }
+}
+
+grub_uint8_t
+grub_gf256_pow (unsigned n)
+{
+  init_tables ();
+  return powx[n % 255];
+}
+
+unsigned
+grub_gf256_log (grub_uint8_t a)
+{
+  init_tables ();
+  return powx_inv[a];
+}
+
+grub_uint8_t
+grub_gf256_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  if (a == 0 || b == 0)
+    return 0;
+  init_tables ();
+  return powx[powx_inv[a] + powx_inv[b]];
+}
+
+grub_uint8_t
+grub_gf256_inv (grub_uint8_t a)
+{
+  init_tables ();
+  return powx[255 - powx_inv[a]];
+}
+
+/* Fill TABLE with the products of all bytes by C.  Looking the product
+   up directly avoids the zero test and the second lookup of the
+   logarithm tables for every byte.  */
+static void
+mul_table (grub_uint8_t table[256], grub_uint8_t c)
+{
+  unsigned i, logc;
+
+  init_tables ();
+  logc = powx_inv[c];
+  table[0] = 0;
+  for (i = 1; i < 256; i++)
+    table[i] = powx[powx_inv[i] + logc];
+}
+
+void
+grub_gf256_mul_region (grub_uint8_t *buf, grub_uint8_t c, grub_size_t size)
+{
+  grub_uint8_t table[256];
+
+  if (c == 1)
+    return;
+  if (c == 0)
+    {
+      grub_memset (buf, 0, size);
+      return;
+    }
+
+  mul_table (table, c);
+  for (; size >= 4; size -= 4, buf += 4)
+    {
+      buf[0] = table[buf[0]];
+      buf[1] = table[buf[1]];
+      buf[2] = table[buf[2]];
+      buf[3] = table[buf[3]];
+    }
+  for (; size; size--, buf++)
+    *buf = table[*buf];
+}
+
+void
+grub_gf256_muladd_region (grub_uint8_t *dst, const grub_uint8_t *src,
+			  grub_uint8_t c, grub_size_t size)
+{
+  grub_uint8_t table[256];
+
+  if (c == 0)
+    return;
+  /* Plain parity, which is done a word at a time.  */
+  if (c == 1)
+    {
+      grub_crypto_xor (dst, dst, src, size);
+      return;
+    }
+
+  mul_table (table, c);
+  for (; size >= 4; size -= 4, dst += 4, src += 4)
+    {
+      dst[0] ^= table[src[0]];
+      dst[1] ^= table[src[1]];
+      dst[2] ^= table[src[2]];
+      dst[3] ^= table[src[3]];
+    }
+  for (; size; size--, dst++, src++)
+    *dst ^= table[*src];
+}
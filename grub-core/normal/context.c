@@ -56,7 +56,6 @@ static grub_err_t
 grub_env_new_context (int export_all)
 {
   struct grub_env_context *context;
-  int i;
   struct menu_pointer *menu;
 
   context = grub_zalloc (sizeof (*context));
@@ -69,30 +68,14 @@ grub_env_new_context (int export_all)
       return grub_errno;
     }
 
+  /* Exported variables are inherited, and copied on write.  */
+  context->inherit_all = export_all;
   context->prev = grub_current_context;
   grub_current_context = context;
 
   menu->prev = current_menu;
   current_menu = menu;
 
-  /* Copy exported variables.  */
-  for (i = 0; i < HASHSZ; i++)
-    {
-      struct grub_env_var *var;
-
-      for (var = context->prev->vars[i]; var; var = var->next)
-	if (var->global || export_all)
-	  {
-	    if (grub_env_set (var->name, var->value) != GRUB_ERR_NONE)
-	      {
-		grub_env_context_close ();
-		return grub_errno;
-	      }
-	    grub_env_export (var->name);
-	    grub_register_variable_hook (var->name, var->read_hook, var->write_hook);
-	  }
-    }
-
   return GRUB_ERR_NONE;
 }
 
@@ -115,7 +98,7 @@ grub_err_t
 grub_env_context_close (void)
 {
   struct grub_env_context *context;
-  int i;
+  grub_size_t i;
   struct menu_pointer *menu;
 
   if (! grub_current_context->prev)
@@ -123,7 +106,7 @@ grub_env_context_close (void)
 		       "cannot close the initial context");
 
   /* Free the variables associated with this context.  */
-  for (i = 0; i < HASHSZ; i++)
+  for (i = 0; i < grub_current_context->size; i++)
     {
       struct grub_env_var *p, *q;
 
@@ -135,6 +118,7 @@ grub_env_context_close (void)
 	  grub_free (p);
 	}
     }
+  grub_free (grub_current_context->vars);
 
   /* Restore the previous context.  */
   context = grub_current_context->prev;
@@ -70,6 +70,7 @@ grub_normal_free_menu (grub_menu_t menu)
       grub_free ((void *) entry->users);
       grub_free ((void *) entry->title);
       grub_free ((void *) entry->sourcecode);
+      grub_script_unref (entry->script);
       grub_free (entry);
       entry = next_entry;
     }
@@ -102,6 +103,77 @@ read_config_file_getline (char **line, int cont __attribute__ ((unused)),
   return GRUB_ERR_NONE;
 }
 
+/* Helper for read_config_file.  Read the whole of FILE into memory.  */
+static char *
+read_config_file_whole (grub_file_t file, grub_size_t *size)
+{
+  grub_off_t file_size = grub_file_size (file);
+  char *buf;
+
+  if (file_size == GRUB_FILE_SIZE_UNKNOWN
+      || file_size != (grub_size_t) file_size)
+    return 0;
+
+  buf = grub_malloc (file_size + 1);
+  if (! buf)
+    return 0;
+
+  if (grub_file_read (file, buf, file_size) != (grub_ssize_t) file_size)
+    {
+      grub_free (buf);
+      return 0;
+    }
+
+  *size = file_size;
+  return buf;
+}
+
+/* Helper for read_config_file.  Execute the compiled form of CONFIG if
+   there is one and it is up to date.  Return 1 if it was executed.  */
+static int
+read_config_file_compiled (const char *config, grub_file_t file)
+{
+  grub_file_t compiled;
+  char *name, *source = 0, *image = 0;
+  grub_size_t size, image_size;
+  int ret = 0;
+
+  name = grub_xasprintf ("%s" GRUB_SCRIPT_COMPILED_SUFFIX, config);
+  if (! name)
+    goto out;
+
+  compiled = grub_file_open (name);
+  if (! compiled)
+    goto out;
+
+  image = read_config_file_whole (compiled, &image_size);
+  grub_file_close (compiled);
+  if (! image)
+    goto out;
+
+  source = read_config_file_whole (file, &size);
+  if (! source)
+    goto out;
+
+  if (grub_script_execute_compiled (source, size, image, image_size))
+    {
+      grub_dprintf ("normal", "not using %s: %s\n", name, grub_errmsg);
+      goto out;
+    }
+  ret = 1;
+
+ out:
+  if (! ret)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (file, 0);
+    }
+  grub_free (source);
+  grub_free (image);
+  grub_free (name);
+  return ret;
+}
+
 static grub_menu_t
 read_config_file (const char *config)
 {
@@ -164,20 +236,21 @@ read_config_file (const char *config)
   grub_env_export ("config_file");
   grub_env_export ("config_directory");
 
-  while (1)
-    {
-      char *line;
+  if (! read_config_file_compiled (config, file))
+    while (1)
+      {
+	char *line;
 
-      /* Print an error, if any.  */
-      grub_print_error ();
-      grub_errno = GRUB_ERR_NONE;
+	/* Print an error, if any.  */
+	grub_print_error ();
+	grub_errno = GRUB_ERR_NONE;
 
-      if ((read_config_file_getline (&line, 0, file)) || (! line))
-	break;
+	if ((read_config_file_getline (&line, 0, file)) || (! line))
+	  break;
 
-      grub_normal_parse_line (line, read_config_file_getline, file);
-      grub_free (line);
-    }
+	grub_normal_parse_line (line, read_config_file_getline, file);
+	grub_free (line);
+      }
 
   if (old_file)
     grub_env_set ("config_file", old_file);
@@ -295,7 +295,16 @@ grub_menu_execute_entry(grub_menu_entry_t entry, int auto_boot)
   else
     grub_env_unset ("default");
 
-  grub_script_execute_new_scope (entry->sourcecode, entry->argc, entry->args);
+  if (entry->script)
+    {
+      /* The block was parsed when the entry was defined, run it as is.  */
+      struct grub_script *script = grub_script_ref (entry->script);
+
+      grub_script_execute_parsed_new_scope (script, entry->argc, entry->args);
+      grub_script_unref (script);
+    }
+  else
+    grub_script_execute_new_scope (entry->sourcecode, entry->argc, entry->args);
 
   if (errs_before != grub_err_printed_errors)
     grub_wait_after_message ();
@@ -594,6 +594,8 @@ make_screen (grub_menu_entry_t entry)
   if (! init_line (screen, screen->lines))
     goto fail;
 
+  if (! grub_menu_entry_get_sourcecode (entry))
+    goto fail;
   insert_string (screen, (char *) entry->sourcecode, 0);
 
   /* Reset the cursor position.  */
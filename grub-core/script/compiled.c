@@ -0,0 +1,857 @@
+/* compiled.c -- Pre-parsed representation of GRUB scripts.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/err.h>
+#include <grub/i18n.h>
+#include <grub/crypto.h>
+#include <grub/script_sh.h>
+
+/* A compiled script is the sequence of top level statements of a
+   script file, each one stored exactly as grub_script_parse returned
+   it, together with the functions its parsing defined.  Loading it
+   rebuilds the same in-memory structures through the constructors used
+   by the parser, so the interpreter can't tell the difference.
+
+   All numbers are little endian.  The image starts with
+   struct grub_script_compiled_header and is followed by NUNITS units:
+
+     unit:    u32 nfuncs, nfuncs * (string name, cmd body), cmd
+     cmd:     u8 tag, followed by the tag-specific fields below
+     arglist: u32 nargs, nargs * arg
+     arg:     u32 nparts, nparts * (u8 type, string, [cmd if block])
+     string:  u32 length, length bytes, '\0'
+*/
+
+#define GRUB_SCRIPT_COMPILED_MAGIC	"GRUBSAST"
+#define GRUB_SCRIPT_COMPILED_VERSION	1
+#define GRUB_SCRIPT_COMPILED_HASH_SIZE	32
+
+/* Guard against exhausting the stack on corrupted images.  Scripts
+   nested deeper than this are not pre-parsed.  */
+#define GRUB_SCRIPT_COMPILED_MAX_DEPTH	64
+
+struct grub_script_compiled_header
+{
+  char magic[8];
+  grub_uint32_t version;
+  grub_uint32_t nunits;
+  grub_uint64_t source_size;
+  grub_uint8_t source_hash[GRUB_SCRIPT_COMPILED_HASH_SIZE];
+} GRUB_PACKED;
+
+enum
+  {
+    CMD_NONE,
+    CMD_LIST,      /* u32 count, count * cmd.  */
+    CMD_LINE,      /* arglist.  */
+    CMD_IF,        /* cmd condition, cmd true, cmd false.  */
+    CMD_FOR,       /* arg name, arglist words, cmd body.  */
+    CMD_WHILE,     /* cmd condition, cmd body.  */
+    CMD_UNTIL      /* cmd condition, cmd body.  */
+  };
+
+/* Read next line of an in-memory script, with the same semantics as
+   the config file reader in normal mode.  */
+grub_err_t
+grub_script_source_getline (char **line, int cont __attribute__ ((unused)),
+			    void *data)
+{
+  struct grub_script_source *source = data;
+
+  while (1)
+    {
+      const char *eol;
+      char *buf;
+      grub_size_t pos = 0;
+
+      *line = 0;
+      if (source->ptr >= source->end)
+	return GRUB_ERR_NONE;
+
+      for (eol = source->ptr; eol < source->end && *eol != '\n'; eol++);
+
+      buf = grub_malloc (eol - source->ptr + 1);
+      if (! buf)
+	return grub_errno;
+
+      for (; source->ptr < eol; source->ptr++)
+	if (*source->ptr != '\r')
+	  buf[pos++] = *source->ptr;
+      buf[pos] = '\0';
+
+      if (source->ptr < source->end)
+	source->ptr++;
+
+      if (buf[0] != '#')
+	{
+	  *line = buf;
+	  return GRUB_ERR_NONE;
+	}
+      grub_free (buf);
+    }
+}
+
+static grub_err_t
+hash_source (const char *source, grub_size_t size, grub_uint8_t *hash)
+{
+  const gcry_md_spec_t *md;
+
+  md = grub_crypto_lookup_md_by_name ("sha256");
+  if (! md || md->mdlen != GRUB_SCRIPT_COMPILED_HASH_SIZE)
+    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		       N_("hash `%s' not found"), "sha256");
+
+  grub_crypto_hash (md, hash, source, size);
+  return GRUB_ERR_NONE;
+}
+
+
+
+struct compiled_writer
+{
+  grub_uint8_t *buf;
+  grub_size_t size;
+  grub_size_t allocated;
+  int depth;
+};
+
+static grub_err_t
+write_data (struct compiled_writer *w, const void *data, grub_size_t len)
+{
+  if (w->size + len > w->allocated)
+    {
+      grub_size_t allocated = w->allocated ? : 4096;
+      grub_uint8_t *buf;
+
+      while (w->size + len > allocated)
+	allocated *= 2;
+
+      buf = grub_realloc (w->buf, allocated);
+      if (! buf)
+	return grub_errno;
+
+      w->buf = buf;
+      w->allocated = allocated;
+    }
+
+  grub_memcpy (w->buf + w->size, data, len);
+  w->size += len;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+write_u8 (struct compiled_writer *w, grub_uint8_t val)
+{
+  return write_data (w, &val, sizeof (val));
+}
+
+static grub_err_t
+write_u32 (struct compiled_writer *w, grub_uint32_t val)
+{
+  val = grub_cpu_to_le32 (val);
+  return write_data (w, &val, sizeof (val));
+}
+
+static grub_err_t
+write_string (struct compiled_writer *w, const char *str)
+{
+  grub_size_t len = grub_strlen (str);
+
+  if (write_u32 (w, len))
+    return grub_errno;
+  return write_data (w, str, len + 1);
+}
+
+static grub_err_t write_cmd (struct compiled_writer *w,
+			     struct grub_script_cmd *cmd);
+
+static grub_err_t
+write_arg (struct compiled_writer *w, struct grub_script_arg *arg)
+{
+  struct grub_script_arg *part;
+  grub_uint32_t nparts = 0;
+
+  for (part = arg; part; part = part->next)
+    nparts++;
+
+  if (write_u32 (w, nparts))
+    return grub_errno;
+
+  for (part = arg; part; part = part->next)
+    {
+      if (write_u8 (w, part->type) || write_string (w, part->str))
+	return grub_errno;
+
+      if (part->type == GRUB_SCRIPT_ARG_TYPE_BLOCK
+	  && write_cmd (w, part->script ? part->script->cmd : 0))
+	return grub_errno;
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+write_arglist (struct compiled_writer *w, struct grub_script_arglist *list)
+{
+  struct grub_script_arglist *l;
+  grub_uint32_t nargs = 0;
+
+  for (l = list; l; l = l->next)
+    nargs++;
+
+  if (write_u32 (w, nargs))
+    return grub_errno;
+
+  for (l = list; l; l = l->next)
+    if (write_arg (w, l->arg))
+      return grub_errno;
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+write_cmd_real (struct compiled_writer *w, struct grub_script_cmd *cmd)
+{
+  if (! cmd)
+    return write_u8 (w, CMD_NONE);
+
+  if (cmd->exec == grub_script_execute_cmdlist)
+    {
+      struct grub_script_cmd *c;
+      grub_uint32_t count = 0;
+
+      for (c = cmd->next; c; c = c->next)
+	count++;
+
+      if (write_u8 (w, CMD_LIST) || write_u32 (w, count))
+	return grub_errno;
+
+      for (c = cmd->next; c; c = c->next)
+	if (write_cmd (w, c))
+	  return grub_errno;
+
+      return GRUB_ERR_NONE;
+    }
+
+  if (cmd->exec == grub_script_execute_cmdline)
+    {
+      struct grub_script_cmdline *line = (struct grub_script_cmdline *) cmd;
+
+      if (write_u8 (w, CMD_LINE))
+	return grub_errno;
+      return write_arglist (w, line->arglist);
+    }
+
+  if (cmd->exec == grub_script_execute_cmdif)
+    {
+      struct grub_script_cmdif *cmdif = (struct grub_script_cmdif *) cmd;
+
+      if (write_u8 (w, CMD_IF)
+	  || write_cmd (w, cmdif->exec_to_evaluate)
+	  || write_cmd (w, cmdif->exec_on_true))
+	return grub_errno;
+      return write_cmd (w, cmdif->exec_on_false);
+    }
+
+  if (cmd->exec == grub_script_execute_cmdfor)
+    {
+      struct grub_script_cmdfor *cmdfor = (struct grub_script_cmdfor *) cmd;
+
+      if (write_u8 (w, CMD_FOR)
+	  || write_arg (w, cmdfor->name)
+	  || write_arglist (w, cmdfor->words))
+	return grub_errno;
+      return write_cmd (w, cmdfor->list);
+    }
+
+  if (cmd->exec == grub_script_execute_cmdwhile)
+    {
+      struct grub_script_cmdwhile *cmdwhile
+	= (struct grub_script_cmdwhile *) cmd;
+
+      if (write_u8 (w, cmdwhile->until ? CMD_UNTIL : CMD_WHILE)
+	  || write_cmd (w, cmdwhile->cond))
+	return grub_errno;
+      return write_cmd (w, cmdwhile->list);
+    }
+
+  return grub_error (GRUB_ERR_BUG, "unknown script command type");
+}
+
+/* Write CMD, refusing to nest deeper than the reader accepts.  */
+static grub_err_t
+write_cmd (struct compiled_writer *w, struct grub_script_cmd *cmd)
+{
+  grub_err_t err;
+
+  if (++w->depth > GRUB_SCRIPT_COMPILED_MAX_DEPTH)
+    {
+      w->depth--;
+      return grub_error (GRUB_ERR_OUT_OF_RANGE,
+			 N_("script is nested too deeply to pre-parse"));
+    }
+
+  err = write_cmd_real (w, cmd);
+  w->depth--;
+  return err;
+}
+
+static grub_err_t
+write_unit (struct compiled_writer *w, struct grub_script *script)
+{
+  struct grub_script_arglist *l;
+  grub_uint32_t nfuncs = 0;
+
+  for (l = script->functions; l; l = l->next)
+    nfuncs++;
+
+  if (write_u32 (w, nfuncs))
+    return grub_errno;
+
+  for (l = script->functions; l; l = l->next)
+    {
+      grub_script_function_t func;
+
+      FOR_SCRIPT_FUNCTIONS (func)
+	if (grub_strcmp (func->name, l->arg->str) == 0)
+	  break;
+      if (! func)
+	return grub_error (GRUB_ERR_BUG, "function `%s' vanished",
+			   l->arg->str);
+
+      if (write_string (w, func->name)
+	  || write_cmd (w, func->func ? func->func->cmd : 0))
+	return grub_errno;
+    }
+
+  return write_cmd (w, script->cmd);
+}
+
+/* Parse the script in SOURCE and store its compiled form in a newly
+   allocated buffer returned in IMAGE.  Fail with GRUB_ERR_OUT_OF_RANGE
+   if the script is nested too deeply to be read back.  */
+grub_err_t
+grub_script_compile (const char *source, grub_size_t size,
+		     void **image, grub_size_t *image_size)
+{
+  struct grub_script_compiled_header head;
+  struct compiled_writer w = { 0, 0, 0, 0 };
+  struct grub_script_source src = { source, source + size };
+  grub_uint32_t nunits = 0;
+
+  grub_memset (&head, 0, sizeof (head));
+  grub_memcpy (head.magic, GRUB_SCRIPT_COMPILED_MAGIC, sizeof (head.magic));
+  head.version = grub_cpu_to_le32_compile_time (GRUB_SCRIPT_COMPILED_VERSION);
+  head.source_size = grub_cpu_to_le64 (size);
+  if (hash_source (source, size, head.source_hash)
+      || write_data (&w, &head, sizeof (head)))
+    goto fail;
+
+  while (1)
+    {
+      struct grub_script *parsed;
+      char *line;
+
+      if (grub_script_source_getline (&line, 0, &src) || ! line)
+	break;
+
+      parsed = grub_script_parse (line, grub_script_source_getline, &src);
+      grub_free (line);
+      if (! parsed)
+	{
+	  if (grub_errno == GRUB_ERR_NONE)
+	    grub_error (GRUB_ERR_BAD_ARGUMENT, N_("syntax error"));
+	  goto fail;
+	}
+
+      write_unit (&w, parsed);
+      grub_script_free (parsed);
+      if (grub_errno)
+	goto fail;
+      nunits++;
+    }
+
+  if (grub_errno)
+    goto fail;
+
+  head.nunits = grub_cpu_to_le32 (nunits);
+  grub_memcpy (w.buf, &head, sizeof (head));
+
+  *image = w.buf;
+  *image_size = w.size;
+  return GRUB_ERR_NONE;
+
+ fail:
+  grub_free (w.buf);
+  return grub_errno;
+}
+
+
+
+struct compiled_reader
+{
+  const grub_uint8_t *ptr;
+  const grub_uint8_t *end;
+  int depth;
+  int err;
+  struct grub_parser_param *state;
+};
+
+static const void *
+read_data (struct compiled_reader *r, grub_size_t len)
+{
+  const void *data = r->ptr;
+
+  if (r->err || (grub_size_t) (r->end - r->ptr) < len)
+    {
+      r->err = 1;
+      return 0;
+    }
+
+  r->ptr += len;
+  return data;
+}
+
+static grub_uint8_t
+read_u8 (struct compiled_reader *r)
+{
+  const grub_uint8_t *val = read_data (r, sizeof (*val));
+  return val ? *val : 0;
+}
+
+static grub_uint32_t
+read_u32 (struct compiled_reader *r)
+{
+  const grub_uint32_t *val = read_data (r, sizeof (*val));
+  return val ? grub_le_to_cpu32 (grub_get_unaligned32 (val)) : 0;
+}
+
+static const char *
+read_string (struct compiled_reader *r)
+{
+  grub_uint32_t len = read_u32 (r);
+  const char *str;
+
+  if (len == GRUB_UINT_MAX)
+    r->err = 1;
+  str = read_data (r, len + 1);
+  if (str && str[len] != '\0')
+    r->err = 1;
+
+  return r->err ? 0 : str;
+}
+
+/* Reading never stops half-way: in case of error the partially built
+   structures are still linked together, so that freeing the outermost
+   script releases all of them.  */
+static struct grub_script_cmd *read_cmd (struct compiled_reader *r);
+
+/* Read the commands of a block or function body into their own
+   grub_script, the same way the parser builds them.  TEXT is the text of
+   a block, NULL for a function body.  */
+static struct grub_script *
+read_script (struct compiled_reader *r, const char *text)
+{
+  struct grub_parser_param *state = r->state;
+  struct grub_script_mem *membackup;
+  struct grub_script *scripts;
+  struct grub_script_mem *memory;
+  struct grub_script_cmd *cmd;
+  struct grub_script *script;
+  char *copy = 0;
+
+  membackup = grub_script_mem_record (state);
+  scripts = state->scripts;
+  state->scripts = 0;
+
+  if (text)
+    {
+      grub_size_t len = grub_strlen (text) + 1;
+
+      copy = grub_script_malloc (state, len);
+      if (copy)
+	grub_memcpy (copy, text, len);
+      else
+	r->err = 1;
+    }
+
+  cmd = read_cmd (r);
+
+  memory = grub_script_mem_record_stop (state, membackup);
+  script = grub_script_create (cmd, memory);
+  if (! script)
+    {
+      r->err = 1;
+      grub_script_mem_free (memory);
+    }
+  else
+    {
+      script->children = state->scripts;
+      script->text = copy;
+    }
+
+  state->scripts = scripts;
+  return script;
+}
+
+static struct grub_script_arg *
+read_arg (struct compiled_reader *r)
+{
+  struct grub_parser_param *state = r->state;
+  struct grub_script_arg *arg = 0;
+  grub_uint32_t nparts;
+
+  nparts = read_u32 (r);
+  if (! nparts)
+    r->err = 1;
+
+  while (nparts-- && ! r->err)
+    {
+      grub_uint8_t type = read_u8 (r);
+      const char *str = read_string (r);
+      struct grub_script_arg *part, *last;
+      struct grub_script *script = 0;
+
+      if (r->err || type > GRUB_SCRIPT_ARG_TYPE_BLOCK)
+	{
+	  r->err = 1;
+	  break;
+	}
+
+      if (type == GRUB_SCRIPT_ARG_TYPE_BLOCK)
+	script = read_script (r, str);
+
+      for (last = arg; last && last->next; last = last->next);
+      arg = grub_script_arg_add (state, arg, type, (char *) str);
+      for (part = arg; part && part->next; part = part->next);
+      if (! part || part == last)
+	{
+	  r->err = 1;
+	  grub_script_free (script);
+	  break;
+	}
+
+      part->script = script;
+      if (script)
+	{
+	  /* Append to the scripts of the enclosing block, like the
+	     parser does.  */
+	  struct grub_script *s = state->scripts;
+
+	  if (! s)
+	    state->scripts = script;
+	  else
+	    {
+	      while (s->next_siblings)
+		s = s->next_siblings;
+	      s->next_siblings = script;
+	    }
+	}
+    }
+
+  return arg;
+}
+
+static struct grub_script_arglist *
+read_arglist (struct compiled_reader *r)
+{
+  struct grub_script_arglist *list = 0;
+  grub_uint32_t nargs;
+
+  nargs = read_u32 (r);
+  while (nargs-- && ! r->err)
+    {
+      struct grub_script_arg *arg = read_arg (r);
+      struct grub_script_arglist *l;
+
+      l = grub_script_add_arglist (r->state, list, arg);
+      if (! l)
+	r->err = 1;
+      list = l;
+    }
+
+  return list;
+}
+
+static struct grub_script_cmd *
+read_cmd (struct compiled_reader *r)
+{
+  struct grub_parser_param *state = r->state;
+  struct grub_script_cmd *cmd = 0;
+  grub_uint8_t tag;
+
+  tag = read_u8 (r);
+  if (r->err)
+    return 0;
+
+  if (++r->depth > GRUB_SCRIPT_COMPILED_MAX_DEPTH)
+    {
+      r->err = 1;
+      r->depth--;
+      return 0;
+    }
+
+  switch (tag)
+    {
+    case CMD_NONE:
+      break;
+
+    case CMD_LIST:
+      {
+	grub_uint32_t count = read_u32 (r);
+
+	if (! count)
+	  r->err = 1;
+
+	while (count-- && ! r->err)
+	  {
+	    struct grub_script_cmd *c = read_cmd (r);
+
+	    /* Lists only ever hold plain commands.  */
+	    if (! c || c->exec == grub_script_execute_cmdlist)
+	      {
+		r->err = 1;
+		break;
+	      }
+	    cmd = grub_script_append_cmd (state, cmd, c);
+	    if (! cmd)
+	      r->err = 1;
+	  }
+	break;
+      }
+
+    case CMD_LINE:
+      {
+	struct grub_script_arglist *arglist = read_arglist (r);
+
+	cmd = grub_script_create_cmdline (state, arglist);
+	break;
+      }
+
+    case CMD_IF:
+      {
+	struct grub_script_cmd *cond, *on_true, *on_false;
+
+	cond = read_cmd (r);
+	on_true = read_cmd (r);
+	on_false = read_cmd (r);
+	cmd = grub_script_create_cmdif (state, cond, on_true, on_false);
+	break;
+      }
+
+    case CMD_FOR:
+      {
+	struct grub_script_arg *name;
+	struct grub_script_arglist *words;
+	struct grub_script_cmd *list;
+
+	name = read_arg (r);
+	words = read_arglist (r);
+	list = read_cmd (r);
+	cmd = grub_script_create_cmdfor (state, name, words, list);
+	break;
+      }
+
+    case CMD_WHILE:
+    case CMD_UNTIL:
+      {
+	struct grub_script_cmd *cond, *list;
+
+	cond = read_cmd (r);
+	list = read_cmd (r);
+	cmd = grub_script_create_cmdwhile (state, cond, list,
+					   tag == CMD_UNTIL);
+	break;
+      }
+
+    default:
+      r->err = 1;
+      break;
+    }
+
+  if (tag != CMD_NONE && ! cmd)
+    r->err = 1;
+
+  r->depth--;
+  return cmd;
+}
+
+/* One top level statement, with the functions defined by it.  */
+struct compiled_unit
+{
+  struct grub_script *script;
+  grub_uint32_t nfuncs;
+  struct grub_script_arg **names;
+  struct grub_script **funcs;
+};
+
+static void
+free_units (struct compiled_unit *units, grub_uint32_t nunits)
+{
+  grub_uint32_t i, j;
+
+  if (! units)
+    return;
+
+  for (i = 0; i < nunits; i++)
+    {
+      for (j = 0; j < units[i].nfuncs; j++)
+	grub_script_free (units[i].funcs[j]);
+      grub_free (units[i].names);
+      grub_free (units[i].funcs);
+      grub_script_free (units[i].script);
+    }
+  grub_free (units);
+}
+
+static void
+read_unit (struct compiled_reader *r, struct compiled_unit *unit)
+{
+  struct grub_parser_param *state = r->state;
+  struct grub_script_mem *membackup, *memory;
+  grub_uint32_t i, nfuncs;
+
+  grub_memset (state, 0, sizeof (*state));
+  membackup = grub_script_mem_record (state);
+
+  nfuncs = read_u32 (r);
+  if (nfuncs > (grub_size_t) (r->end - r->ptr))
+    r->err = 1;
+  else if (nfuncs)
+    {
+      unit->names = grub_zalloc (nfuncs * sizeof (unit->names[0]));
+      unit->funcs = grub_zalloc (nfuncs * sizeof (unit->funcs[0]));
+      if (! unit->names || ! unit->funcs)
+	r->err = 1;
+    }
+
+  for (i = 0; i < nfuncs && ! r->err; i++)
+    {
+      const char *name = read_string (r);
+
+      if (! name)
+	break;
+      unit->names[i] = grub_script_arg_add (state, 0,
+					    GRUB_SCRIPT_ARG_TYPE_TEXT,
+					    (char *) name);
+      unit->funcs[i] = read_script (r, 0);
+      unit->nfuncs = i + 1;
+      if (! unit->names[i] || ! unit->funcs[i])
+	r->err = 1;
+    }
+
+  state->parsed = read_cmd (r);
+
+  memory = grub_script_mem_record_stop (state, membackup);
+  unit->script = grub_script_create (state->parsed, memory);
+  if (! unit->script)
+    {
+      r->err = 1;
+      grub_script_mem_free (memory);
+      return;
+    }
+  unit->script->children = state->scripts;
+}
+
+/* Execute the compiled script IMAGE if it was made from SOURCE.  If the
+   image is stale or damaged, nothing is executed and an error is
+   returned, so that the caller can fall back to parsing SOURCE.  */
+grub_err_t
+grub_script_execute_compiled (const char *source, grub_size_t size,
+			      const void *image, grub_size_t image_size)
+{
+  const struct grub_script_compiled_header *head = image;
+  grub_uint8_t hash[GRUB_SCRIPT_COMPILED_HASH_SIZE];
+  struct grub_parser_param state;
+  struct compiled_reader r;
+  struct compiled_unit *units;
+  grub_uint32_t nunits, i, j;
+
+  if (image_size < sizeof (*head)
+      || grub_memcmp (head->magic, GRUB_SCRIPT_COMPILED_MAGIC,
+		      sizeof (head->magic)) != 0
+      || head->version != grub_cpu_to_le32_compile_time (GRUB_SCRIPT_COMPILED_VERSION))
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid compiled script");
+
+  if (grub_le_to_cpu64 (head->source_size) != size)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "compiled script is stale");
+
+  if (hash_source (source, size, hash))
+    return grub_errno;
+  if (grub_memcmp (hash, head->source_hash, sizeof (hash)) != 0)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "compiled script is stale");
+
+  r.ptr = (const grub_uint8_t *) (head + 1);
+  r.end = (const grub_uint8_t *) image + image_size;
+  r.depth = 0;
+  r.err = 0;
+  r.state = &state;
+
+  /* Every unit takes at least its function count and command tag.  */
+  nunits = grub_le_to_cpu32 (head->nunits);
+  if (nunits > (grub_size_t) (r.end - r.ptr) / 5)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid compiled script");
+  if (! nunits)
+    return GRUB_ERR_NONE;
+
+  units = grub_zalloc (nunits * sizeof (units[0]));
+  if (! units)
+    return grub_errno;
+
+  /* Load everything before running anything, so that a damaged image
+     doesn't leave the script half executed.  */
+  for (i = 0; i < nunits && ! r.err; i++)
+    read_unit (&r, &units[i]);
+
+  if (r.err || r.ptr != r.end)
+    {
+      free_units (units, nunits);
+      if (grub_errno)
+	return grub_errno;
+      return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid compiled script");
+    }
+
+  for (i = 0; i < nunits; i++)
+    {
+      struct compiled_unit *unit = &units[i];
+
+      /* Print an error, if any.  */
+      grub_print_error ();
+      grub_errno = GRUB_ERR_NONE;
+
+      for (j = 0; j < unit->nfuncs; j++)
+	{
+	  if (! grub_script_function_create (unit->names[j], unit->funcs[j]))
+	    grub_script_free (unit->funcs[j]);
+	  unit->funcs[j] = 0;
+	}
+
+      grub_script_execute (unit->script);
+      grub_script_unref (unit->script);
+      unit->script = 0;
+    }
+
+  free_units (units, nunits);
+
+  grub_print_error ();
+  grub_errno = GRUB_ERR_NONE;
+  return GRUB_ERR_NONE;
+}
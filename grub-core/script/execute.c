@@ -77,6 +77,15 @@ wildcard_escape (const char *s)
   return p;
 }
 
+static int
+has_wildcard (const char *s)
+{
+  for (; *s; s++)
+    if (*s == '*' || *s == '\\' || *s == '?')
+      return 1;
+  return 0;
+}
+
 static char*
 wildcard_unescape (const char *s)
 {
@@ -629,6 +638,15 @@ grub_script_arglist_to_argv (struct grub_script_arglist *arglist,
       if (grub_script_argv_next (&result))
 	goto fail;
 
+      /* Constant arguments were expanded by the parser already.  */
+      if (arglist->value)
+	{
+	  if (grub_script_argv_append (&result, arglist->value,
+				       grub_strlen (arglist->value)))
+	    goto fail;
+	  continue;
+	}
+
       arg = arglist->arg;
       while (arg)
 	{
@@ -758,6 +776,16 @@ cleanup:
   int failed = 0;
   struct grub_script_argv unexpanded = result;
 
+  /* Words without wildcards or escapes expand to themselves.  */
+  for (i = 0; unexpanded.args[i]; i++)
+    if (has_wildcard (unexpanded.args[i]))
+      break;
+  if (! unexpanded.args[i])
+    {
+      *argv = result;
+      return 0;
+    }
+
   result.argc = 0;
   result.args = 0;
   for (i = 0; unexpanded.args[i]; i++)
@@ -921,6 +949,29 @@ grub_script_execute_new_scope (const char *source, int argc, char **args)
   return ret;
 }
 
+/* Execute a parsed script in new scope.  */
+grub_err_t
+grub_script_execute_parsed_new_scope (struct grub_script *script,
+				      int argc, char **args)
+{
+  grub_err_t ret = 0;
+  struct grub_script_scope new_scope;
+  struct grub_script_scope *old_scope;
+
+  new_scope.argv.argc = argc;
+  new_scope.argv.args = args;
+  new_scope.flags = 0;
+  new_scope.shifts = 0;
+
+  old_scope = scope;
+  scope = &new_scope;
+
+  ret = grub_script_execute (script);
+
+  replace_scope (old_scope); /* free any scopes by setparams */
+  return ret;
+}
+
 /* Execute a single command line.  */
 grub_err_t
 grub_script_execute_cmdline (struct grub_script_cmd *cmd)
@@ -979,8 +1030,18 @@ grub_script_execute_cmdline (struct grub_script_cmd *cmd)
       args = argv.args + 2;
       cmdname = argv.args[1];
     }
-  grubcmd = grub_command_find (cmdname);
-  if (! grubcmd)
+  /* Reuse the previous lookup if the command name is constant and no
+     command or function has been added or removed since.  */
+  if ((cmdline->grubcmd || cmdline->func)
+      && cmdline->command_generation == grub_command_generation
+      && cmdline->function_generation == grub_script_function_generation)
+    {
+      grubcmd = cmdline->grubcmd;
+      func = cmdline->func;
+    }
+  else
+    grubcmd = grub_command_find (cmdname);
+  if (! grubcmd && ! func)
     {
       grub_errno = GRUB_ERR_NONE;
 
@@ -1014,6 +1075,15 @@ grub_script_execute_cmdline (struct grub_script_cmd *cmd)
 	}
     }
 
+  if (cmdline->arglist->value
+      && (! invert || cmdline->arglist->next->value))
+    {
+      cmdline->grubcmd = grubcmd;
+      cmdline->func = func;
+      cmdline->command_generation = grub_command_generation;
+      cmdline->function_generation = grub_script_function_generation;
+    }
+
   /* Execute the GRUB command or function.  */
   if (grubcmd)
     {
@@ -23,6 +23,7 @@
 #include <grub/charset.h>
 
 grub_script_function_t grub_script_function_list;
+unsigned long grub_script_function_generation;
 
 grub_script_function_t
 grub_script_function_create (struct grub_script_arg *functionname_arg,
@@ -71,6 +72,8 @@ grub_script_function_create (struct grub_script_arg *functionname_arg,
       *p = func;
     }
 
+  grub_script_function_generation++;
+
   return func;
 }
 
@@ -86,6 +89,7 @@ grub_script_function_remove (const char *name)
 	grub_free (q->name);
 	grub_script_free (q->func);
         grub_free (q);
+	grub_script_function_generation++;
         break;
       }
 }
@@ -193,15 +193,19 @@ block: "{"
 	 struct grub_script_mem *memory;
 	 struct grub_script *s = $<scripts>2;
 
-	 memory = grub_script_mem_record_stop (state, $<memory>2);
+         /* The text is kept with the block, which may outlive this
+	    script.  */
          if ((p = grub_script_lexer_record_stop (state, $<offset>2)))
 	   *grub_strrchr (p, '}') = '\0';
+	 memory = grub_script_mem_record_stop (state, $<memory>2);
 
 	 $$ = grub_script_arg_add (state, 0, GRUB_SCRIPT_ARG_TYPE_BLOCK, p);
 	 if (! $$ || ! ($$->script = grub_script_create ($3, memory)))
 	   grub_script_mem_free (memory);
 
 	 else {
+	   $$->script->text = p;
+
 	   /* attach nested scripts to $$->script as children */
 	   $$->script->children = state->scripts;
 
@@ -289,7 +293,10 @@ function: "function" "name"
 	      grub_script_mem_free (state->func_mem);
 	    else {
 	      script->children = state->scripts;
-	      grub_script_function_create ($2, script);
+	      if (grub_script_function_create ($2, script))
+		state->functions = grub_script_add_arglist (state,
+							    state->functions,
+							    $2);
 	    }
 
 	    state->scripts = $<scripts>3;
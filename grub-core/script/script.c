@@ -150,6 +150,52 @@ grub_script_arg_add (struct grub_parser_param *state,
   return arg;
 }
 
+/* Return the expanded value of ARG if it consists of text and quoted
+   strings only, without characters that are special to wildcard
+   expansion.  Otherwise return 0.  */
+static char *
+grub_script_arg_value (struct grub_parser_param *state,
+		       struct grub_script_arg *arg)
+{
+  struct grub_script_arg *part;
+  grub_size_t len = 0;
+  int quoted = 0;
+  char *value, *p;
+
+  for (part = arg; part; part = part->next)
+    {
+      switch (part->type)
+	{
+	case GRUB_SCRIPT_ARG_TYPE_DQSTR:
+	case GRUB_SCRIPT_ARG_TYPE_SQSTR:
+	  quoted = 1;
+	  /* Fall through.  */
+	case GRUB_SCRIPT_ARG_TYPE_TEXT:
+	  if (grub_strchr (part->str, '*') || grub_strchr (part->str, '?')
+	      || grub_strchr (part->str, '\\'))
+	    return 0;
+	  len += grub_strlen (part->str);
+	  break;
+
+	default:
+	  return 0;
+	}
+    }
+
+  /* An empty unquoted word does not make an argument.  */
+  if (! len && ! quoted)
+    return 0;
+
+  value = grub_script_malloc (state, len + 1);
+  if (! value)
+    return 0;
+
+  for (p = value, part = arg; part; part = part->next)
+    p = grub_stpcpy (p, part->str);
+
+  return value;
+}
+
 /* Add the argument ARG to the end of the argument list LIST.  If LIST
    is zero, a new list will be created.  */
 struct grub_script_arglist *
@@ -169,6 +215,7 @@ grub_script_add_arglist (struct grub_parser_param *state,
 
   link->next = 0;
   link->arg = arg;
+  link->value = grub_script_arg_value (state, arg);
   link->argcount = 0;
 
   if (!list)
@@ -204,6 +251,8 @@ grub_script_create_cmdline (struct grub_parser_param *state,
   cmd->cmd.exec = grub_script_execute_cmdline;
   cmd->cmd.next = 0;
   cmd->arglist = arglist;
+  cmd->grubcmd = 0;
+  cmd->func = 0;
 
   return (struct grub_script_cmd *) cmd;
 }
@@ -333,6 +382,8 @@ grub_script_create (struct grub_script_cmd *cmd, struct grub_script_mem *mem)
   parsed->refcnt = 0;
   parsed->children = 0;
   parsed->next_siblings = 0;
+  parsed->functions = 0;
+  parsed->text = 0;
 
   return parsed;
 }
@@ -388,6 +439,7 @@ grub_script_parse (char *script,
   parsed->mem = grub_script_mem_record_stop (parsestate, membackup);
   parsed->cmd = parsestate->parsed;
   parsed->children = parsestate->scripts;
+  parsed->functions = parsestate->functions;
 
   grub_script_lexer_fini (lexstate);
   grub_free (parsestate);
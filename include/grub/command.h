@@ -79,6 +79,8 @@ struct grub_command
 typedef struct grub_command *grub_command_t;
 
 extern grub_command_t EXPORT_VAR(grub_command_list);
+/* Incremented whenever a command is registered or unregistered.  */
+extern unsigned long EXPORT_VAR(grub_command_generation);
 
 grub_command_t
 EXPORT_FUNC(grub_register_command_prio) (const char *name,
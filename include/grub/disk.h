@@ -175,9 +175,13 @@ typedef struct grub_disk_memberlist *grub_disk_memberlist_t;
 
 /* This is called from the memory manager.  */
 void grub_disk_cache_invalidate_all (void);
+/* Incremented whenever the disk cache is invalidated.  */
+extern unsigned long EXPORT_VAR(grub_disk_cache_generation);
 
 void EXPORT_FUNC(grub_disk_dev_register) (grub_disk_dev_t dev);
 void EXPORT_FUNC(grub_disk_dev_unregister) (grub_disk_dev_t dev);
+/* Incremented whenever the set of available disks may have changed.  */
+extern unsigned long EXPORT_VAR(grub_disk_dev_generation);
 static inline int
 grub_disk_dev_iterate (grub_disk_dev_iterate_hook_t hook, void *hook_data)
 {
@@ -213,7 +217,7 @@ extern grub_err_t (*EXPORT_VAR(grub_disk_write_weak)) (grub_disk_t disk,
 
 grub_uint64_t EXPORT_FUNC(grub_disk_get_size) (grub_disk_t disk);
 
-#if DISK_CACHE_STATS
+#if DISK_CACHE_STATS || defined (GRUB_UTIL)
 void
 EXPORT_FUNC(grub_disk_cache_get_performance) (unsigned long *hits, unsigned long *misses);
 #endif
@@ -22,6 +22,7 @@
 
 #include <grub/types.h>
 #include <grub/list.h>
+#include <grub/disk.h>
 
 enum
   {
@@ -153,6 +154,7 @@ grub_diskfilter_register_front (grub_diskfilter_t diskfilter)
 {
   grub_list_push (GRUB_AS_LIST_P (&grub_diskfilter_list),
 		  GRUB_AS_LIST (diskfilter));
+  grub_disk_dev_generation++;
 }
 
 static inline void
@@ -163,11 +165,13 @@ grub_diskfilter_register_back (grub_diskfilter_t diskfilter)
   diskfilter->next = NULL;
   diskfilter->prev = q;
   *q = diskfilter;
+  grub_disk_dev_generation++;
 }
 static inline void
 grub_diskfilter_unregister (grub_diskfilter_t diskfilter)
 {
   grub_list_remove (GRUB_AS_LIST (diskfilter));
+  grub_disk_dev_generation++;
 }
 
 struct grub_diskfilter_vg *
@@ -189,6 +193,23 @@ typedef grub_err_t (*grub_raid6_recover_func_t) (struct grub_diskfilter_segment
 extern grub_raid5_recover_func_t grub_raid5_recover_func;
 extern grub_raid6_recover_func_t grub_raid6_recover_func;
 
+/* Read SIZE bytes at SECTOR from member DISKNR of the array DATA, for
+   the generic recovery functions.  */
+typedef grub_err_t (*grub_raid_recover_read_t) (void *data, int disknr,
+						grub_disk_addr_t sector,
+						void *buf, grub_size_t size);
+
+grub_err_t
+grub_raid5_recover_gen (void *data, grub_uint64_t nstripes, int disknr,
+			char *buf, grub_disk_addr_t sector, grub_size_t size,
+			grub_raid_recover_read_t read_func);
+
+grub_err_t
+grub_raid6_recover_gen (void *data, grub_uint64_t nstripes, int disknr,
+			int p, char *buf, grub_disk_addr_t sector,
+			grub_size_t size, int layout,
+			grub_raid_recover_read_t read_func);
+
 grub_err_t grub_diskfilter_vg_register (struct grub_diskfilter_vg *vg);
 
 grub_err_t
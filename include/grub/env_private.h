@@ -21,14 +21,26 @@
 
 #include <grub/env.h>
 
-/* The size of the hash table.  */
-#define	HASHSZ	13
-
-/* A hashtable for quick lookup of variables.  */
+/* The initial size of the hash table, a power of two.  */
+#define	GRUB_ENV_INITIAL_HASHSZ	16
+
+/* A hashtable for quick lookup of variables.  A context sees its own
+   variables and those exported by the outer contexts, without copying
+   them: a variable is copied to the current context only when it is
+   modified there.  A variable without value hides the one of the same
+   name in the outer contexts.  */
 struct grub_env_context
 {
-  /* A hash table for variables.  */
-  struct grub_env_var *vars[HASHSZ];
+  /* A hash table for variables, with SIZE buckets.  */
+  struct grub_env_var **vars;
+  grub_size_t size;
+
+  /* The number of variables in the table.  */
+  grub_size_t count;
+
+  /* If set, all variables of the outer context are visible, not only
+     the exported ones.  */
+  int inherit_all;
 
   /* One level deeper on the stack.  */
   struct grub_env_context *prev;
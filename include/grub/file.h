@@ -68,6 +68,7 @@ extern grub_disk_read_hook_t EXPORT_VAR(grub_file_progress_hook);
 /* Filters with lower ID are executed first.  */
 typedef enum grub_file_filter_id
   {
+    GRUB_FILE_FILTER_BLOCKMAP,
     GRUB_FILE_FILTER_PUBKEY,
     GRUB_FILE_FILTER_GZIO,
     GRUB_FILE_FILTER_XZIO,
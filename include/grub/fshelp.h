@@ -73,6 +73,77 @@ EXPORT_FUNC(grub_fshelp_find_file_lookup) (const char *path,
 					   char *(*read_symlink) (grub_fshelp_node_t node),
 					   enum grub_fshelp_filetype expect);
 
+/* Caches that filesystems keep across mounts are tied to a volume and
+   must be dropped together with the disk cache, since the disk may have
+   been written or swapped in the meantime, and whenever disks come or
+   go, since a volume key may then name another volume.  */
+
+/* The volume a cached item belongs to.  */
+struct grub_fshelp_volume
+{
+  enum grub_disk_dev_id dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t start;
+};
+
+/* What a cache was filled under, initially all zeros.  */
+struct grub_fshelp_cache_generation
+{
+  unsigned long disk;
+  unsigned long dev;
+};
+
+/* Set VOL to the volume starting OFFSET sectors into DISK.  */
+void EXPORT_FUNC(grub_fshelp_volume_init) (struct grub_fshelp_volume *vol,
+					   grub_disk_t disk,
+					   grub_disk_addr_t offset);
+
+int EXPORT_FUNC(grub_fshelp_volume_eq) (const struct grub_fshelp_volume *a,
+					const struct grub_fshelp_volume *b);
+
+/* Return 1 if a cache filled under GEN must be dropped, and bring GEN up
+   to date.  */
+int EXPORT_FUNC(grub_fshelp_cache_changed) (struct grub_fshelp_cache_generation *gen);
+
+/* How a filesystem's nodes are kept in the directory cache across mounts
+   of the same volume.  */
+struct grub_fshelp_dcache_ops
+{
+  /* The size of NODE in bytes, or 0 if it can't be cached.  */
+  grub_size_t (*node_size) (grub_fshelp_node_t node);
+  /* Make the copy NODE belong to the mount ROOT is the root node of.  */
+  void (*node_rebind) (grub_fshelp_node_t node, grub_fshelp_node_t root);
+};
+
+/* Like grub_fshelp_find_file_lookup, but keep the nodes found in the
+   directory cache.  DISK is the disk the filesystem is on.  */
+grub_err_t
+EXPORT_FUNC(grub_fshelp_find_file_cached) (const char *path,
+					   grub_fshelp_node_t rootnode,
+					   grub_fshelp_node_t *foundnode,
+					   grub_err_t (*lookup_file) (grub_fshelp_node_t dir,
+								      const char *name,
+								      grub_fshelp_node_t *foundnode,
+								      enum grub_fshelp_filetype *foundtype),
+					   char *(*read_symlink) (grub_fshelp_node_t node),
+					   enum grub_fshelp_filetype expect,
+					   grub_disk_t disk,
+					   const struct grub_fshelp_dcache_ops *dcache);
+
+/* Like grub_fshelp_find_file, but keep the nodes found in the directory
+   cache.  DISK is the disk the filesystem is on.  */
+grub_err_t
+EXPORT_FUNC(grub_fshelp_find_file_iterate_cached) (const char *path,
+						   grub_fshelp_node_t rootnode,
+						   grub_fshelp_node_t *foundnode,
+						   int (*iterate_dir) (grub_fshelp_node_t dir,
+								       grub_fshelp_iterate_dir_hook_t hook,
+								       void *hook_data),
+						   char *(*read_symlink) (grub_fshelp_node_t node),
+						   enum grub_fshelp_filetype expect,
+						   grub_disk_t disk,
+						   const struct grub_fshelp_dcache_ops *dcache);
+
 /* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
    beginning with the block POS.  READ_HOOK should be set before
    reading a block from the file.  GET_BLOCK is used to translate file
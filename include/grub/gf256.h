@@ -0,0 +1,48 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_GF256_HEADER
+#define GRUB_GF256_HEADER 1
+
+#include <grub/types.h>
+
+/* Arithmetic in GF(2^8) modulo x^8 + x^4 + x^3 + x^2 + 1, as used by
+   RAID 6 and RAID-Z parity.  */
+
+/* x**n.  */
+grub_uint8_t grub_gf256_pow (unsigned n);
+/* Such an n that x**n = a, for a != 0.  */
+unsigned grub_gf256_log (grub_uint8_t a);
+grub_uint8_t grub_gf256_mul (grub_uint8_t a, grub_uint8_t b);
+/* Inverse of a != 0.  */
+grub_uint8_t grub_gf256_inv (grub_uint8_t a);
+
+/* The region functions look each byte up in a 256-byte product table.
+   There are no SSSE3 or AVX2 variants because GRUB is built without SSE
+   on x86 and cannot count on it at run time.  RAID 6 recovery, which
+   btrfs uses too, and RAID-Z both go through them, so a faster kernel
+   only needs adding here.  */
+
+/* buf[i] = buf[i] * c.  */
+void grub_gf256_mul_region (grub_uint8_t *buf, grub_uint8_t c,
+			    grub_size_t size);
+/* dst[i] ^= src[i] * c.  */
+void grub_gf256_muladd_region (grub_uint8_t *dst, const grub_uint8_t *src,
+			       grub_uint8_t c, grub_size_t size);
+
+#endif
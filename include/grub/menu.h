@@ -20,6 +20,8 @@
 #ifndef GRUB_MENU_HEADER
 #define GRUB_MENU_HEADER 1
 
+struct grub_script;
+
 struct grub_menu_entry_class
 {
   char *name;
@@ -47,9 +49,14 @@ struct grub_menu_entry
      E.classes->next is the first class if it is not NULL.  */
   struct grub_menu_entry_class *classes;
 
-  /* The sourcecode of the menu entry, used by the editor.  */
+  /* The sourcecode of the menu entry, used by the editor.  For entries
+     defined with a block it is only built when needed, so use
+     grub_menu_entry_get_sourcecode to access it.  */
   const char *sourcecode;
 
+  /* The parsed block, if the entry was defined with one.  */
+  struct grub_script *script;
+
   /* Parameters to be passed to menu definition.  */
   int argc;
   char **args;
@@ -95,6 +102,7 @@ typedef struct grub_menu_execute_callback
 *grub_menu_execute_callback_t;
 
 grub_menu_entry_t grub_menu_get_entry (grub_menu_t menu, int no);
+const char *grub_menu_entry_get_sourcecode (grub_menu_entry_t entry);
 int grub_menu_get_timeout (void);
 void grub_menu_set_timeout (int timeout);
 void grub_menu_entry_run (grub_menu_entry_t entry);
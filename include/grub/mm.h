@@ -37,6 +37,12 @@ void *EXPORT_FUNC(grub_realloc) (void *ptr, grub_size_t size);
 void *EXPORT_FUNC(grub_memalign) (grub_size_t align, grub_size_t size);
 #endif
 
+#if defined (GRUB_UTIL) || defined (GRUB_MACHINE_EMU)
+/* Number and total size of allocations made so far.  */
+extern unsigned long EXPORT_VAR(grub_mm_alloc_count);
+extern grub_uint64_t EXPORT_VAR(grub_mm_alloc_bytes);
+#endif
+
 void grub_mm_check_real (const char *file, int line);
 #define grub_mm_check() grub_mm_check_real (GRUB_FILE, __LINE__);
 
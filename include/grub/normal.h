@@ -144,8 +144,8 @@ grub_err_t
 grub_normal_add_menu_entry (int argc, const char **args, char **classes,
 			    const char *id,
 			    const char *users, const char *hotkey,
-			    const char *prefix, const char *sourcecode,
-			    int submenu);
+			    const char *sourcecode,
+			    struct grub_script *script, int submenu);
 
 grub_err_t
 grub_normal_set_password (const char *user, const char *password);
@@ -127,6 +127,14 @@ struct grub_ntfs_bpb
   grub_uint32_t checksum;
 } GRUB_PACKED;
 
+/* A decoded data run.  LCN 0 marks a sparse run.  */
+struct grub_ntfs_run
+{
+  grub_uint64_t vcn;
+  grub_uint64_t count;
+  grub_disk_addr_t lcn;
+};
+
 struct grub_ntfs_attr
 {
   int flags;
@@ -135,6 +143,10 @@ struct grub_ntfs_attr
   grub_uint32_t save_pos;
   grub_uint8_t *sbuf;
   struct grub_ntfs_file *mft;
+  /* Runs of the attribute record RUNS_ATTR.  */
+  grub_uint8_t *runs_attr;
+  struct grub_ntfs_run *runs;
+  grub_size_t num_runs;
 };
 
 struct grub_ntfs_file
@@ -156,8 +168,11 @@ struct grub_ntfs_data
   grub_uint64_t mft_size;
   grub_uint64_t idx_size;
   int log_spc;
+  int log_idx_vcn;
   grub_uint64_t mft_start;
   grub_uint64_t uuid;
+  grub_uint16_t *upcase;
+  int upcase_read;
 };
 
 struct grub_ntfs_comp_table_element
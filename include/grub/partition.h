@@ -21,6 +21,7 @@
 
 #include <grub/dl.h>
 #include <grub/list.h>
+#include <grub/disk.h>
 
 struct grub_disk;
 
@@ -105,6 +106,7 @@ grub_partition_map_register (grub_partition_map_t partmap)
 {
   grub_list_push (GRUB_AS_LIST_P (&grub_partition_map_list),
 		  GRUB_AS_LIST (partmap));
+  grub_disk_dev_generation++;
 }
 #endif
 
@@ -112,6 +114,7 @@ static inline void
 grub_partition_map_unregister (grub_partition_map_t partmap)
 {
   grub_list_remove (GRUB_AS_LIST (partmap));
+  grub_disk_dev_generation++;
 }
 
 #define FOR_PARTITION_MAPS(var) FOR_LIST_ELEMENTS((var), (grub_partition_map_list))
@@ -47,6 +47,12 @@ struct grub_script
   /* grub_scripts from block arguments.  */
   struct grub_script *next_siblings;
   struct grub_script *children;
+
+  /* Names of the functions defined while parsing this script.  */
+  struct grub_script_arglist *functions;
+
+  /* For a block argument, its text without the braces.  It lives in MEM.  */
+  const char *text;
 };
 
 typedef enum
@@ -96,6 +102,8 @@ struct grub_script_arglist
 {
   struct grub_script_arglist *next;
   struct grub_script_arg *arg;
+  /* The expanded argument if it does not depend on variables, or 0.  */
+  char *value;
   /* Only stored in the first link.  */
   int argcount;
 };
@@ -107,6 +115,13 @@ struct grub_script_cmdline
 
   /* The arguments for this command.  */
   struct grub_script_arglist *arglist;
+
+  /* The command or function found for a constant command name, valid
+     while the generations are unchanged.  */
+  grub_command_t grubcmd;
+  struct grub_script_function *func;
+  unsigned long command_generation;
+  unsigned long function_generation;
 };
 
 /* An if statement.  */
@@ -236,6 +251,9 @@ struct grub_parser_param
   /* The result of the parser.  */
   struct grub_script_cmd *parsed;
 
+  /* The names of the functions defined by the parsed script.  */
+  struct grub_script_arglist *functions;
+
   struct grub_lexer_param *lexerstate;
 };
 
@@ -331,6 +349,8 @@ grub_err_t grub_script_execute_cmdwhile (struct grub_script_cmd *cmd);
 grub_err_t grub_script_execute (struct grub_script *script);
 grub_err_t grub_script_execute_sourcecode (const char *source);
 grub_err_t grub_script_execute_new_scope (const char *source, int argc, char **args);
+grub_err_t grub_script_execute_parsed_new_scope (struct grub_script *script,
+						 int argc, char **args);
 
 /* Break command for loops.  */
 grub_err_t grub_script_break (grub_command_t cmd, int argc, char *argv[]);
@@ -370,6 +390,8 @@ struct grub_script_function
 typedef struct grub_script_function *grub_script_function_t;
 
 extern grub_script_function_t grub_script_function_list;
+/* Incremented whenever a function is created or removed.  */
+extern unsigned long grub_script_function_generation;
 
 #define FOR_SCRIPT_FUNCTIONS(var) for((var) = grub_script_function_list; \
 				      (var); (var) = (var)->next)
@@ -390,6 +412,24 @@ grub_normal_parse_line (char *line,
 			grub_reader_getline_t getline_func,
 			void *getline_func_data);
 
+/* Pre-parsed ("compiled") scripts, stored next to the source file.  */
+#define GRUB_SCRIPT_COMPILED_SUFFIX	".ast"
+
+/* State for reading a script held in memory line by line.  */
+struct grub_script_source
+{
+  const char *ptr;
+  const char *end;
+};
+
+grub_err_t grub_script_source_getline (char **line, int cont, void *data);
+
+grub_err_t grub_script_compile (const char *source, grub_size_t size,
+				void **image, grub_size_t *image_size);
+grub_err_t grub_script_execute_compiled (const char *source, grub_size_t size,
+					 const void *image,
+					 grub_size_t image_size);
+
 static inline struct grub_script *
 grub_script_ref (struct grub_script *script)
 {
@@ -0,0 +1,86 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <grub/test.h>
+#include <grub/gf256.h>
+
+#define BUFSIZE 1031
+
+/* Shift-and-add multiplication, independent of the tables.  */
+static grub_uint8_t
+slow_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  grub_uint8_t r = 0;
+
+  while (b)
+    {
+      if (b & 1)
+	r ^= a;
+      a = (a << 1) ^ ((a & 0x80) ? 0x1d : 0);
+      b >>= 1;
+    }
+
+  return r;
+}
+
+static void
+gf256_test (void)
+{
+  static grub_uint8_t src[BUFSIZE + 1], dst[BUFSIZE + 1], ref[BUFSIZE + 1];
+  unsigned a, b, i;
+
+  for (a = 0; a < 256; a++)
+    for (b = 0; b < 256; b++)
+      grub_test_assert (grub_gf256_mul (a, b) == slow_mul (a, b),
+			"%u * %u", a, b);
+
+  for (a = 1; a < 256; a++)
+    {
+      grub_test_assert (grub_gf256_mul (a, grub_gf256_inv (a)) == 1,
+			"inverse of %u", a);
+      grub_test_assert (grub_gf256_pow (grub_gf256_log (a)) == a,
+			"logarithm of %u", a);
+    }
+
+  for (i = 0; i < sizeof (src); i++)
+    src[i] = random ();
+
+  /* Odd sizes and offsets exercise the unaligned heads and tails.  */
+  for (a = 0; a < 256; a++)
+    {
+      unsigned off = a & 1, size = BUFSIZE - (a % 7);
+
+      for (i = 0; i < sizeof (dst); i++)
+	dst[i] = ref[i] = random ();
+      for (i = 0; i < size; i++)
+	ref[i + off] ^= slow_mul (src[i], a);
+      grub_gf256_muladd_region (dst + off, src, a, size);
+      grub_test_assert (memcmp (dst, ref, sizeof (dst)) == 0,
+			"multiply-add by %u", a);
+
+      for (i = 0; i < size; i++)
+	ref[i + off] = slow_mul (ref[i + off], a);
+      grub_gf256_mul_region (dst + off, a, size);
+      grub_test_assert (memcmp (dst, ref, sizeof (dst)) == 0,
+			"multiply by %u", a);
+    }
+}
+
+GRUB_UNIT_TEST ("gf256_unit_test", gf256_test);
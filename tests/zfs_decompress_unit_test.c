@@ -0,0 +1,265 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <grub/test.h>
+#include <grub/err.h>
+
+extern grub_err_t lzjb_decompress (void *, void *, grub_size_t, grub_size_t);
+extern grub_err_t lz4_decompress (void *, void *, grub_size_t, grub_size_t);
+
+#define MAXSIZE		(1 << 20)
+#define GUARD		64
+#define HASHSZ		4096
+
+static grub_uint8_t orig[MAXSIZE];
+static grub_uint8_t comp[MAXSIZE + MAXSIZE / 8 + 64];
+static grub_uint8_t out[MAXSIZE + GUARD];
+static long table[HASHSZ];
+
+static unsigned
+hash3 (const grub_uint8_t *p)
+{
+  return ((p[0] << 16) ^ (p[1] << 8) ^ p[2]) * 2654435761U >> 20;
+}
+
+/* Plain greedy LZJB encoder, as in the ZFS sources.  */
+static grub_size_t
+lzjb_compress (const grub_uint8_t *src, grub_uint8_t *dst, grub_size_t len)
+{
+  grub_uint8_t *d = dst, *copymap = 0;
+  grub_size_t i = 0;
+  int copymask = 1 << 7;
+
+  memset (table, 0xff, sizeof (table));
+
+  while (i < len)
+    {
+      unsigned h;
+      long cand;
+      grub_size_t mlen;
+
+      if ((copymask <<= 1) == (1 << 8))
+	{
+	  copymask = 1;
+	  copymap = d;
+	  *d++ = 0;
+	}
+      if (i + 3 > len)
+	{
+	  *d++ = src[i++];
+	  continue;
+	}
+
+      h = hash3 (src + i) % HASHSZ;
+      cand = table[h];
+      table[h] = i;
+      if (cand < 0 || i - cand > 1023 || memcmp (src + cand, src + i, 3) != 0)
+	{
+	  *d++ = src[i++];
+	  continue;
+	}
+
+      for (mlen = 3; mlen < 66 && i + mlen < len
+	     && src[cand + mlen] == src[i + mlen]; mlen++)
+	;
+      *copymap |= copymask;
+      *d++ = ((mlen - 3) << 2) | ((i - cand) >> 8);
+      *d++ = (i - cand) & 0xff;
+      i += mlen;
+    }
+
+  return d - dst;
+}
+
+static grub_uint8_t *
+lz4_put_length (grub_uint8_t *d, grub_size_t n)
+{
+  for (; n >= 255; n -= 255)
+    *d++ = 255;
+  *d++ = n;
+  return d;
+}
+
+static grub_uint8_t *
+lz4_put_sequence (grub_uint8_t *d, const grub_uint8_t *lit,
+		  grub_size_t litlen, grub_size_t offset, grub_size_t mlen)
+{
+  grub_uint8_t *token = d++;
+
+  *token = (litlen < 15 ? litlen : 15) << 4;
+  if (litlen >= 15)
+    d = lz4_put_length (d, litlen - 15);
+  memcpy (d, lit, litlen);
+  d += litlen;
+  if (! mlen)
+    return d;
+
+  *d++ = offset & 0xff;
+  *d++ = offset >> 8;
+  mlen -= 4;
+  *token |= mlen < 15 ? mlen : 15;
+  if (mlen >= 15)
+    d = lz4_put_length (d, mlen - 15);
+  return d;
+}
+
+/*
+ * Greedy LZ4 block encoder with the ZFS size header.  It honours the
+ * end-of-block rules: the last match starts at least 12 bytes and ends
+ * at least 5 bytes before the end.
+ */
+static grub_size_t
+lz4_compress (const grub_uint8_t *src, grub_uint8_t *dst, grub_size_t len)
+{
+  grub_uint8_t *d = dst + 4;
+  grub_size_t i = 0, anchor = 0, size;
+
+  memset (table, 0xff, sizeof (table));
+
+  while (i + 12 < len)
+    {
+      unsigned h = hash3 (src + i) % HASHSZ;
+      long cand = table[h];
+      grub_size_t mlen;
+
+      table[h] = i;
+      if (cand < 0 || i - cand > 65535 || memcmp (src + cand, src + i, 4) != 0)
+	{
+	  i++;
+	  continue;
+	}
+
+      for (mlen = 4; i + mlen < len - 5
+	     && src[cand + mlen] == src[i + mlen]; mlen++)
+	;
+      d = lz4_put_sequence (d, src + anchor, i - anchor, i - cand, mlen);
+      i += mlen;
+      anchor = i;
+    }
+  d = lz4_put_sequence (d, src + anchor, len - anchor, 0, 0);
+
+  size = d - dst - 4;
+  dst[0] = size >> 24;
+  dst[1] = size >> 16;
+  dst[2] = size >> 8;
+  dst[3] = size;
+  return d - dst;
+}
+
+/* Fill with a mix of literals, long matches and short-period runs.  */
+static void
+fill (grub_uint8_t *buf, grub_size_t len, unsigned seed)
+{
+  grub_size_t i = 0;
+
+  srandom (seed);
+  while (i < len)
+    {
+      grub_size_t run = random () % 300 + 1, j;
+      unsigned period = random () % 24 + 1;
+
+      if (run > len - i)
+	run = len - i;
+      switch (random () % 4)
+	{
+	case 0:
+	  for (j = 0; j < run; j++)
+	    buf[i + j] = random ();
+	  break;
+	case 1:
+	  if (i < period)
+	    period = i ? i : 1;
+	  for (j = 0; j < run; j++)
+	    buf[i + j] = i >= period ? buf[i + j - period] : 'a';
+	  break;
+	case 2:
+	  {
+	    grub_size_t from = i ? random () % i : 0;
+
+	    for (j = 0; j < run; j++)
+	      buf[i + j] = i ? buf[from + j] : 0;
+	  }
+	  break;
+	default:
+	  for (j = 0; j < run; j++)
+	    buf[i + j] = "the quick brown fox "[(i + j) % 20];
+	  break;
+	}
+      i += run;
+    }
+}
+
+typedef grub_err_t (*decompress_t) (void *, void *, grub_size_t, grub_size_t);
+typedef grub_size_t (*compress_t) (const grub_uint8_t *, grub_uint8_t *,
+				   grub_size_t);
+
+static void
+roundtrip (const char *name, compress_t compress, decompress_t decompress,
+	   grub_size_t len, unsigned seed)
+{
+  grub_size_t clen, i;
+  grub_err_t err;
+
+  fill (orig, len, seed);
+  clen = compress (orig, comp, len);
+  memset (out, 0xa5, sizeof (out));
+
+  err = decompress (comp, out, clen, len);
+  grub_test_assert (err == GRUB_ERR_NONE, "%s: %u bytes, seed %u failed",
+		    name, (unsigned) len, seed);
+  grub_errno = GRUB_ERR_NONE;
+  grub_test_assert (memcmp (orig, out, len) == 0,
+		    "%s: %u bytes, seed %u mismatch",
+		    name, (unsigned) len, seed);
+  for (i = len; i < len + GUARD; i++)
+    if (out[i] != 0xa5)
+      break;
+  grub_test_assert (i == len + GUARD, "%s: %u bytes, seed %u overrun",
+		    name, (unsigned) len, seed);
+
+  /* A short output buffer must not be written past its end.  */
+  memset (out, 0xa5, sizeof (out));
+  decompress (comp, out, clen, len / 2);
+  grub_errno = GRUB_ERR_NONE;
+  for (i = len / 2; i < len / 2 + GUARD; i++)
+    if (out[i] != 0xa5)
+      break;
+  grub_test_assert (i == len / 2 + GUARD,
+		    "%s: %u bytes, seed %u overrun on short output",
+		    name, (unsigned) len, seed);
+}
+
+static void
+zfs_decompress_test (void)
+{
+  static const grub_size_t sizes[] =
+    { 1, 2, 3, 7, 8, 9, 12, 13, 15, 16, 17, 31, 32, 33, 100, 511, 4096,
+      65537, MAXSIZE };
+  unsigned i, seed;
+
+  for (i = 0; i < ARRAY_SIZE (sizes); i++)
+    for (seed = 1; seed <= 8; seed++)
+      {
+	roundtrip ("lzjb", lzjb_compress, lzjb_decompress, sizes[i], seed);
+	roundtrip ("lz4", lz4_compress, lz4_decompress, sizes[i], seed);
+      }
+}
+
+GRUB_UNIT_TEST ("zfs_decompress_unit_test", zfs_decompress_test);
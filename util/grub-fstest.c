@@ -35,6 +35,7 @@
 #include <grub/i18n.h>
 #include <grub/zfs/zfs.h>
 #include <grub/emu/hostfile.h>
+#include <grub/time.h>
 
 #include <stdio.h>
 #include <errno.h>
@@ -69,7 +70,8 @@ enum {
   CMD_BLOCKLIST,
   CMD_TESTLOAD,
   CMD_ZFSINFO,
-  CMD_XNU_UUID
+  CMD_XNU_UUID,
+  CMD_BENCH
 };
 #define BUF_SIZE  32256
 
@@ -367,6 +369,271 @@ cmd_crc (char *pathname)
   free (crc32_context);
 }
 
+/* Calls made into the driver of the root filesystem and reads issued to
+   the loopback devices while running a bench script.  */
+static struct
+{
+  unsigned long dir, open, read, close;
+  unsigned long disk_reads;
+  grub_uint64_t disk_sectors;
+} bench_stats;
+
+static struct grub_fs bench_fs_orig;
+static grub_err_t (*bench_disk_read_orig) (grub_disk_t disk,
+					   grub_disk_addr_t sector,
+					   grub_size_t size, char *buf);
+
+static grub_err_t
+bench_fs_dir (grub_device_t device, const char *path,
+	      grub_fs_dir_hook_t hook, void *hook_data)
+{
+  bench_stats.dir++;
+  return bench_fs_orig.dir (device, path, hook, hook_data);
+}
+
+static grub_err_t
+bench_fs_open (grub_file_t file, const char *name)
+{
+  bench_stats.open++;
+  return bench_fs_orig.open (file, name);
+}
+
+static grub_ssize_t
+bench_fs_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  bench_stats.read++;
+  return bench_fs_orig.read (file, buf, len);
+}
+
+static grub_err_t
+bench_fs_close (grub_file_t file)
+{
+  bench_stats.close++;
+  return bench_fs_orig.close ? bench_fs_orig.close (file) : GRUB_ERR_NONE;
+}
+
+static grub_err_t
+bench_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
+		 grub_size_t size, char *buf)
+{
+  bench_stats.disk_reads++;
+  bench_stats.disk_sectors += (grub_uint64_t) size
+    << (disk->log_sector_size - GRUB_DISK_SECTOR_BITS);
+  return bench_disk_read_orig (disk, sector, size, buf);
+}
+
+static int
+bench_dir_hook (const char *filename __attribute__ ((unused)),
+		const struct grub_dirhook_info *info __attribute__ ((unused)),
+		void *data)
+{
+  (*(unsigned long *) data)++;
+  return 0;
+}
+
+static grub_err_t
+bench_dir (const char *pathname)
+{
+  char *device_name;
+  const char *path;
+  grub_device_t dev;
+  grub_fs_t fs;
+  unsigned long n = 0;
+
+  device_name = grub_file_get_device_name (pathname);
+  if (grub_errno)
+    return grub_errno;
+  path = (pathname[0] == '(') ? grub_strchr (pathname, ')') : NULL;
+  path = path ? path + 1 : pathname;
+  if (! *path)
+    path = "/";
+
+  dev = grub_device_open (device_name);
+  grub_free (device_name);
+  if (! dev)
+    return grub_errno;
+
+  fs = grub_fs_probe (dev);
+  if (fs)
+    (fs->dir) (dev, path, bench_dir_hook, &n);
+  grub_device_close (dev);
+
+  grub_util_info ("%s: %lu entries", pathname, n);
+  return grub_errno;
+}
+
+static grub_err_t
+bench_read (const char *pathname, grub_off_t ofs, grub_off_t len,
+	    grub_uint64_t *total)
+{
+  static char buf[BUF_SIZE];
+  grub_file_t file;
+
+  if (uncompress == 0)
+    grub_file_filter_disable_compression ();
+  file = grub_file_open (pathname);
+  if (! file)
+    return grub_errno;
+
+  if (ofs > file->size)
+    ofs = file->size;
+  if (! len || len > file->size - ofs)
+    len = file->size - ofs;
+  grub_file_seek (file, ofs);
+
+  while (len)
+    {
+      grub_ssize_t sz;
+
+      sz = grub_file_read (file, buf, (len > BUF_SIZE) ? BUF_SIZE : len);
+      if (sz <= 0)
+	break;
+      *total += sz;
+      len -= sz;
+    }
+
+  grub_file_close (file);
+  return grub_errno;
+}
+
+/* Replay the operations listed in SCRIPT, one per line:
+
+     open PATH
+     read PATH [OFFSET [LENGTH]]
+     dir PATH
+
+   A line holding only a path reads the whole file, so a plain list of the
+   files touched by a boot can be replayed as is.  */
+static void
+cmd_bench (const char *script)
+{
+  FILE *f;
+  char line[4096];
+  grub_device_t dev;
+  grub_fs_t fs = NULL;
+  grub_disk_dev_t p;
+  unsigned long hits0, misses0, hits, misses, allocs0, ops = 0, errors = 0;
+  grub_uint64_t alloc_bytes0, data = 0, start, elapsed;
+
+  f = (strcmp (script, "-") == 0) ? stdin : grub_util_fopen (script, "r");
+  if (! f)
+    grub_util_error (_("cannot open OS file `%s': %s"), script,
+		     strerror (errno));
+
+  /* Wrap the driver of the root filesystem.  */
+  dev = grub_device_open (0);
+  if (dev)
+    {
+      fs = grub_fs_probe (dev);
+      grub_device_close (dev);
+    }
+  if (! fs)
+    grub_util_error ("%s", grub_errmsg);
+  bench_fs_orig = *fs;
+  fs->dir = bench_fs_dir;
+  fs->open = bench_fs_open;
+  fs->read = bench_fs_read;
+  fs->close = bench_fs_close;
+
+  for (p = grub_disk_dev_list; p; p = p->next)
+    if (p->id == GRUB_DISK_DEVICE_LOOPBACK_ID)
+      {
+	bench_disk_read_orig = p->read;
+	p->read = bench_disk_read;
+      }
+
+  grub_disk_cache_get_performance (&hits0, &misses0);
+  allocs0 = grub_mm_alloc_count;
+  alloc_bytes0 = grub_mm_alloc_bytes;
+  start = grub_get_time_ms ();
+
+  while (fgets (line, sizeof (line), f))
+    {
+      char *argv[4], *ptr = line;
+      int argc = 0;
+      grub_uint64_t op_start = grub_get_time_ms ();
+      grub_uint64_t op_sectors = bench_stats.disk_sectors;
+
+      while (argc < 4)
+	{
+	  while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')
+	    *ptr++ = 0;
+	  if (! *ptr || *ptr == '#')
+	    break;
+	  argv[argc++] = ptr;
+	  while (*ptr && *ptr != ' ' && *ptr != '\t' && *ptr != '\n'
+		 && *ptr != '\r')
+	    ptr++;
+	}
+      if (argc == 0)
+	continue;
+
+      if (argc == 1)
+	bench_read (argv[0], 0, 0, &data);
+      else if (strcmp (argv[0], "read") == 0)
+	bench_read (argv[1],
+		    argc > 2 ? grub_strtoull (argv[2], NULL, 0) : 0,
+		    argc > 3 ? grub_strtoull (argv[3], NULL, 0) : 0, &data);
+      else if (strcmp (argv[0], "open") == 0)
+	{
+	  grub_file_t file;
+
+	  if (uncompress == 0)
+	    grub_file_filter_disable_compression ();
+	  file = grub_file_open (argv[1]);
+	  if (file)
+	    grub_file_close (file);
+	}
+      else if (strcmp (argv[0], "dir") == 0)
+	bench_dir (argv[1]);
+      else
+	grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown bench operation `%s'",
+		    argv[0]);
+
+      ops++;
+      if (grub_errno)
+	{
+	  errors++;
+	  grub_print_error ();
+	}
+      grub_util_info ("%s %s: %" GRUB_HOST_PRIuLONG_LONG " ms, %lu sectors",
+		      argv[0], argc > 1 ? argv[1] : "",
+		      (unsigned long long) (grub_get_time_ms () - op_start),
+		      (unsigned long) (bench_stats.disk_sectors - op_sectors));
+    }
+
+  elapsed = grub_get_time_ms () - start;
+  grub_disk_cache_get_performance (&hits, &misses);
+  hits -= hits0;
+  misses -= misses0;
+
+  if (f != stdin)
+    fclose (f);
+  *fs = bench_fs_orig;
+  for (p = grub_disk_dev_list; p; p = p->next)
+    if (p->id == GRUB_DISK_DEVICE_LOOPBACK_ID)
+      p->read = bench_disk_read_orig;
+
+  printf ("operations: %lu (%lu failed), %" GRUB_HOST_PRIuLONG_LONG
+	  " bytes read\n", ops, errors, (unsigned long long) data);
+  printf ("wall time: %" GRUB_HOST_PRIuLONG_LONG " ms\n",
+	  (unsigned long long) elapsed);
+  printf ("disk: %lu reads, %" GRUB_HOST_PRIuLONG_LONG " sectors\n",
+	  bench_stats.disk_reads,
+	  (unsigned long long) bench_stats.disk_sectors);
+  printf ("disk cache: %lu hits, %lu misses", hits, misses);
+  if (hits + misses)
+    printf (" (%lu.%02lu%%)", hits * 10000 / (hits + misses) / 100,
+	    hits * 10000 / (hits + misses) % 100);
+  printf ("\n");
+  printf ("allocations: %lu, %" GRUB_HOST_PRIuLONG_LONG " bytes\n",
+	  grub_mm_alloc_count - allocs0,
+	  (unsigned long long) (grub_mm_alloc_bytes - alloc_bytes0));
+  printf ("%s: dir %lu, open %lu, read %lu, close %lu\n", fs->name,
+	  bench_stats.dir, bench_stats.open, bench_stats.read,
+	  bench_stats.close);
+}
+
 static const char *root = NULL;
 static int args_count = 0;
 static int nparm = 0;
@@ -458,6 +725,9 @@ fstest (int n)
       execute_command ("testload", n, args);
       grub_printf ("\n");
       break;
+    case CMD_BENCH:
+      cmd_bench (args[0]);
+      break;
     case CMD_XNU_UUID:
       {
 	grub_device_t dev;
@@ -512,6 +782,7 @@ static struct argp_option options[] = {
   {N_("crc FILE"), 0, 0     , OPTION_DOC, N_("Get crc32 checksum of FILE."), 1},
   {N_("blocklist FILE"), 0, 0, OPTION_DOC, N_("Display blocklist of FILE."), 1},
   {N_("xnu_uuid DEVICE"), 0, 0, OPTION_DOC, N_("Compute XNU UUID of the device."), 1},
+  {N_("bench SCRIPT"), 0, 0, OPTION_DOC, N_("Replay the opens, reads and directory listings in SCRIPT and report their cost."), 1},
   
   {"root",      'r', N_("DEVICE_NAME"), 0, N_("Set root device."),                 2},
   {"skip",      's', N_("NUM"),           0, N_("Skip N bytes from output file."),   2},
@@ -701,6 +972,11 @@ argp_parser (int key, char *arg, struct argp_state *state)
 	  cmd = CMD_TESTLOAD;
           nparm = 1;
 	}
+      else if (!grub_strcmp (arg, "bench"))
+	{
+	  cmd = CMD_BENCH;
+	  nparm = 1;
+	}
       else if (grub_strcmp (arg, "xnu_uuid") == 0)
 	{
 	  cmd = CMD_XNU_UUID;
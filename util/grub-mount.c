@@ -40,6 +40,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #pragma GCC diagnostic ignored "-Wmissing-prototypes"
 #pragma GCC diagnostic ignored "-Wmissing-declarations"
@@ -121,6 +122,192 @@ translate_error (void)
   return ret;
 }
 
+/* GRUB itself is single-threaded, so requests from the FUSE worker threads
+   take a ticket and enter the core one at a time, in arrival order.  */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long queue_head, queue_tail;
+
+static void
+core_enter (void)
+{
+  unsigned long ticket;
+
+  pthread_mutex_lock (&queue_lock);
+  ticket = queue_tail++;
+  while (ticket != queue_head)
+    pthread_cond_wait (&queue_cond, &queue_lock);
+  pthread_mutex_unlock (&queue_lock);
+}
+
+static void
+core_leave (void)
+{
+  pthread_mutex_lock (&queue_lock);
+  queue_head++;
+  pthread_cond_broadcast (&queue_cond);
+  pthread_mutex_unlock (&queue_lock);
+}
+
+/* Attributes of paths seen so far, including ones that don't exist.  The
+   mounted image is read-only, so entries never go stale.  Hits are served
+   without entering the core.  */
+#define ATTR_HASH_SIZE 4096
+#define ATTR_MAX_ENTRIES 65536
+
+struct attr_entry
+{
+  struct attr_entry *next;
+  int exists;
+  struct stat st;
+  char path[0];
+};
+
+static pthread_mutex_t attr_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct attr_entry *attr_hash[ATTR_HASH_SIZE];
+static unsigned attr_count;
+
+static unsigned
+attr_hash_path (const char *path)
+{
+  grub_uint32_t h = 2166136261U;
+
+  for (; *path; path++)
+    h = (h ^ (grub_uint8_t) *path) * 16777619U;
+  return h % ATTR_HASH_SIZE;
+}
+
+/* Return 1 and set *RET if PATH is cached.  */
+static int
+attr_cache_lookup (const char *path, struct stat *st, int *ret)
+{
+  struct attr_entry *e;
+  int found = 0;
+
+  pthread_mutex_lock (&attr_lock);
+  for (e = attr_hash[attr_hash_path (path)]; e; e = e->next)
+    if (strcmp (e->path, path) == 0)
+      {
+	if (e->exists)
+	  *st = e->st;
+	*ret = e->exists ? 0 : -ENOENT;
+	found = 1;
+	break;
+      }
+  pthread_mutex_unlock (&attr_lock);
+  return found;
+}
+
+/* Remember ST for PATH, or that PATH doesn't exist if ST is NULL.  */
+static void
+attr_cache_insert (const char *path, const struct stat *st)
+{
+  struct attr_entry *e;
+  unsigned h = attr_hash_path (path), i;
+
+  pthread_mutex_lock (&attr_lock);
+  for (e = attr_hash[h]; e; e = e->next)
+    if (strcmp (e->path, path) == 0)
+      goto out;
+
+  if (attr_count >= ATTR_MAX_ENTRIES)
+    {
+      for (i = 0; i < ATTR_HASH_SIZE; i++)
+	while (attr_hash[i])
+	  {
+	    e = attr_hash[i];
+	    attr_hash[i] = e->next;
+	    free (e);
+	  }
+      attr_count = 0;
+    }
+
+  e = malloc (sizeof (*e) + strlen (path) + 1);
+  if (! e)
+    goto out;
+  strcpy (e->path, path);
+  e->exists = !! st;
+  if (st)
+    e->st = *st;
+  e->next = attr_hash[h];
+  attr_hash[h] = e;
+  attr_count++;
+
+ out:
+  pthread_mutex_unlock (&attr_lock);
+}
+
+/* Open PATH on the mounted filesystem.  This is grub_file_open without the
+   filesystem probe, which would otherwise try every driver on each request.
+   Called with the core entered.  */
+static grub_file_t
+mount_file_open (const char *path)
+{
+  grub_file_t file, last_file = 0;
+  grub_file_filter_id_t filter;
+
+  file = grub_zalloc (sizeof (*file));
+  if (! file)
+    return 0;
+
+  file->fs = fs;
+  file->device = grub_device_open (0);
+  if (! file->device || (fs->open) (file, path) != GRUB_ERR_NONE)
+    {
+      if (file->device)
+	grub_device_close (file->device);
+      grub_free (file);
+      return 0;
+    }
+  file->name = grub_strdup (path);
+
+  for (filter = 0; file && filter < ARRAY_SIZE (grub_file_filters_enabled);
+       filter++)
+    if (grub_file_filters_enabled[filter])
+      {
+	last_file = file;
+	file = grub_file_filters_enabled[filter] (file, path);
+      }
+  if (! file)
+    grub_file_close (last_file);
+
+  return file;
+}
+
+/* Fill ST for PATH described by INFO.  Regular files have to be opened to
+   learn their size.  Called with the core entered.  */
+static int
+fill_stat (const char *path, const struct grub_dirhook_info *info,
+	   struct stat *st)
+{
+  grub_memset (st, 0, sizeof (*st));
+  st->st_mode = info->dir ? (0555 | S_IFDIR) : (0444 | S_IFREG);
+  if (!info->dir)
+    {
+      grub_file_t file;
+      file = mount_file_open (path);
+      /* Symlink to directory.  */
+      if (! file && grub_errno == GRUB_ERR_BAD_FILE_TYPE)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  st->st_mode = (0555 | S_IFDIR);
+	}
+      else if (! file)
+	return translate_error ();
+      else
+	{
+	  st->st_size = file->size;
+	  grub_file_close (file);
+	}
+    }
+  st->st_blksize = 512;
+  st->st_blocks = (st->st_size + 511) >> 9;
+  st->st_atime = st->st_mtime = st->st_ctime
+    = info->mtimeset ? info->mtime : 0;
+  grub_errno = GRUB_ERR_NONE;
+  return 0;
+}
+
 /* Context for fuse_getattr.  */
 struct fuse_getattr_ctx
 {
@@ -151,6 +338,7 @@ fuse_getattr (const char *path, struct stat *st)
 {
   struct fuse_getattr_ctx ctx;
   char *pathname, *path2;
+  int ret;
   
   if (path[0] == '/' && path[1] == 0)
     {
@@ -167,6 +355,9 @@ fuse_getattr (const char *path, struct stat *st)
       return 0;
     }
 
+  if (attr_cache_lookup (path, st, &ret))
+    return ret;
+
   ctx.file_exists = 0;
 
   pathname = xstrdup (path);
@@ -179,55 +370,37 @@ fuse_getattr (const char *path, struct stat *st)
   ctx.filename = grub_strrchr (pathname, '/');
   if (! ctx.filename)
     {
-      path2 = grub_strdup ("/");
+      path2 = xstrdup ("/");
       ctx.filename = pathname;
     }
   else
     {
       ctx.filename++;
-      path2 = grub_strdup (pathname);
+      path2 = xstrdup (pathname);
       path2[ctx.filename - pathname] = 0;
     }
 
+  core_enter ();
+
   /* It's the whole device. */
   (fs->dir) (dev, path2, fuse_getattr_find_file, &ctx);
 
-  grub_free (path2);
   if (!ctx.file_exists)
     {
       grub_errno = GRUB_ERR_NONE;
-      return -ENOENT;
+      ret = -ENOENT;
     }
-  st->st_dev = 0;
-  st->st_ino = 0;
-  st->st_mode = ctx.file_info.dir ? (0555 | S_IFDIR) : (0444 | S_IFREG);
-  st->st_uid = 0;
-  st->st_gid = 0;
-  st->st_rdev = 0;
-  st->st_size = 0;
-  if (!ctx.file_info.dir)
-    {
-      grub_file_t file;
-      file = grub_file_open (path);
-      if (! file && grub_errno == GRUB_ERR_BAD_FILE_TYPE)
-	{
-	  grub_errno = GRUB_ERR_NONE;
-	  st->st_mode = (0555 | S_IFDIR);
-	}
-      else if (! file)
-	return translate_error ();
-      else
-	{
-	  st->st_size = file->size;
-	  grub_file_close (file);
-	}
-    }
-  st->st_blksize = 512;
-  st->st_blocks = (st->st_size + 511) >> 9;
-  st->st_atime = st->st_mtime = st->st_ctime = ctx.file_info.mtimeset
-    ? ctx.file_info.mtime : 0;
-  grub_errno = GRUB_ERR_NONE;
-  return 0;
+  else
+    ret = fill_stat (path, &ctx.file_info, st);
+
+  core_leave ();
+
+  free (path2);
+  free (pathname);
+
+  if (ret == 0 || ret == -ENOENT)
+    attr_cache_insert (path, ret == 0 ? st : NULL);
+  return ret;
 }
 
 static int
@@ -236,52 +409,56 @@ fuse_opendir (const char *path, struct fuse_file_info *fi)
   return 0;
 }
 
-/* FIXME */
-static grub_file_t files[65536];
-static int first_fd = 1;
-
 static int 
-fuse_open (const char *path, struct fuse_file_info *fi __attribute__ ((unused)))
+fuse_open (const char *path, struct fuse_file_info *fi)
 {
   grub_file_t file;
-  file = grub_file_open (path);
+  int ret = 0;
+
+  core_enter ();
+  file = mount_file_open (path);
   if (! file)
-    return translate_error ();
-  files[first_fd++] = file;
-  fi->fh = first_fd;
-  files[first_fd++] = file;
+    ret = translate_error ();
   grub_errno = GRUB_ERR_NONE;
-  return 0;
+  core_leave ();
+
+  if (file)
+    fi->fh = (grub_addr_t) file;
+  return ret;
 } 
 
 static int 
 fuse_read (const char *path, char *buf, size_t sz, off_t off,
 	   struct fuse_file_info *fi)
 {
-  grub_file_t file = files[fi->fh];
+  grub_file_t file = (grub_file_t) (grub_addr_t) fi->fh;
   grub_ssize_t size;
+  int ret;
 
   if (off > file->size)
     return -EINVAL;
 
-  file->offset = off;
-  
+  core_enter ();
+  grub_file_seek (file, off);
   size = grub_file_read (file, buf, sz);
   if (size < 0)
-    return translate_error ();
+    ret = translate_error ();
   else
     {
       grub_errno = GRUB_ERR_NONE;
-      return size;
+      ret = size;
     }
+  core_leave ();
+  return ret;
 } 
 
 static int 
 fuse_release (const char *path, struct fuse_file_info *fi)
 {
-  grub_file_close (files[fi->fh]);
-  files[fi->fh] = NULL;
+  core_enter ();
+  grub_file_close ((grub_file_t) (grub_addr_t) fi->fh);
   grub_errno = GRUB_ERR_NONE;
+  core_leave ();
   return 0;
 }
 
@@ -293,43 +470,25 @@ struct fuse_readdir_ctx
   fuse_fill_dir_t fill;
 };
 
-/* Helper for fuse_readdir.  */
+/* Helper for fuse_readdir.  Stat every entry while we are here, so that the
+   getattr calls following a listing are answered from the cache.  */
 static int
 fuse_readdir_call_fill (const char *filename,
 			const struct grub_dirhook_info *info, void *data)
 {
   struct fuse_readdir_ctx *ctx = data;
   struct stat st;
+  char *tmp;
 
-  grub_memset (&st, 0, sizeof (st));
-  st.st_mode = info->dir ? (0555 | S_IFDIR) : (0444 | S_IFREG);
-  if (!info->dir)
+  tmp = xasprintf ("%s/%s", ctx->path[1] ? ctx->path : "", filename);
+  if (fill_stat (tmp, info, &st) == 0)
+    attr_cache_insert (tmp, &st);
+  else
     {
-      grub_file_t file;
-      char *tmp;
-      tmp = xasprintf ("%s/%s", ctx->path, filename);
-      file = grub_file_open (tmp);
-      free (tmp);
-      /* Symlink to directory.  */
-      if (! file && grub_errno == GRUB_ERR_BAD_FILE_TYPE)
-	{
-	  grub_errno = GRUB_ERR_NONE;
-	  st.st_mode = (0555 | S_IFDIR);
-	}
-      else if (!file)
-	{
-	  grub_errno = GRUB_ERR_NONE;
-	}
-      else
-	{
-	  st.st_size = file->size;
-	  grub_file_close (file);
-	}
+      grub_memset (&st, 0, sizeof (st));
+      st.st_mode = info->dir ? (0555 | S_IFDIR) : (0444 | S_IFREG);
     }
-  st.st_blksize = 512;
-  st.st_blocks = (st.st_size + 511) >> 9;
-  st.st_atime = st.st_mtime = st.st_ctime
-    = info->mtimeset ? info->mtime : 0;
+  free (tmp);
   ctx->fill (ctx->buf, filename, &st, 0);
   return 0;
 }
@@ -339,7 +498,6 @@ fuse_readdir (const char *path, void *buf,
 	      fuse_fill_dir_t fill, off_t off, struct fuse_file_info *fi)
 {
   struct fuse_readdir_ctx ctx = {
-    .path = path,
     .buf = buf,
     .fill = fill
   };
@@ -351,14 +509,28 @@ fuse_readdir (const char *path, void *buf,
   while (pathname [0] && pathname[1]
 	 && pathname[grub_strlen (pathname) - 1] == '/')
     pathname[grub_strlen (pathname) - 1] = 0;
+  ctx.path = pathname;
 
+  core_enter ();
   (fs->dir) (dev, pathname, fuse_readdir_call_fill, &ctx);
-  free (pathname);
   grub_errno = GRUB_ERR_NONE;
+  core_leave ();
+
+  free (pathname);
   return 0;
 }
 
+static void *
+fuse_init_conn (struct fuse_conn_info *conn)
+{
+#ifdef FUSE_CAP_BIG_WRITES
+  conn->want |= FUSE_CAP_BIG_WRITES;
+#endif
+  return NULL;
+}
+
 struct fuse_operations grub_opers = {
+  .init = fuse_init_conn,
   .getattr = fuse_getattr,
   .open = fuse_open,
   .release = fuse_release,
@@ -562,11 +734,16 @@ main (int argc, char *argv[])
 
   grub_util_host_init (&argc, &argv);
 
-  fuse_args = xrealloc (fuse_args, (fuse_argc + 2) * sizeof (fuse_args[0]));
+  fuse_args = xrealloc (fuse_args, (fuse_argc + 3) * sizeof (fuse_args[0]));
   fuse_args[fuse_argc] = xstrdup (argv[0]);
   fuse_argc++;
-  /* Run single-threaded.  */
-  fuse_args[fuse_argc] = xstrdup ("-s");
+  /* The image doesn't change under us: let the kernel keep file pages and
+     lookups around.  Options given on the command line come later and
+     override these.  */
+  fuse_args[fuse_argc] = xstrdup ("-o");
+  fuse_argc++;
+  fuse_args[fuse_argc] = xstrdup ("kernel_cache,entry_timeout=3600,"
+				  "attr_timeout=3600,negative_timeout=3600");
   fuse_argc++;
 
   argp_parse (&argp, argc, argv, 0, 0, 0);
@@ -74,7 +74,8 @@ enum {
   PRINT_MSDOS_PARTTYPE,
   PRINT_GPT_PARTTYPE,
   PRINT_ZERO_CHECK,
-  PRINT_DISK
+  PRINT_DISK,
+  PRINT_BLOCKMAP
 };
 
 static const char *targets[] =
@@ -98,6 +99,7 @@ static const char *targets[] =
     [PRINT_GPT_PARTTYPE]       = "gpt_parttype",
     [PRINT_ZERO_CHECK]         = "zero_check",
     [PRINT_DISK]               = "disk",
+    [PRINT_BLOCKMAP]           = "blockmap",
   };
 
 static int print = PRINT_FS;
@@ -252,6 +254,184 @@ probe_abstraction (grub_disk_t disk, char delim)
     printf ("raid6rec%c", delim);
 }
 
+/* Context for probe_blockmap.  */
+struct blockmap_ctx
+{
+  grub_disk_addr_t part_start;
+  grub_disk_addr_t start;
+  grub_disk_addr_t count;
+  grub_uint64_t covered;
+  int tail;
+  int bad;
+  char *list;
+};
+
+/* Helper for probe_blockmap.  */
+static void
+blockmap_flush (struct blockmap_ctx *ctx)
+{
+  char *list;
+
+  if (!ctx->count)
+    return;
+  list = xasprintf ("%s%s%llu+%llu", ctx->list ? : "", ctx->list ? "," : "",
+		    (unsigned long long) (ctx->start - ctx->part_start),
+		    (unsigned long long) ctx->count);
+  free (ctx->list);
+  ctx->list = list;
+  ctx->count = 0;
+}
+
+/* Helper for probe_blockmap.  Only whole sectors can go into a block
+   list, so anything but a partial last sector makes the file
+   unmappable.  */
+static void
+blockmap_read_hook (grub_disk_addr_t sector, unsigned offset, unsigned length,
+		    void *data)
+{
+  struct blockmap_ctx *ctx = data;
+
+  if (offset || ctx->tail)
+    ctx->bad = 1;
+  if (ctx->bad)
+    return;
+  if (length & (GRUB_DISK_SECTOR_SIZE - 1))
+    ctx->tail = 1;
+
+  if (!ctx->count || ctx->start + ctx->count != sector)
+    {
+      blockmap_flush (ctx);
+      ctx->start = sector;
+    }
+  ctx->count += ALIGN_UP (length, GRUB_DISK_SECTOR_SIZE) >> GRUB_DISK_SECTOR_BITS;
+  ctx->covered += length;
+}
+
+/* Hash the contents of FILE with HASH into RESULT.  */
+static void
+blockmap_hash (grub_file_t file, const gcry_md_spec_t *hash,
+	       grub_uint8_t *result)
+{
+  void *context = xmalloc (hash->contextsize);
+  char buf[65536];
+  grub_ssize_t r;
+
+  hash->init (context);
+  while ((r = grub_file_read (file, buf, sizeof (buf))) > 0)
+    hash->write (context, buf, r);
+  if (r < 0)
+    grub_util_error ("%s", grub_errmsg);
+  hash->final (context);
+  memcpy (result, hash->read (context), hash->mdlen);
+  free (context);
+}
+
+/* Return whether the time of last write FS reports only changes when the
+   files on it may have moved.  ext2 (also used for ext3 and ext4) and
+   nilfs2 report the superblock write time, which changes on every mount
+   and unmount, so a block map recorded from them would be thrown away on
+   the next boot; the SHA-256 hash alone protects those.  */
+static int
+blockmap_mtime_usable (grub_fs_t fs)
+{
+  return (fs->mtime && grub_strcmp (fs->name, "ext2") != 0
+	  && grub_strcmp (fs->name, "nilfs2") != 0);
+}
+
+/* Print the block map line of PATH, which lives on DRIVE:
+   "PATH UUID GENERATION SIZE SHA256 BLOCKLIST".  */
+static void
+probe_blockmap (const char *drive, const char *path, char delim)
+{
+  const gcry_md_spec_t *hash;
+  grub_uint8_t result[GRUB_CRYPTO_MAX_MDLEN], check[GRUB_CRYPTO_MAX_MDLEN];
+  struct blockmap_ctx ctx;
+  grub_device_t dev;
+  grub_fs_t fs;
+  grub_file_t file;
+  char *canon, *relpath, *name, *uuid = NULL;
+  grub_int32_t mtime;
+  grub_uint64_t size;
+  unsigned i;
+
+  hash = grub_crypto_lookup_md_by_name ("sha256");
+  if (!hash)
+    grub_util_error ("%s", grub_errmsg);
+
+  dev = grub_device_open (drive);
+  if (! dev)
+    grub_util_error ("%s", grub_errmsg);
+  if (! dev->disk)
+    grub_util_error (_("%s is not a disk"), drive);
+  fs = grub_fs_probe (dev);
+  if (! fs)
+    grub_util_error ("%s", grub_errmsg);
+
+  canon = grub_canonicalize_file_name (path);
+  if (! canon)
+    grub_util_error (_("failed to get canonical path of `%s'"), path);
+  relpath = grub_make_system_path_relative_to_its_root (canon);
+  free (canon);
+  for (i = 0; relpath[i]; i++)
+    if (grub_isspace (relpath[i]))
+      grub_util_error (_("cannot map `%s': name contains spaces"), path);
+
+  memset (&ctx, 0, sizeof (ctx));
+  ctx.part_start = grub_partition_get_start (dev->disk->partition);
+
+  name = xasprintf ("(%s)%s", drive, relpath);
+  grub_file_filter_disable_all ();
+  file = grub_file_open (name);
+  free (name);
+  if (! file)
+    grub_util_error ("%s", grub_errmsg);
+  size = file->size;
+  file->read_hook = blockmap_read_hook;
+  file->read_hook_data = &ctx;
+  blockmap_hash (file, hash, result);
+  grub_file_close (file);
+  blockmap_flush (&ctx);
+
+  if (ctx.bad || ctx.covered != size || !ctx.list)
+    grub_util_error (_("cannot map `%s': it is not stored in whole sectors"),
+		     path);
+
+  /* Read it back through the block list to be sure.  */
+  name = xasprintf ("(%s)%s", drive, ctx.list);
+  grub_file_filter_disable_all ();
+  file = grub_file_open (name);
+  free (name);
+  if (! file)
+    grub_util_error ("%s", grub_errmsg);
+  file->size = size;
+  blockmap_hash (file, hash, check);
+  grub_file_close (file);
+  if (memcmp (result, check, hash->mdlen) != 0)
+    grub_util_error (_("cannot map `%s': its block list does not match its "
+		       "contents"), path);
+
+  if (fs->uuid && fs->uuid (dev, &uuid) != GRUB_ERR_NONE)
+    grub_util_error ("%s", grub_errmsg);
+
+  printf ("%s %s ", relpath, uuid ? : "-");
+  if (blockmap_mtime_usable (fs)
+      && fs->mtime (dev, &mtime) == GRUB_ERR_NONE)
+    printf ("%d ", (int) mtime);
+  else
+    printf ("- ");
+  grub_errno = GRUB_ERR_NONE;
+  printf ("%llu ", (unsigned long long) size);
+  for (i = 0; i < hash->mdlen; i++)
+    printf ("%02x", result[i]);
+  printf (" %s", ctx.list);
+  putchar (delim);
+
+  grub_free (uuid);
+  free (ctx.list);
+  free (relpath);
+  grub_device_close (dev);
+}
+
 static void
 probe (const char *path, char **device_names, char delim)
 {
@@ -367,6 +547,14 @@ probe (const char *path, char **device_names, char delim)
       grub_printf ("true\n");
     }
 
+  if (print == PRINT_BLOCKMAP)
+    {
+      if (path == NULL)
+	grub_util_error (_("target `%s' needs a path"), targets[print]);
+      probe_blockmap (drives_names[0], path, delim);
+      goto end;
+    }
+
   if (print == PRINT_FS || print == PRINT_FS_UUID
       || print == PRINT_FS_LABEL)
     {
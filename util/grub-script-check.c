@@ -22,10 +22,12 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/emu/misc.h>
+#include <grub/emu/hostfile.h>
 #include <grub/util/misc.h>
 #include <grub/i18n.h>
 #include <grub/parser.h>
 #include <grub/script_sh.h>
+#include <grub/crypto.h>
 
 #define _GNU_SOURCE	1
 
@@ -46,10 +48,13 @@ struct arguments
 {
   int verbose;
   char *filename;
+  char *output;
 };
 
 static struct argp_option options[] = {
   {"verbose",     'v', 0,      0, N_("print verbose messages."), 0},
+  {"output",      'o', N_("FILE"), 0,
+   N_("save the pre-parsed script to FILE."), 0},
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -66,6 +71,11 @@ argp_parser (int key, char *arg, struct argp_state *state)
       arguments->verbose = 1;
       break;
 
+    case 'o':
+      free (arguments->output);
+      arguments->output = xstrdup (arg);
+      break;
+
     case ARGP_KEY_ARG:
       if (state->arg_num == 0)
 	arguments->filename = xstrdup (arg);
@@ -139,6 +149,48 @@ get_config_line (char **line, int cont __attribute__ ((unused)), void *data)
   return 0;
 }
 
+static void
+write_compiled (const struct arguments *arguments)
+{
+  char *source;
+  size_t size;
+  void *image;
+  grub_size_t image_size;
+  FILE *out;
+
+  if (! arguments->filename)
+    grub_util_error ("%s", _("pre-parsed output needs an input file"));
+
+  size = grub_util_get_image_size (arguments->filename);
+  source = grub_util_read_image (arguments->filename);
+
+  grub_gcry_init_all ();
+  if (grub_script_compile (source, size, &image, &image_size))
+    {
+      if (grub_errno != GRUB_ERR_OUT_OF_RANGE)
+	grub_util_error ("%s", grub_errmsg);
+
+      /* The script is still valid; normal mode parses it itself.  */
+      grub_util_warn (_("not saving the pre-parsed form: %s"), grub_errmsg);
+      grub_util_unlink (arguments->output);
+      grub_errno = GRUB_ERR_NONE;
+      free (source);
+      return;
+    }
+
+  out = grub_util_fopen (arguments->output, "wb");
+  if (! out)
+    grub_util_error (_("cannot open `%s': %s"), arguments->output,
+		     strerror (errno));
+  grub_util_write_image (image, image_size, out, arguments->output);
+  if (fclose (out) != 0)
+    grub_util_error (_("cannot close `%s': %s"), arguments->output,
+		     strerror (errno));
+
+  grub_free (image);
+  free (source);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -214,5 +266,8 @@ main (int argc, char *argv[])
       return 1;
     }
 
+  if (ctx.arguments.output)
+    write_compiled (&ctx.arguments);
+
   return 0;
 }